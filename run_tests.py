@@ -12,11 +12,17 @@ _CLEAN_CMD   = ["make", "clean"]
 _STAGE_FILE  = "src/compiler_stages.h"
 _BIN         = "build/albatross"
 
+# Seconds a single test may take, compilation included. Large inputs such as
+# tests/runtime-tests/07-while/pass7 fail here if compile time goes
+# superlinear again.
+_TIMEOUT     = 60
+
 _STAGE_FLAGS = [
     "COMPILE_STAGE_LEXER", 
     "COMPILE_STAGE_PARSER",
     "COMPILE_STAGE_SYMBOL_RESOLVER",
-    "COMPILE_STAGE_TYPE_CHECKER"
+    "COMPILE_STAGE_TYPE_CHECKER",
+    "COMPILE_STAGE_EXECUTOR"
 ]
 
 _DEFAULT_COMPILER_STAGES_FILE_CONTENTS = """// DO NOT EDIT MANUALLY. 
@@ -24,11 +30,24 @@ _DEFAULT_COMPILER_STAGES_FILE_CONTENTS = """// DO NOT EDIT MANUALLY.
 // stages of Albatross.\n
 """ + "\n".join([f"#define {flag}" for flag in _STAGE_FLAGS])
 
-# test dir, #defined stage flags, valid return codes on failure
+# Every execution engine runs the whole runtime test suite. The tiered engine
+# runs with low thresholds so that functions are recompiled mid-run.
+_ENGINES = [
+    ["--exec=interp"],
+    ["--exec=bytecode"],
+    ["--exec=baseline"],
+    ["--exec=jit"],
+    ["--exec=tiered", "--tier-calls=2", "--tier-loops=3"],
+]
+
+# test dir, #defined stage flags, valid return codes on failure, extra args
 _COMPAT_TEST_CONFIGS = [
-    ("tests/lexer-tests",    _STAGE_FLAGS[:1], [201]),
-    ("tests/parser-tests",   _STAGE_FLAGS[:2], [202]),
-    ("tests/semantic-tests", _STAGE_FLAGS[:4], [203, 204]),
+    ("tests/lexer-tests",    _STAGE_FLAGS[:1], [201], []),
+    ("tests/parser-tests",   _STAGE_FLAGS[:2], [202], []),
+    ("tests/semantic-tests", _STAGE_FLAGS[:4], [203, 204], []),
+] + [
+    ("tests/runtime-tests",  _STAGE_FLAGS[:5], [205], engine_args)
+    for engine_args in _ENGINES
 ]
 
 _SKIP = {
@@ -79,14 +98,21 @@ def main():
     total_failed  = 0
     total_skipped = 0
 
-    for test_dir, flags, fail_errcodes in _COMPAT_TEST_CONFIGS:
-        # Compile the binary w/ given flags for this test group.
-        define_flags(flags)
+    built_flags = None
+    for test_dir, flags, fail_errcodes, extra_args in _COMPAT_TEST_CONFIGS:
+        # Compile the binary w/ given flags for this test group. Consecutive
+        # groups with the same flags share a binary.
+        if flags != built_flags:
+            define_flags(flags)
+
+            print("Compiling binary for", test_dir)
 
-        print("Compiling binary for", test_dir)
+            subprocess.run(_CLEAN_CMD, check=True, capture_output=True)
+            subprocess.run(_BUILD_CMD, check=True, capture_output=True)
+            built_flags = flags
 
-        subprocess.run(_CLEAN_CMD, check=True, capture_output=True)
-        subprocess.run(_BUILD_CMD, check=True, capture_output=True)
+        if extra_args:
+            print("Running", test_dir, "with", " ".join(extra_args))
 
         for test_subgroup in sorted(os.listdir(test_dir)):
             subgroup_path = f"{test_dir}/{test_subgroup}/"
@@ -111,13 +137,14 @@ def main():
                 passed      = False
                 should_fail = input_file[:4] == "fail"
 
-                result      = subprocess.run([_BIN, input_path], capture_output=True)
                 total_run  += 1
 
-                with open("dummy", "w") as dummy:
-                    dummy.write(result.stdout.decode("utf-8") + "\n")
-
                 try:
+                    result = subprocess.run([_BIN, *extra_args, input_path], capture_output=True, timeout=_TIMEOUT)
+
+                    with open("dummy", "w") as dummy:
+                        dummy.write(result.stdout.decode("utf-8") + "\n")
+
                     result.check_returncode()
                     if output_file is not None:
                         # Compare output
@@ -129,7 +156,10 @@ def main():
                     if should_fail and result.returncode in fail_errcodes:
                         passed = True
 
-                os.system("rm dummy")
+                except subprocess.TimeoutExpired:
+                    pass
+
+                os.system("rm -f dummy")
                 if passed:
                     total_passed += 1
                 else:
@@ -1,45 +1,58 @@
-#include <deque>
-#include <fstream>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "bytecode.h"
 #include "compiler_stages.h"
 #include "error.h"
+#include "interp.h"
+#include "ir.h"
+#include "jit.h"
 #include "lexer.h"
+#include "lower_ir.h"
+#include "options.h"
 #include "parser.h"
+#include "pass_manager.h"
+#include "program.h"
+#include "runtime.h"
+#include "source_file.h"
 #include "symres.h"
 #include "transform_ast.h"
 #include "typecheck.h"
+#include "vm.h"
 
 int
 main(int argc, char *argv[])
 {
-    if (argc < 2) {
-        // This should just switch to interactive mode
-        std::cerr << "Error: no input file" << std::endl;
-        exit(EXIT_FAILURE);
-    }
+    Options options = parse_options(argc, argv);
 
-    std::ifstream file;
-    file.open(argv[1]);
-
-    if (!file.is_open()) {
+    SourceFile source;
+    if (!source.open(options.path)) {
         perror("Error: open()");
         exit(EXIT_FAILURE);
     }
 
-    std::string content((std::istreambuf_iterator<char>(file)),
-                        (std::istreambuf_iterator<char>()));
+    std::string_view content = source.text();
 
     try {
 #ifdef COMPILE_STAGE_LEXER
         ProgramText text(content);
 
-        auto tokens = tokenize(text);
+        auto lex_start = std::chrono::steady_clock::now();
+        auto tokens    = tokenize(text);
+        auto lex_end   = std::chrono::steady_clock::now();
+
+        rt_stats.lex_bytes = content.size();
+        rt_stats.lex_seconds =
+            std::chrono::duration<double>(lex_end - lex_start).count();
 
 #ifdef COMPILE_STAGE_PARSER
-        auto stmts = parse_stmts(tokens);
+        TokenCursor cursor(tokens);
+        auto        stmts = parse_stmts(cursor);
+
+        // Nothing after the parser reads tokens, so free them.
+        tokens = TokenStream(content);
 
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
         SymbolResolverVisitor srsv;
@@ -50,19 +63,83 @@ main(int argc, char *argv[])
         TypecheckVisitor tcsv;
         tcsv.visit_stmts(stmts);
 
-        bool should_optimize = true;
-        while (should_optimize) {
-            should_optimize = false;
-            should_optimize |= fold_stmts(stmts);
-            should_optimize |= dce_stmts(stmts);
+        optimize_ast(stmts, options.opt.level);
+        mark_tail_calls(stmts);
+        print_warnings(content);
+
+#ifdef COMPILE_STAGE_EXECUTOR
+        Program program = collect_program(stmts);
+
+        if (options.dump_ir) {
+            IRProgram ir = lower_program(program, options.opt);
+            print_ir(ir, std::cout);
+            exit(EXIT_SUCCESS);
+        }
+
+        rt_source        = content;
+        rt_stats.enabled = options.stats;
+        rt_start_stats(engine_name(options.engine));
+
+        int exit_code = 0;
+        switch (options.engine) {
+        case ExecEngine::Interp: {
+            Interpreter interp(program);
+            exit_code = interp.run();
+            break;
+        }
+        case ExecEngine::Bytecode: {
+            IRProgram ir = lower_program(program, options.opt);
+            BCProgram bc = compile_bytecode(ir);
+            VM        vm(bc);
+            exit_code = vm.run();
+            break;
+        }
+        case ExecEngine::Baseline: {
+            JIT jit(program.funs.size(), program.n_globals);
+            for (unsigned int i = 0; i < program.funs.size(); i++) {
+                if (i == 0 || program.funs[i]) {
+                    jit.compile_baseline(program, i);
+                }
+            }
+            exit_code = jit.run();
+            break;
+        }
+        case ExecEngine::Tiered: {
+            JIT jit(program.funs.size(), program.n_globals);
+            jit.enable_tiering(program,
+                               options.tier_calls,
+                               options.tier_loops,
+                               options.opt);
+            for (unsigned int i = 0; i < program.funs.size(); i++) {
+                if (i == 0 || program.funs[i]) {
+                    jit.compile_baseline(program, i);
+                }
+            }
+            exit_code = jit.run();
+            break;
+        }
+        case ExecEngine::Jit: {
+            IRProgram ir = lower_program(program, options.opt);
+            JIT       jit(ir.funs.size(), ir.n_globals);
+            for (auto &fun : ir.funs) {
+                if (fun) {
+                    jit.compile(*fun);
+                }
+            }
+            exit_code = jit.run();
+            break;
+        }
         }
 
+        rt_exit(exit_code);
+#endif
 #endif
 #endif
 #endif
 #endif
     } catch (AlbatrossError &e) {
-        print_err(content, e.line_num(), e.col_num(), e.what());
+        fflush(stdout);
+        print_err(content, e.pos(), e.what());
         exit(e.exit_code());
     }
 }
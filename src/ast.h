@@ -3,11 +3,13 @@
 #include <deque>
 #include <list>
 #include <memory>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
 
 #include "error.h"
+#include "string_pool.h"
 #include "token.h"
 #include "types.h"
 
@@ -71,6 +73,11 @@ typedef struct {
 typedef struct {
     Type var_type;
     int  var_idx;
+
+    // var_idx_db of the function that declared this variable (0 for the top
+    // level), and the variable's slot within that function's frame.
+    int fun_idx;
+    int frame_idx;
 } VarInfo;
 
 typedef struct {
@@ -98,8 +105,7 @@ public:
 };
 
 struct ExpNode {
-    int line_num = -1;
-    int col_num  = -1;
+    SourcePos pos = -1;
 
     unsigned int reg = -1;
 
@@ -136,7 +142,8 @@ struct IntNode : ExpNode {
 };
 
 struct StrNode : ExpNode {
-    std::string sval;
+    // Index of the literal in string_pool; the default is the empty string.
+    int str_idx = 0;
 
     StrNode()
     {
@@ -145,7 +152,7 @@ struct StrNode : ExpNode {
 
     std::string to_str() override
     {
-        return "(\"" + sval + "\")";
+        return "(\"" + std::string(string_pool.get(str_idx)->view()) + "\")";
     }
 
     void accept(ExpVisitor &visitor) override
@@ -286,8 +293,7 @@ public:
 };
 
 struct StmtNode {
-    int line_num = -1;
-    int col_num  = -1;
+    SourcePos pos = -1;
 
     enum StmtKind {
         AssignStmt,
@@ -323,6 +329,7 @@ struct VardeclNode : StmtNode {
     Type                     type;
     std::string              lhs;
     std::unique_ptr<ExpNode> rhs;
+    std::optional<VarInfo>   var_info;
 
     VardeclNode()
     {
@@ -403,6 +410,11 @@ struct FundecNode : StmtNode {
     std::string                          name;
     std::vector<ParamNode>               params;
     std::list<std::unique_ptr<StmtNode>> body;
+    std::optional<FunInfo>               fun_info;
+
+    // Number of frame slots (parameters first, then locals) the function
+    // needs. Filled in by the symbol resolver.
+    int frame_size = 0;
 
     FundecNode()
     {
@@ -418,6 +430,10 @@ struct FundecNode : StmtNode {
 struct RetNode : StmtNode {
     std::optional<std::unique_ptr<ExpNode>> ret_exp = std::nullopt;
 
+    // Set by mark_tail_calls() when ret_exp is a call to the enclosing
+    // function itself, which may then reuse the current frame.
+    bool tail_call = false;
+
     RetNode()
     {
         kind = StmtKind::RetStmt;
@@ -0,0 +1,890 @@
+#include "builtins.h"
+#include "jit.h"
+
+// The baseline compiler emits code for one function in a single walk over its
+// AST, with no IR and no register allocation. Variables live in their frame
+// slots (VarInfo::frame_idx); expressions are evaluated in a stack of
+// temporary registers.
+//
+// Each expression's ExpNode::reg holds its Sethi-Ullman number: the number of
+// temporaries needed to evaluate it without spilling. Evaluating the operand
+// with the larger number first keeps the other one's value in a register for
+// the shortest time. The top bit marks expressions that have no side effects,
+// cannot fail and read no globals; only those may be evaluated out of source
+// order.
+//
+// When tiering, the code also counts its calls and loop back-edges and calls
+// back into the JIT once a count runs out (see jit.h): to be recompiled, or to
+// continue a hot loop in optimized code.
+
+// RAX and RDX are left free for results and division, R11 for spills.
+const Reg TEMP_REGS[] = { RCX, RSI, RDI, R8, R9, R10 };
+const int N_TEMPS     = sizeof(TEMP_REGS) / sizeof(TEMP_REGS[0]);
+const Reg SCRATCH     = R11;
+
+const unsigned int SU_PURE = 1u << 31;
+
+static unsigned int
+su_need(ExpNode *exp)
+{
+    return exp->reg & ~SU_PURE;
+}
+
+static bool
+su_pure(ExpNode *exp)
+{
+    return exp->reg & SU_PURE;
+}
+
+// Operands that an instruction can take directly, as an immediate or a memory
+// reference, without a register of their own.
+static bool
+is_direct_operand(ExpNode *exp)
+{
+    return exp->kind == ExpNode::IntExp || exp->kind == ExpNode::VarExp;
+}
+
+static bool
+is_compare(Operator op)
+{
+    switch (op) {
+    case Operator::Eq:
+    case Operator::Ne:
+    case Operator::Lt:
+    case Operator::Le:
+    case Operator::Gt:
+    case Operator::Ge: return true;
+    default: return false;
+    }
+}
+
+static Cond
+compare_cond(Operator op)
+{
+    switch (op) {
+    case Operator::Eq: return CondE;
+    case Operator::Ne: return CondNE;
+    case Operator::Lt: return CondL;
+    case Operator::Le: return CondLE;
+    case Operator::Gt: return CondG;
+    case Operator::Ge: return CondGE;
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+static unsigned int
+number(ExpNode *exp)
+{
+    unsigned int need = 1;
+    bool         pure = true;
+
+    switch (exp->kind) {
+    case ExpNode::IntExp:
+    case ExpNode::StringExp: break;
+    case ExpNode::VarExp:
+        // A call may assign a global, so reading one is ordered with calls.
+        pure = static_cast<VarNode *>(exp)->var_info.value().fun_idx != 0;
+        break;
+    case ExpNode::UnopExp: {
+        auto node = static_cast<UnOpNode *>(exp);
+        number(node->e.get());
+        need = su_need(node->e.get());
+        pure = su_pure(node->e.get());
+        break;
+    }
+    case ExpNode::BinopExp: {
+        auto node = static_cast<BinOpNode *>(exp);
+        number(node->lhs.get());
+        number(node->rhs.get());
+
+        unsigned int l = su_need(node->lhs.get());
+        unsigned int r = is_direct_operand(node->rhs.get()) ?
+                             0 :
+                             su_need(node->rhs.get());
+        pure = su_pure(node->lhs.get()) && su_pure(node->rhs.get())
+               && node->op != Operator::Div && node->op != Operator::Rem;
+
+        if (node->op == Operator::And || node->op == Operator::Or) {
+            need = std::max(l, su_need(node->rhs.get()));
+        } else if (su_pure(node->lhs.get()) || r <= l) {
+            need = l == r ? l + 1 : std::max(l, r);
+        } else {
+            need = std::max(l, r + 1);
+        }
+        break;
+    }
+    case ExpNode::CallExp: {
+        // Calls clobber every temporary.
+        auto node = static_cast<CallNode *>(exp);
+        for (auto &arg : node->args) {
+            number(arg.get());
+        }
+        need = N_TEMPS;
+        pure = false;
+        break;
+    }
+    }
+
+    exp->reg = need | (pure ? SU_PURE : 0);
+    return need;
+}
+
+static void
+tier_up_thunk(JIT *jit, int fun_idx)
+{
+    jit->tier_up(fun_idx);
+}
+
+static void *
+osr_thunk(JIT *jit, int fun_idx, StmtNode *loop)
+{
+    return jit->osr(fun_idx, loop);
+}
+
+class BaselineCompiler {
+private:
+    FundecNode   *fun; // nullptr for the top level
+    int           fun_idx;
+    void        **fun_table;
+    JIT          *jit;
+    TierCounters *counters; // nullptr unless tiering
+
+    Assembler  as;
+    ErrorStubs error_stubs;
+    Label      entry;
+
+    // Out-of-line calls into the JIT when a counter runs out, emitted after
+    // the body like the error stubs. They return to the code after the
+    // counter, unless a loop gets replaced on the stack.
+    struct TierStub {
+        Label            label;
+        Label            back;
+        int              sp_offset;
+        StmtNode        *loop; // nullptr for the call counter
+        std::vector<Mem> repeat_counters;
+    };
+    std::vector<std::unique_ptr<TierStub>> tier_stubs;
+
+    int frame_bytes = 0;
+
+    // Counter slots of the repeat statements running at this point,
+    // outermost first.
+    std::vector<Mem> repeat_counters;
+
+    // Bytes pushed below the fixed part of the frame, to keep calls aligned
+    // and to size the stack.
+    int sp_offset     = 0;
+    int max_sp_offset = 0;
+
+    void push(Reg r)
+    {
+        as.push(r);
+        adjust_sp(8);
+    }
+
+    void pop(Reg r)
+    {
+        as.pop(r);
+        adjust_sp(-8);
+    }
+
+    void adjust_sp(int bytes)
+    {
+        sp_offset += bytes;
+        max_sp_offset = std::max(max_sp_offset, sp_offset);
+    }
+
+    TierStub &count(int32_t TierCounters::*counter)
+    {
+        tier_stubs.push_back(std::make_unique<TierStub>());
+        auto &stub     = *tier_stubs.back();
+        stub.sp_offset = sp_offset;
+        stub.loop      = nullptr;
+
+        as.alu(AluSub, &(counters[fun_idx].*counter), 1);
+        as.jcc(CondE, stub.label);
+        as.bind(stub.back);
+        return stub;
+    }
+
+    // The top level runs only once, so recompiling it would never pay off.
+    void count_call()
+    {
+        if (counters && fun_idx != 0) {
+            count(&TierCounters::calls);
+        }
+    }
+
+    void count_back_edge(StmtNode *loop)
+    {
+        if (counters) {
+            auto &stub           = count(&TierCounters::loops);
+            stub.loop            = loop;
+            stub.repeat_counters = repeat_counters;
+        }
+    }
+
+    // Passes the state of the loop to its OSR entry (in SCRATCH) as laid out
+    // by lower_function() and returns its result from this function.
+    void emit_osr_transfer(TierStub &stub)
+    {
+        int n_slots = fun ? fun->frame_size : 0;
+        int n_args  = n_slots + stub.repeat_counters.size();
+
+        auto load_arg = [&](Reg dst, int i) {
+            if (i < n_slots) {
+                as.mov(dst, slot_mem(i));
+                return;
+            }
+
+            // Only the innermost repeat has already counted the iteration
+            // that just finished; the IR counts at the bottom of the body.
+            int  r         = i - n_slots;
+            bool innermost = r + 1 == (int)stub.repeat_counters.size()
+                             && stub.loop->kind == StmtNode::RepeatStmt;
+            as.mov(dst, stub.repeat_counters[r], false);
+            if (!innermost) {
+                as.alu(AluAdd, dst, 1);
+            }
+        };
+
+        int n_stack = std::max(0, n_args - N_ARG_REGS);
+        int pushed  = 8 * n_stack;
+        if ((stub.sp_offset + pushed) % 16) {
+            as.alu(AluSub, RSP, 8, true);
+            pushed += 8;
+        }
+        max_sp_offset = std::max(max_sp_offset, stub.sp_offset + pushed);
+
+        for (int i = n_args - 1; i >= N_ARG_REGS; i--) {
+            load_arg(RAX, i);
+            as.push(RAX);
+        }
+        for (int i = 0; i < n_args && i < N_ARG_REGS; i++) {
+            load_arg(ARG_REGS[i], i);
+        }
+        as.call(SCRATCH);
+        gen_epilogue();
+    }
+
+    void emit_tier_stubs()
+    {
+        for (auto &stub : tier_stubs) {
+            // Counters sit at statement boundaries, where no temporary is
+            // live.
+            int padding = stub->sp_offset % 16;
+            as.bind(stub->label);
+            if (padding) {
+                as.alu(AluSub, RSP, padding, true);
+            }
+            as.mov(RDI, (int64_t)jit);
+            as.mov(RSI, fun_idx);
+            if (stub->loop) {
+                as.mov(RDX, (int64_t)stub->loop);
+                emit_call_runtime(as, (void *)osr_thunk);
+            } else {
+                emit_call_runtime(as, (void *)tier_up_thunk);
+            }
+            if (padding) {
+                as.alu(AluAdd, RSP, padding, true);
+            }
+
+            if (stub->loop) {
+                as.test(RAX, RAX, true);
+                as.jcc(CondE, stub->back);
+                as.mov(SCRATCH, RAX);
+                emit_osr_transfer(*stub);
+            } else {
+                as.jmp(stub->back);
+            }
+        }
+    }
+
+    // The frame slot of a parameter or local.
+    Mem slot_mem(int frame_idx)
+    {
+        if (frame_idx < (int)fun->params.size() && frame_idx >= N_ARG_REGS) {
+            return Mem{ RBP, 16 + 8 * (frame_idx - N_ARG_REGS) };
+        }
+        return Mem{ RBP, -8 * (frame_idx + 1) };
+    }
+
+    Mem var_mem(VarInfo &info)
+    {
+        if (info.fun_idx == 0) {
+            return Mem{ GLOBALS_REG, 8 * info.frame_idx };
+        }
+        return slot_mem(info.frame_idx);
+    }
+
+    void store_var(VarInfo &info, Reg src)
+    {
+        // Globals are shared with the other engines, which expect ints
+        // sign-extended to 64 bits.
+        if (info.fun_idx == 0 && info.var_type != Type::String) {
+            as.movsxd(src, src);
+        }
+        as.mov(var_mem(info), src, info.var_type == Type::String);
+    }
+
+    // How the right operand of a binary operator is available.
+    struct Operand {
+        enum { Imm, Memory, Register } kind = Imm;
+        int32_t imm                         = 0;
+        Mem     mem                         = Mem{ RBP, 0 };
+        Reg     reg                         = RAX;
+    };
+
+    // Evaluates the operands of a binary operator into TEMP_REGS[d] and an
+    // operand for the instruction.
+    Operand gen_operands(BinOpNode *node, int d)
+    {
+        ExpNode *lhs = node->lhs.get();
+        ExpNode *rhs = node->rhs.get();
+        Reg      r   = TEMP_REGS[d];
+
+        Operand res;
+        if (rhs->kind == ExpNode::IntExp) {
+            gen(lhs, d);
+            res.kind = Operand::Imm;
+            res.imm  = static_cast<IntNode *>(rhs)->ival;
+            return res;
+        }
+        if (rhs->kind == ExpNode::VarExp) {
+            gen(lhs, d);
+            res.kind = Operand::Memory;
+            res.mem  = var_mem(static_cast<VarNode *>(rhs)->var_info.value());
+            return res;
+        }
+
+        res.kind = Operand::Register;
+        if (su_pure(lhs) && su_need(rhs) > su_need(lhs)) {
+            gen(rhs, d);
+            if (d + 1 < N_TEMPS) {
+                gen(lhs, d + 1);
+                as.xchg(r, TEMP_REGS[d + 1]);
+                res.reg = TEMP_REGS[d + 1];
+            } else {
+                push(r);
+                gen(lhs, d);
+                pop(SCRATCH);
+                res.reg = SCRATCH;
+            }
+            return res;
+        }
+
+        gen(lhs, d);
+        if (d + 1 < N_TEMPS) {
+            gen(rhs, d + 1);
+            res.reg = TEMP_REGS[d + 1];
+        } else {
+            push(r);
+            gen(rhs, d);
+            as.mov(SCRATCH, r);
+            pop(r);
+            res.reg = SCRATCH;
+        }
+        return res;
+    }
+
+    void emit_alu(AluOp op, Reg r, Operand &b)
+    {
+        switch (b.kind) {
+        case Operand::Imm: as.alu(op, r, b.imm); break;
+        case Operand::Memory: as.alu(op, r, b.mem); break;
+        case Operand::Register: as.alu(op, r, b.reg); break;
+        }
+    }
+
+    void gen_div(BinOpNode *node, Reg r, Operand &b)
+    {
+        // idiv traps on both a zero divisor and INT_MIN / -1; the latter
+        // wraps to INT_MIN with a remainder of 0.
+        bool  is_div = node->op == Operator::Div;
+        Label minus_one;
+        Label done;
+
+        if (b.kind == Operand::Imm) {
+            if (b.imm == 0) {
+                as.jmp(error_stubs.add(DIVISION_BY_ZERO, node->pos));
+                return;
+            }
+            as.mov(SCRATCH, b.imm);
+            b.kind = Operand::Register;
+            b.reg  = SCRATCH;
+        } else {
+            if (b.kind == Operand::Memory) {
+                as.alu(AluCmp, b.mem, 0);
+            } else {
+                as.test(b.reg, b.reg);
+            }
+            as.jcc(CondE, error_stubs.add(DIVISION_BY_ZERO, node->pos));
+        }
+
+        if (b.kind == Operand::Memory) {
+            as.alu(AluCmp, b.mem, -1);
+        } else {
+            as.alu(AluCmp, b.reg, -1);
+        }
+        as.jcc(CondE, minus_one);
+
+        as.mov(RAX, r, false);
+        as.cdq();
+        if (b.kind == Operand::Memory) {
+            as.idiv(b.mem);
+        } else {
+            as.idiv(b.reg);
+        }
+        as.mov(r, is_div ? RAX : RDX, false);
+        as.jmp(done);
+
+        as.bind(minus_one);
+        if (is_div) {
+            as.neg(r);
+        } else {
+            as.alu(AluXor, r, r);
+        }
+        as.bind(done);
+    }
+
+    void gen_binop(BinOpNode *node, int d)
+    {
+        Reg r = TEMP_REGS[d];
+
+        if (node->op == Operator::And || node->op == Operator::Or) {
+            bool  is_and = node->op == Operator::And;
+            Label short_circuit;
+            Label done;
+
+            gen(node->lhs.get(), d);
+            as.test(r, r);
+            as.jcc(is_and ? CondE : CondNE, short_circuit);
+            gen(node->rhs.get(), d);
+            as.test(r, r);
+            as.setcc(CondNE, r);
+            as.movzxb(r, r);
+            as.jmp(done);
+            as.bind(short_circuit);
+            as.mov(r, is_and ? 0 : 1);
+            as.bind(done);
+            return;
+        }
+
+        Operand b = gen_operands(node, d);
+
+        switch (node->op) {
+        case Operator::Add: emit_alu(AluAdd, r, b); break;
+        case Operator::Sub: emit_alu(AluSub, r, b); break;
+        case Operator::Band: emit_alu(AluAnd, r, b); break;
+        case Operator::Bor: emit_alu(AluOr, r, b); break;
+        case Operator::Xor: emit_alu(AluXor, r, b); break;
+        case Operator::Mul:
+            switch (b.kind) {
+            case Operand::Imm: as.imul(r, r, b.imm); break;
+            case Operand::Memory: as.imul(r, b.mem); break;
+            case Operand::Register: as.imul(r, b.reg); break;
+            }
+            break;
+        case Operator::Div:
+        case Operator::Rem: gen_div(node, r, b); break;
+        default:
+            emit_alu(AluCmp, r, b);
+            as.setcc(compare_cond(node->op), r);
+            as.movzxb(r, r);
+            break;
+        }
+    }
+
+    void gen_call(FunInfo                               &info,
+                  std::vector<std::unique_ptr<ExpNode>> &args,
+                  SourcePos                              pos,
+                  int                                    d)
+    {
+        int callee = info.var_idx_db;
+
+        // Temporaries below d are live and every one of them is
+        // caller-saved.
+        for (int i = 0; i < d; i++) {
+            push(TEMP_REGS[i]);
+        }
+
+        if (is_builtin(callee)) {
+            gen(args[0].get(), 0);
+            as.mov(RDI, TEMP_REGS[0]);
+
+            int padding = sp_offset % 16;
+            if (padding) {
+                as.alu(AluSub, RSP, padding, true);
+            }
+            switch (callee) {
+            case BuiltinPrintint:
+                emit_call_runtime(as, (void *)rt_printint);
+                break;
+            case BuiltinPrintstring:
+                emit_call_runtime(as, (void *)rt_printstring);
+                break;
+            case BuiltinExit:
+                as.movsxd(RDI, RDI);
+                emit_call_runtime(as, (void *)rt_exit);
+                break;
+            }
+            if (padding) {
+                as.alu(AluAdd, RSP, padding, true);
+            }
+        } else {
+            as.alu(AluSub, DEPTH_REG, 1, true);
+            as.jcc(CondE, error_stubs.add(STACK_OVERFLOW, pos));
+
+            // Arguments are evaluated left to right. The first six are pushed
+            // and popped into their registers at the end; the rest are
+            // stored straight into the outgoing area reserved below.
+            int argc     = args.size();
+            int n_regs   = std::min(argc, N_ARG_REGS);
+            int n_stack  = argc - n_regs;
+            int reserved = 8 * n_stack;
+            if ((sp_offset + reserved) % 16) {
+                reserved += 8;
+            }
+            if (reserved) {
+                as.alu(AluSub, RSP, reserved, true);
+                adjust_sp(reserved);
+            }
+
+            for (int i = 0; i < argc; i++) {
+                gen(args[i].get(), 0);
+                if (i < N_ARG_REGS) {
+                    push(TEMP_REGS[0]);
+                } else {
+                    as.mov(Mem{ RSP, 8 * (n_regs + i - N_ARG_REGS) },
+                           TEMP_REGS[0]);
+                }
+            }
+            for (int i = n_regs - 1; i >= 0; i--) {
+                pop(ARG_REGS[i]);
+            }
+
+            // Recursive calls go through the table when tiering, so that
+            // they reach the optimized code once there is some.
+            if (callee == fun_idx && !counters) {
+                as.call(entry);
+            } else {
+                as.call_indirect(&fun_table[callee]);
+            }
+
+            if (reserved) {
+                as.alu(AluAdd, RSP, reserved, true);
+                adjust_sp(-reserved);
+            }
+            as.alu(AluAdd, DEPTH_REG, 1, true);
+        }
+
+        as.mov(TEMP_REGS[d], RAX);
+        for (int i = d - 1; i >= 0; i--) {
+            pop(TEMP_REGS[i]);
+        }
+    }
+
+    // Evaluates an expression into TEMP_REGS[d], using only the temporaries
+    // from d up.
+    void gen(ExpNode *exp, int d)
+    {
+        Reg r = TEMP_REGS[d];
+
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+            as.mov(r, static_cast<IntNode *>(exp)->ival);
+            break;
+        case ExpNode::StringExp:
+            as.mov(r,
+                   (int64_t)string_pool.get(
+                       static_cast<StrNode *>(exp)->str_idx));
+            break;
+        case ExpNode::VarExp: {
+            auto &info = static_cast<VarNode *>(exp)->var_info.value();
+            as.mov(r, var_mem(info), info.var_type == Type::String);
+            break;
+        }
+        case ExpNode::UnopExp: {
+            auto node = static_cast<UnOpNode *>(exp);
+            gen(node->e.get(), d);
+            if (node->op == Operator::Neg) {
+                as.neg(r);
+            } else {
+                as.test(r, r);
+                as.setcc(CondE, r);
+                as.movzxb(r, r);
+            }
+            break;
+        }
+        case ExpNode::BinopExp: gen_binop(static_cast<BinOpNode *>(exp), d); break;
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp);
+            gen_call(node->fun_info.value(), node->args, node->pos, d);
+            break;
+        }
+        }
+    }
+
+    // Jumps to `target` if the truth of `exp` equals `when`.
+    void gen_cond(ExpNode *exp, bool when, Label &target)
+    {
+        if (exp->kind == ExpNode::IntExp) {
+            if ((static_cast<IntNode *>(exp)->ival != 0) == when) {
+                as.jmp(target);
+            }
+            return;
+        }
+
+        if (exp->kind == ExpNode::UnopExp) {
+            auto node = static_cast<UnOpNode *>(exp);
+            if (node->op == Operator::Not) {
+                gen_cond(node->e.get(), !when, target);
+                return;
+            }
+        }
+
+        if (exp->kind == ExpNode::BinopExp) {
+            auto node = static_cast<BinOpNode *>(exp);
+            if (node->op == Operator::And || node->op == Operator::Or) {
+                // The lhs decides on its own when it is false for && and
+                // true for ||.
+                bool  decides = node->op == Operator::Or;
+                Label skip;
+                if (when == decides) {
+                    gen_cond(node->lhs.get(), when, target);
+                    gen_cond(node->rhs.get(), when, target);
+                } else {
+                    gen_cond(node->lhs.get(), decides, skip);
+                    gen_cond(node->rhs.get(), when, target);
+                    as.bind(skip);
+                }
+                return;
+            }
+
+            if (is_compare(node->op)) {
+                Operand b = gen_operands(node, 0);
+                emit_alu(AluCmp, TEMP_REGS[0], b);
+                Cond cond = compare_cond(node->op);
+                as.jcc(when ? cond : negate(cond), target);
+                return;
+            }
+        }
+
+        gen(exp, 0);
+        as.test(TEMP_REGS[0], TEMP_REGS[0]);
+        as.jcc(when ? CondNE : CondE, target);
+    }
+
+    void gen_exp(ExpNode *exp)
+    {
+        number(exp);
+        gen(exp, 0);
+    }
+
+    void gen_epilogue()
+    {
+        as.mov(RSP, RBP);
+        as.pop(RBP);
+        as.ret();
+    }
+
+    // return f(...) inside f: the arguments replace the parameters and the
+    // frame is torn down before jumping back to the start, so deep tail
+    // recursion runs in constant stack space. When tiering, the jump goes
+    // through the function table and so counts as a call, reaching the
+    // optimized code once there is some.
+    void gen_tail_call(CallNode *node)
+    {
+        int argc = node->args.size();
+        for (auto &arg : node->args) {
+            gen_exp(arg.get());
+            push(TEMP_REGS[0]);
+        }
+        for (int i = argc - 1; i >= 0; i--) {
+            if (i < N_ARG_REGS) {
+                pop(ARG_REGS[i]);
+            } else {
+                pop(SCRATCH);
+                as.mov(slot_mem(i), SCRATCH);
+            }
+        }
+
+        as.mov(RSP, RBP);
+        as.pop(RBP);
+        if (counters) {
+            as.jmp_indirect(&fun_table[fun_idx]);
+        } else {
+            as.jmp(entry);
+        }
+    }
+
+    void gen_stmt(StmtNode *stmt)
+    {
+        switch (stmt->kind) {
+        case StmtNode::VardeclStmt: {
+            auto node = static_cast<VardeclNode *>(stmt);
+            gen_exp(node->rhs.get());
+            store_var(node->var_info.value(), TEMP_REGS[0]);
+            break;
+        }
+        case StmtNode::AssignStmt: {
+            auto node = static_cast<AssignNode *>(stmt);
+            auto lhs  = static_cast<VarNode *>(node->lhs.get());
+            gen_exp(node->rhs.get());
+            store_var(lhs->var_info.value(), TEMP_REGS[0]);
+            break;
+        }
+        case StmtNode::IfStmt: {
+            auto  node = static_cast<IfNode *>(stmt);
+            Label else_label;
+            Label done;
+            number(node->cond.get());
+            gen_cond(node->cond.get(), false, else_label);
+            gen_stmts(node->then_stmts);
+            if (!node->else_stmts.empty()) {
+                as.jmp(done);
+            }
+            as.bind(else_label);
+            gen_stmts(node->else_stmts);
+            as.bind(done);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            // The otherwise block runs only if the body never does.
+            auto  node = static_cast<WhileNode *>(stmt);
+            Label body;
+            Label otherwise;
+            Label done;
+            number(node->cond.get());
+            gen_cond(node->cond.get(), false, otherwise);
+            as.bind(body);
+            gen_stmts(node->body_stmts);
+            count_back_edge(stmt);
+            gen_cond(node->cond.get(), true, body);
+            if (!node->otherwise_stmts.empty()) {
+                as.jmp(done);
+            }
+            as.bind(otherwise);
+            gen_stmts(node->otherwise_stmts);
+            as.bind(done);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            // The count is evaluated once and kept in a stack slot pushed
+            // for the duration of the loop.
+            auto  node = static_cast<RepeatNode *>(stmt);
+            Label top;
+            Label done;
+            gen_exp(node->cond.get());
+            push(TEMP_REGS[0]);
+            Mem counter{ RBP, -(frame_bytes + sp_offset) };
+
+            as.bind(top);
+            as.alu(AluSub, counter, 1);
+            as.jcc(CondL, done);
+            repeat_counters.push_back(counter);
+            gen_stmts(node->body_stmts);
+            count_back_edge(stmt);
+            repeat_counters.pop_back();
+            as.jmp(top);
+            as.bind(done);
+            as.alu(AluAdd, RSP, 8, true);
+            adjust_sp(-8);
+            break;
+        }
+        case StmtNode::CallStmt: {
+            auto node = static_cast<CallStmtNode *>(stmt);
+            for (auto &arg : node->args) {
+                number(arg.get());
+            }
+            gen_call(node->fun_info.value(), node->args, node->pos, 0);
+            break;
+        }
+        case StmtNode::FundecStmt: break; // Compiled on their own
+        case StmtNode::RetStmt: {
+            auto node = static_cast<RetNode *>(stmt);
+            if (node->tail_call) {
+                gen_tail_call(static_cast<CallNode *>(node->ret_exp->get()));
+                break;
+            }
+            if (node->ret_exp.has_value()) {
+                gen_exp(node->ret_exp.value().get());
+                as.mov(RAX, TEMP_REGS[0]);
+            } else {
+                as.alu(AluXor, RAX, RAX);
+            }
+            gen_epilogue();
+            break;
+        }
+        }
+    }
+
+    void gen_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        for (auto &stmt : stmts) {
+            gen_stmt(stmt.get());
+        }
+    }
+
+public:
+    BaselineCompiler(FundecNode   *fun,
+                     int           fun_idx,
+                     void        **fun_table,
+                     JIT          *jit,
+                     TierCounters *counters)
+        : fun(fun)
+        , fun_idx(fun_idx)
+        , fun_table(fun_table)
+        , jit(jit)
+        , counters(counters)
+    {
+    }
+
+    // Returns the size of the largest native frame the code can build.
+    size_t compile(std::list<std::unique_ptr<StmtNode>> &body)
+    {
+        frame_bytes = fun ? (8 * fun->frame_size + 15) & ~15 : 0;
+
+        as.bind(entry);
+        as.push(RBP);
+        as.mov(RBP, RSP);
+        if (frame_bytes > 0) {
+            as.alu(AluSub, RSP, frame_bytes, true);
+        }
+        if (fun) {
+            for (int p = 0; p < (int)fun->params.size() && p < N_ARG_REGS;
+                 p++) {
+                as.mov(Mem{ RBP, -8 * (p + 1) }, ARG_REGS[p]);
+            }
+        }
+        count_call();
+
+        gen_stmts(body);
+
+        // Falling off the end returns 0.
+        as.alu(AluXor, RAX, RAX);
+        gen_epilogue();
+
+        error_stubs.emit(as);
+        emit_tier_stubs();
+        return 16 + frame_bytes + max_sp_offset;
+    }
+
+    Assembler &assembler()
+    {
+        return as;
+    }
+};
+
+void
+JIT::compile_baseline(Program &program, int fun_idx)
+{
+    auto             start = std::chrono::steady_clock::now();
+    FundecNode      *fun   = fun_idx == 0 ? nullptr : program.funs[fun_idx];
+    BaselineCompiler compiler(fun, fun_idx, fun_table, this, counters);
+
+    size_t frame = compiler.compile(fun ? fun->body : program.stmts);
+    baseline_frames[fun_idx] = frame;
+    fun_table[fun_idx]       = install(compiler.assembler(), frame, 0);
+    count_compile(start);
+}
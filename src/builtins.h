@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+// Functions provided by the runtime rather than declared in the program. The
+// symbol resolver registers them before anything else, in this order, so any
+// FunInfo whose var_idx_db is below FIRST_USER_FUN_IDX refers to a builtin.
+enum BuiltinIdx {
+    BuiltinPrintint = 1,
+    BuiltinPrintstring,
+    BuiltinExit,
+
+    FIRST_USER_FUN_IDX
+};
+
+struct BuiltinDecl {
+    std::string            name;
+    Type                   ret_type;
+    std::vector<ParamNode> params;
+};
+
+static const BuiltinDecl builtin_decls[] = {
+    { "printint", Type::Void, { { "i", Type::Int } } },
+    { "printstring", Type::Void, { { "s", Type::String } } },
+    { "exit", Type::Void, { { "code", Type::Int } } },
+};
+
+static inline bool
+is_builtin(int fun_idx)
+{
+    return fun_idx < FIRST_USER_FUN_IDX;
+}
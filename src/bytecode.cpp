@@ -0,0 +1,443 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+
+#include "builtins.h"
+#include "error.h"
+#include "liveness.h"
+
+const char *
+bc_op_name(BCOp op)
+{
+    static const char *names[] = {
+#define BC_NAME(name) #name,
+        BC_OPS(BC_NAME)
+#undef BC_NAME
+    };
+    return names[op];
+}
+
+// Registers are numbered with 16-bit operands; c doubles as a signed
+// immediate, which leaves 15 bits for register numbers.
+const int MAX_BC_REGS = INT16_MAX;
+
+static BCOp
+binop_bc(Operator op)
+{
+    switch (op) {
+    case Operator::Add: return BC_ADD;
+    case Operator::Sub: return BC_SUB;
+    case Operator::Mul: return BC_MUL;
+    case Operator::Div: return BC_DIV;
+    case Operator::Rem: return BC_REM;
+    case Operator::Band: return BC_BAND;
+    case Operator::Bor: return BC_BOR;
+    case Operator::Xor: return BC_XOR;
+    case Operator::Eq: return BC_EQ;
+    case Operator::Ne: return BC_NE;
+    case Operator::Lt: return BC_LT;
+    case Operator::Le: return BC_LE;
+    case Operator::Gt: return BC_GT;
+    case Operator::Ge: return BC_GE;
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+// Returns the immediate form of a binary operator, or false if it has none.
+static bool
+binop_bck(Operator op, BCOp &res)
+{
+    switch (op) {
+    case Operator::Add: res = BC_ADDK; return true;
+    case Operator::Sub: res = BC_SUBK; return true;
+    case Operator::Mul: res = BC_MULK; return true;
+    case Operator::Eq: res = BC_EQK; return true;
+    case Operator::Ne: res = BC_NEK; return true;
+    case Operator::Lt: res = BC_LTK; return true;
+    case Operator::Le: res = BC_LEK; return true;
+    case Operator::Gt: res = BC_GTK; return true;
+    case Operator::Ge: res = BC_GEK; return true;
+    default: return false;
+    }
+}
+
+// The operator that gives the same result with its operands swapped, or
+// Operator::Invalid if there is none among the immediate forms.
+static Operator
+swapped_op(Operator op)
+{
+    switch (op) {
+    case Operator::Add:
+    case Operator::Mul:
+    case Operator::Eq:
+    case Operator::Ne: return op;
+    case Operator::Lt: return Operator::Gt;
+    case Operator::Le: return Operator::Ge;
+    case Operator::Gt: return Operator::Lt;
+    case Operator::Ge: return Operator::Le;
+    default: return Operator::Invalid;
+    }
+}
+
+class BytecodeCompiler {
+private:
+    IRFunction &fun;
+    BCProgram  &program;
+    BCFunction &res;
+
+    // Register assignment: slot within the register file of the register's
+    // type. -1 for registers that need no slot.
+    std::vector<int> slot;
+
+    // Registers with a single definition that loads a small constant, which
+    // can be used as immediate operands instead.
+    std::vector<bool>    is_small_const;
+    std::vector<int64_t> const_val;
+    std::vector<bool>    elided;
+
+    std::vector<int> block_pc;
+
+    // Jumps whose offsets are patched once every block has a known pc.
+    std::vector<std::pair<uint32_t, int>> fixups;
+
+    bool is_str(int reg)
+    {
+        return fun.reg_types[reg] == Type::String;
+    }
+
+    uint16_t reg(int r)
+    {
+        return slot[r];
+    }
+
+    BCInst &emit(BCOp op, uint16_t a = 0, uint16_t b = 0, int16_t c = 0)
+    {
+        BCInst inst;
+        inst.op = op;
+        inst.a  = a;
+        inst.b  = b;
+        inst.c  = c;
+        res.code.push_back(inst);
+        return res.code.back();
+    }
+
+    void emit_imm(BCOp op, uint16_t a, int32_t imm)
+    {
+        emit(op, a).imm = imm;
+    }
+
+    void emit_jump(BCOp op, uint16_t a, int target)
+    {
+        emit(op, a);
+        fixups.push_back({ res.code.size() - 1, target });
+    }
+
+    void record_position(IRInst &inst)
+    {
+        res.positions[res.code.size() - 1] = inst.pos;
+    }
+
+    void find_constants()
+    {
+        int              n_regs = fun.n_regs();
+        std::vector<int>  n_defs(n_regs, 0);
+        std::vector<bool> const_def(n_regs, false);
+
+        is_small_const.assign(n_regs, false);
+        const_val.assign(n_regs, 0);
+        elided.assign(n_regs, false);
+
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst < 0) {
+                    continue;
+                }
+                n_defs[inst.dst]++;
+                if (inst.op == IROp::Const) {
+                    const_def[inst.dst] = true;
+                    const_val[inst.dst] = inst.imm;
+                }
+            }
+        }
+
+        for (int r = fun.n_params; r < n_regs; r++) {
+            is_small_const[r] = n_defs[r] == 1 && const_def[r]
+                                && const_val[r] >= INT16_MIN
+                                && const_val[r] <= INT16_MAX;
+        }
+
+        // A constant whose every use becomes an immediate operand never has
+        // to be materialized.
+        for (int r = 0; r < n_regs; r++) {
+            elided[r] = is_small_const[r];
+        }
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                Operator op;
+                bool     folds_b = false;
+                bool     folds_a = false;
+                if (inst.op == IROp::BinOp) {
+                    BCOp bc;
+                    folds_b = binop_bck(inst.binop, bc) && is_small_const[inst.b];
+                    op      = swapped_op(inst.binop);
+                    folds_a = !folds_b && op != Operator::Invalid
+                              && is_small_const[inst.a];
+                }
+
+                for_each_use(inst, [&](int r) {
+                    bool folded = (folds_b && r == inst.b && r != inst.a)
+                                  || (folds_a && r == inst.a && r != inst.b);
+                    if (!folded) {
+                        elided[r] = false;
+                    }
+                });
+            }
+        }
+    }
+
+    void allocate_registers()
+    {
+        Liveness         liveness = compute_liveness(fun);
+        std::vector<int> order(fun.blocks.size());
+        for (unsigned int i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+
+        std::vector<int> block_start;
+        auto intervals = build_intervals(fun, liveness, order, block_start);
+
+        slot.assign(fun.n_regs(), -1);
+
+        // Parameters are passed in the first slots of each file, in order.
+        int n_slots[2] = { 0, 0 };
+        for (int p = 0; p < fun.n_params; p++) {
+            slot[p] = n_slots[is_str(p)]++;
+        }
+
+        std::vector<LiveInterval> work;
+        for (auto &interval : intervals) {
+            if (interval.reg >= fun.n_params && !elided[interval.reg]) {
+                // Registers that never appear need no slot.
+                if (interval.start > interval.end) {
+                    continue;
+                }
+                work.push_back(interval);
+            }
+        }
+        std::sort(work.begin(),
+                  work.end(),
+                  [](const LiveInterval &x, const LiveInterval &y) {
+                      return x.start < y.start;
+                  });
+
+        // Greedy interval coloring, independently for each register file.
+        // Parameter slots become free once the parameter dies.
+        std::set<std::pair<int, int>> active[2]; // (end, slot)
+        std::set<int>                 free_slots[2];
+        for (int p = 0; p < fun.n_params; p++) {
+            active[is_str(p)].insert({ intervals[p].end, slot[p] });
+        }
+
+        for (auto &interval : work) {
+            int file = is_str(interval.reg);
+            while (!active[file].empty()
+                   && active[file].begin()->first < interval.start) {
+                free_slots[file].insert(active[file].begin()->second);
+                active[file].erase(active[file].begin());
+            }
+
+            int s;
+            if (!free_slots[file].empty()) {
+                s = *free_slots[file].begin();
+                free_slots[file].erase(free_slots[file].begin());
+            } else {
+                s = n_slots[file]++;
+            }
+
+            slot[interval.reg] = s;
+            active[file].insert({ interval.end, s });
+        }
+
+        if (n_slots[0] > MAX_BC_REGS || n_slots[1] > MAX_BC_REGS) {
+            throw AlbatrossError("Function " + fun.name
+                                     + " needs too many registers for bytecode",
+                                 -1,
+                                 EXIT_RUNTIME_FAILURE);
+        }
+
+        res.n_ints = n_slots[0];
+        res.n_strs = n_slots[1];
+    }
+
+    void compile_call(IRInst &inst)
+    {
+        int callee = inst.imm;
+
+        if (is_builtin(callee)) {
+            switch (callee) {
+            case BuiltinPrintint: emit(BC_PRINTI, reg(inst.args[0])); break;
+            case BuiltinPrintstring: emit(BC_PRINTS, reg(inst.args[0])); break;
+            case BuiltinExit: emit(BC_EXIT, reg(inst.args[0])); break;
+            }
+            return;
+        }
+
+        uint16_t dst  = inst.dst >= 0 ? reg(inst.dst) : 0;
+        int      argc = inst.args.size();
+        emit_imm(BC_CALL, dst, callee);
+        record_position(inst);
+
+        for (int i = 0; i < argc; i += 3) {
+            auto &args = emit(BC_ARGS);
+            args.a     = reg(inst.args[i]);
+            if (i + 1 < argc) {
+                args.b = reg(inst.args[i + 1]);
+            }
+            if (i + 2 < argc) {
+                args.c = reg(inst.args[i + 2]);
+            }
+        }
+    }
+
+    void compile_binop(IRInst &inst)
+    {
+        BCOp     op;
+        Operator swapped = swapped_op(inst.binop);
+
+        if (binop_bck(inst.binop, op) && is_small_const[inst.b]) {
+            emit(op, reg(inst.dst), reg(inst.a), const_val[inst.b]);
+            return;
+        }
+
+        if (swapped != Operator::Invalid && is_small_const[inst.a]) {
+            binop_bck(swapped, op);
+            emit(op, reg(inst.dst), reg(inst.b), const_val[inst.a]);
+            return;
+        }
+
+        emit(binop_bc(inst.binop), reg(inst.dst), reg(inst.a), reg(inst.b));
+        if (inst.binop == Operator::Div || inst.binop == Operator::Rem) {
+            record_position(inst);
+        }
+    }
+
+    void compile_inst(IRInst &inst, int next_block)
+    {
+        switch (inst.op) {
+        case IROp::Const:
+            if (!elided[inst.dst]) {
+                emit_imm(BC_LOADK, reg(inst.dst), inst.imm);
+            }
+            break;
+        case IROp::ConstStr:
+            emit_imm(BC_LOADS, reg(inst.dst), inst.imm);
+            break;
+        case IROp::Mov:
+            if (reg(inst.dst) != reg(inst.a)) {
+                emit(is_str(inst.dst) ? BC_SMOV : BC_MOV,
+                     reg(inst.dst),
+                     reg(inst.a));
+            }
+            break;
+        case IROp::BinOp: compile_binop(inst); break;
+        case IROp::UnOp:
+            emit(inst.binop == Operator::Neg ? BC_NEG : BC_NOT,
+                 reg(inst.dst),
+                 reg(inst.a));
+            break;
+        case IROp::LoadGlobal:
+            emit_imm(is_str(inst.dst) ? BC_LOADGS : BC_LOADG,
+                     reg(inst.dst),
+                     inst.imm);
+            break;
+        case IROp::StoreGlobal:
+            emit_imm(is_str(inst.a) ? BC_STOREGS : BC_STOREG,
+                     reg(inst.a),
+                     inst.imm);
+            break;
+        case IROp::Call: compile_call(inst); break;
+        case IROp::Phi: perror("Phi outside SSA form"); exit(EXIT_FAILURE);
+        case IROp::Jmp:
+            if (inst.target[0] != next_block) {
+                emit_jump(BC_JMP, 0, inst.target[0]);
+            }
+            break;
+        case IROp::Br:
+            if (inst.target[0] == next_block) {
+                emit_jump(BC_JF, reg(inst.a), inst.target[1]);
+            } else {
+                emit_jump(BC_JT, reg(inst.a), inst.target[0]);
+                if (inst.target[1] != next_block) {
+                    emit_jump(BC_JMP, 0, inst.target[1]);
+                }
+            }
+            break;
+        case IROp::Ret:
+            if (inst.a < 0) {
+                emit(BC_RETV);
+            } else {
+                emit(is_str(inst.a) ? BC_RETS : BC_RET, reg(inst.a));
+            }
+            break;
+        }
+    }
+
+public:
+    BytecodeCompiler(IRFunction &fun, BCProgram &program, BCFunction &res)
+        : fun(fun)
+        , program(program)
+        , res(res)
+    {
+    }
+
+    void compile()
+    {
+        res.name     = fun.name;
+        res.ret_type = fun.ret_type;
+        for (int p = 0; p < fun.n_params; p++) {
+            res.param_is_str.push_back(is_str(p));
+        }
+
+        find_constants();
+        allocate_registers();
+
+        block_pc.assign(fun.blocks.size(), 0);
+        for (unsigned int i = 0; i < fun.blocks.size(); i++) {
+            block_pc[i] = res.code.size();
+            for (auto &inst : fun.blocks[i].insts) {
+                compile_inst(inst, i + 1);
+            }
+        }
+
+        for (auto [pc, target] : fixups) {
+            res.code[pc].imm = block_pc[target] - (pc + 1);
+        }
+    }
+};
+
+std::unique_ptr<BCFunction>
+compile_bytecode(IRFunction &fun, BCProgram &program)
+{
+    auto             res = std::make_unique<BCFunction>();
+    BytecodeCompiler compiler(fun, program, *res);
+    compiler.compile();
+    return res;
+}
+
+BCProgram
+compile_bytecode(IRProgram &ir)
+{
+    BCProgram program;
+    program.n_globals = ir.n_globals;
+    program.funs.resize(ir.funs.size());
+
+    for (unsigned int i = 0; i < ir.funs.size(); i++) {
+        if (ir.funs[i]) {
+            program.funs[i] = compile_bytecode(*ir.funs[i], program);
+        }
+    }
+
+    return program;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+#include "types.h"
+
+// Bytecode for the register VM. Registers are split into two files, ints and
+// strings, each numbered from 0 within a frame; an operand's file is implied by
+// the opcode. Jump offsets are relative to the instruction after the jump.
+//
+// Operand legend: a, b, c are register numbers, k is a signed 16-bit
+// immediate stored in c, imm is a signed 32-bit immediate stored in b:c.
+#define BC_OPS(X)                                                             \
+    X(LOADK)  /* ints[a] = imm */                                             \
+    X(LOADS)  /* strs[a] = string_pool[imm] */                                \
+    X(MOV)    /* ints[a] = ints[b] */                                         \
+    X(SMOV)   /* strs[a] = strs[b] */                                         \
+    X(LOADG)  /* ints[a] = globals[imm] */                                    \
+    X(LOADGS) /* strs[a] = globals[imm] */                                    \
+    X(STOREG) /* globals[imm] = ints[a] */                                    \
+    X(STOREGS) /* globals[imm] = strs[a] */                                   \
+    X(ADD)    /* ints[a] = ints[b] + ints[c], and so on */                    \
+    X(SUB)                                                                    \
+    X(MUL)                                                                    \
+    X(DIV)                                                                    \
+    X(REM)                                                                    \
+    X(BAND)                                                                   \
+    X(BOR)                                                                    \
+    X(XOR)                                                                    \
+    X(EQ)                                                                     \
+    X(NE)                                                                     \
+    X(LT)                                                                     \
+    X(LE)                                                                     \
+    X(GT)                                                                     \
+    X(GE)                                                                     \
+    X(ADDK) /* ints[a] = ints[b] + k, and so on */                            \
+    X(SUBK)                                                                   \
+    X(MULK)                                                                   \
+    X(EQK)                                                                    \
+    X(NEK)                                                                    \
+    X(LTK)                                                                    \
+    X(LEK)                                                                    \
+    X(GTK)                                                                    \
+    X(GEK)                                                                    \
+    X(NEG)    /* ints[a] = -ints[b] */                                        \
+    X(NOT)    /* ints[a] = !ints[b] */                                        \
+    X(JMP)    /* pc += imm */                                                 \
+    X(JT)     /* if (ints[a]) pc += imm */                                    \
+    X(JF)     /* if (!ints[a]) pc += imm */                                   \
+    X(CALL)   /* a = result register, imm = var_idx_db; followed by */        \
+              /* ceil(argc / 3) ARGS words, argc being the callee's */        \
+              /* parameter count */                                           \
+    X(ARGS)   /* up to three argument registers in a, b, c */                 \
+    X(RET)    /* return ints[a] */                                            \
+    X(RETS)   /* return strs[a] */                                            \
+    X(RETV)   /* return nothing */                                            \
+    X(PRINTI) /* printint(ints[a]) */                                         \
+    X(PRINTS) /* printstring(strs[a]) */                                      \
+    X(EXIT)   /* exit(ints[a]) */
+
+enum BCOp : uint8_t {
+#define BC_ENUM(name) BC_##name,
+    BC_OPS(BC_ENUM)
+#undef BC_ENUM
+};
+
+struct BCInst {
+    BCOp     op;
+    uint16_t a;
+    union {
+        struct {
+            uint16_t b;
+            int16_t  c;
+        };
+        int32_t imm;
+    };
+};
+
+static_assert(sizeof(BCInst) == 8, "bytecode instructions should stay dense");
+
+struct BCFunction {
+    std::string          name;
+    std::vector<BCInst>  code;
+    uint16_t             n_ints = 0;
+    uint16_t             n_strs = 0;
+    Type                 ret_type;
+    std::vector<uint8_t> param_is_str;
+
+    // Source positions of instructions that can fail at runtime, keyed by
+    // their index in `code`.
+    std::unordered_map<uint32_t, SourcePos> positions;
+};
+
+struct BCProgram {
+    // Indexed by FunInfo::var_idx_db, slot 0 is the top level. Builtins have
+    // no bytecode and map to nullptr.
+    std::vector<std::unique_ptr<BCFunction>> funs;
+    int                                      n_globals = 0;
+};
+
+std::unique_ptr<BCFunction>
+compile_bytecode(IRFunction &fun, BCProgram &program);
+
+BCProgram
+compile_bytecode(IRProgram &ir);
+
+const char *
+bc_op_name(BCOp op);
@@ -0,0 +1,334 @@
+#include "call_folding.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "effects.h"
+#include "program.h"
+#include "runtime.h"
+
+// How many expressions and statements one call may evaluate, and how deep
+// the calls it makes may nest, before it is left for the program to run.
+constexpr int STEP_BUDGET = 1 << 16;
+constexpr int DEPTH_LIMIT = 256;
+
+class CallFolder {
+private:
+    // Thrown when evaluating a call runs into something whose result is
+    // only known at run time, or runs out of budget.
+    struct Unknown {};
+
+    // As in the interpreter: whether to go on with the next statement or
+    // unwind to the caller.
+    enum class Flow { Next, Return };
+
+    std::list<std::unique_ptr<StmtNode>> &stmts;
+
+    Program                      program;
+    std::vector<FunctionEffects> effects;
+
+    // Results of the calls already tried, by function and arguments, with
+    // no value for the ones that could not be evaluated.
+    std::map<std::pair<int, std::vector<int>>, std::optional<int>> results;
+
+    std::vector<int> *frame   = nullptr;
+    int               ret_val = 0;
+    int               steps   = 0;
+    int               depth   = 0;
+
+    bool changed = false;
+
+    void step()
+    {
+        if (--steps < 0) {
+            throw Unknown();
+        }
+    }
+
+    int &lookup(const VarInfo &info)
+    {
+        if (info.fun_idx == 0) {
+            throw Unknown();
+        }
+        return (*frame)[info.frame_idx];
+    }
+
+    int call(const FunInfo &info, std::vector<std::unique_ptr<ExpNode>> &args)
+    {
+        auto fun = program.funs[info.var_idx_db];
+        if (fun == nullptr || depth >= DEPTH_LIMIT) {
+            throw Unknown();
+        }
+
+        std::vector<int> callee(fun->frame_size, 0);
+        for (unsigned int i = 0; i < args.size(); i++) {
+            callee[i] = eval(args[i].get());
+        }
+
+        std::vector<int> *saved_frame = frame;
+        frame                         = &callee;
+        depth++;
+        Flow flow = exec(fun->body);
+        depth--;
+        frame = saved_frame;
+
+        // Falling off the end of a function returns 0.
+        return flow == Flow::Return ? ret_val : 0;
+    }
+
+    int eval(ExpNode *exp)
+    {
+        step();
+
+        switch (exp->kind) {
+        case ExpNode::IntExp: return static_cast<IntNode *>(exp)->ival;
+        case ExpNode::StringExp: throw Unknown();
+        case ExpNode::VarExp:
+            return lookup(static_cast<VarNode *>(exp)->var_info.value());
+        case ExpNode::BinopExp: {
+            auto node = static_cast<BinOpNode *>(exp);
+            int  lhs  = eval(node->lhs.get());
+            if (node->op == Operator::And) {
+                return lhs ? eval(node->rhs.get()) != 0 : 0;
+            } else if (node->op == Operator::Or) {
+                return lhs ? 1 : eval(node->rhs.get()) != 0;
+            }
+
+            int rhs = eval(node->rhs.get());
+            if ((node->op == Operator::Div || node->op == Operator::Rem)
+                && rhs == 0) {
+                throw Unknown();
+            }
+            return eval_binop(node->op, lhs, rhs);
+        }
+        case ExpNode::UnopExp: {
+            auto node = static_cast<UnOpNode *>(exp);
+            return eval_unop(node->op, eval(node->e.get()));
+        }
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp);
+            return call(node->fun_info.value(), node->args);
+        }
+        }
+
+        throw Unknown();
+    }
+
+    Flow exec(StmtNode *stmt)
+    {
+        step();
+
+        switch (stmt->kind) {
+        case StmtNode::VardeclStmt: {
+            auto node                      = static_cast<VardeclNode *>(stmt);
+            lookup(node->var_info.value()) = eval(node->rhs.get());
+            break;
+        }
+        case StmtNode::AssignStmt: {
+            auto node = static_cast<AssignNode *>(stmt);
+            auto lhs  = static_cast<VarNode *>(node->lhs.get());
+            lookup(lhs->var_info.value()) = eval(node->rhs.get());
+            break;
+        }
+        case StmtNode::IfStmt: {
+            auto node = static_cast<IfNode *>(stmt);
+            return eval(node->cond.get()) ? exec(node->then_stmts)
+                                          : exec(node->else_stmts);
+        }
+        case StmtNode::WhileStmt: {
+            auto node = static_cast<WhileNode *>(stmt);
+            if (!eval(node->cond.get())) {
+                return exec(node->otherwise_stmts);
+            }
+            do {
+                if (exec(node->body_stmts) == Flow::Return) {
+                    return Flow::Return;
+                }
+            } while (eval(node->cond.get()));
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            auto node  = static_cast<RepeatNode *>(stmt);
+            int  count = eval(node->cond.get());
+            for (int i = 0; i < count; i++) {
+                if (exec(node->body_stmts) == Flow::Return) {
+                    return Flow::Return;
+                }
+            }
+            break;
+        }
+        case StmtNode::CallStmt: {
+            auto node = static_cast<CallStmtNode *>(stmt);
+            call(node->fun_info.value(), node->args);
+            break;
+        }
+        case StmtNode::FundecStmt: break;
+        case StmtNode::RetStmt: {
+            // A self tail call is just a call here.
+            auto node = static_cast<RetNode *>(stmt);
+            ret_val   = node->ret_exp.has_value()
+                            ? eval(node->ret_exp.value().get())
+                            : 0;
+            return Flow::Return;
+        }
+        }
+
+        return Flow::Next;
+    }
+
+    Flow exec(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        for (auto &stmt : stmts) {
+            if (exec(stmt.get()) == Flow::Return) {
+                return Flow::Return;
+            }
+        }
+        return Flow::Next;
+    }
+
+    // The result of `node` if it can be evaluated now.
+    std::optional<int> evaluate(CallNode *node)
+    {
+        auto &info   = node->fun_info.value();
+        int   f      = info.var_idx_db;
+        auto &reads  = effects[f].reads;
+        auto &writes = effects[f].writes;
+        if (info.ret_type != Type::Int || program.funs[f] == nullptr
+            || effects[f].output
+            || std::find(reads.begin(), reads.end(), true) != reads.end()
+            || std::find(writes.begin(), writes.end(), true) != writes.end()) {
+            return std::nullopt;
+        }
+
+        std::vector<int> args;
+        for (auto &arg : node->args) {
+            if (arg->kind != ExpNode::IntExp) {
+                return std::nullopt;
+            }
+            args.push_back(static_cast<IntNode *>(arg.get())->ival);
+        }
+
+        auto [result, added] = results.try_emplace({ f, args });
+        if (!added) {
+            return result->second;
+        }
+        try {
+            steps          = STEP_BUDGET;
+            depth          = 0;
+            result->second = call(info, node->args);
+        } catch (Unknown &) {
+        }
+        return result->second;
+    }
+
+    void fold(std::unique_ptr<ExpNode> &exp)
+    {
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+        case ExpNode::StringExp:
+        case ExpNode::VarExp: break;
+        case ExpNode::BinopExp: {
+            auto node = static_cast<BinOpNode *>(exp.get());
+            fold(node->lhs);
+            fold(node->rhs);
+            break;
+        }
+        case ExpNode::UnopExp:
+            fold(static_cast<UnOpNode *>(exp.get())->e);
+            break;
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp.get());
+            for (auto &arg : node->args) {
+                fold(arg);
+            }
+            auto value = evaluate(node);
+            if (value.has_value()) {
+                auto res  = new IntNode();
+                res->ival = value.value();
+                res->pos  = node->pos;
+                exp.reset(res);
+                changed = true;
+            }
+            break;
+        }
+        }
+    }
+
+    void fold(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        for (auto &stmt : stmts) {
+            switch (stmt->kind) {
+            case StmtNode::VardeclStmt:
+                fold(static_cast<VardeclNode *>(stmt.get())->rhs);
+                break;
+            case StmtNode::AssignStmt:
+                fold(static_cast<AssignNode *>(stmt.get())->rhs);
+                break;
+            case StmtNode::IfStmt: {
+                auto node = static_cast<IfNode *>(stmt.get());
+                fold(node->cond);
+                fold(node->then_stmts);
+                fold(node->else_stmts);
+                break;
+            }
+            case StmtNode::WhileStmt: {
+                auto node = static_cast<WhileNode *>(stmt.get());
+                fold(node->cond);
+                fold(node->body_stmts);
+                fold(node->otherwise_stmts);
+                break;
+            }
+            case StmtNode::RepeatStmt: {
+                auto node = static_cast<RepeatNode *>(stmt.get());
+                fold(node->cond);
+                fold(node->body_stmts);
+                break;
+            }
+            case StmtNode::CallStmt: {
+                auto node = static_cast<CallStmtNode *>(stmt.get());
+                for (auto &arg : node->args) {
+                    fold(arg);
+                }
+                break;
+            }
+            case StmtNode::FundecStmt: break; // Done from program.funs
+            case StmtNode::RetStmt: {
+                auto node = static_cast<RetNode *>(stmt.get());
+                if (node->ret_exp.has_value()) {
+                    fold(node->ret_exp.value());
+                }
+                break;
+            }
+            }
+        }
+    }
+
+public:
+    CallFolder(std::list<std::unique_ptr<StmtNode>> &stmts)
+        : stmts(stmts)
+        , program(collect_program(stmts))
+    {
+    }
+
+    bool run()
+    {
+        effects = compute_effects(program);
+        for (unsigned int f = 1; f < program.funs.size(); f++) {
+            if (program.funs[f]) {
+                fold(program.funs[f]->body);
+            }
+        }
+        fold(stmts);
+        return changed;
+    }
+};
+
+bool
+fold_constant_calls(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    CallFolder folder(stmts);
+    return folder.run();
+}
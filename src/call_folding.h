@@ -0,0 +1,16 @@
+#pragma once
+
+#include <list>
+#include <memory>
+
+#include "ast.h"
+
+// Evaluates at compile time the calls whose arguments are all int constants
+// and replaces each with the int it returns. Only calls to int functions
+// that neither print, exit nor touch a global (see compute_effects()) are
+// tried, and a call is left alone if running it takes more than a fixed
+// number of steps or nests too deep, or would raise a runtime error, so that
+// it still fails the same way when the program runs. Returns whether
+// anything changed.
+bool
+fold_constant_calls(std::list<std::unique_ptr<StmtNode>> &stmts);
@@ -5,4 +5,5 @@
 #define COMPILE_STAGE_LEXER
 #define COMPILE_STAGE_PARSER
 #define COMPILE_STAGE_SYMBOL_RESOLVER
-#define COMPILE_STAGE_TYPE_CHECKER
\ No newline at end of file
+#define COMPILE_STAGE_TYPE_CHECKER
+#define COMPILE_STAGE_EXECUTOR
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "dead_stores.h"
+
+#include "effects.h"
+#include "program.h"
+
+// Variables live at some point, indexed by slot: the globals first, then the
+// locals of the function being looked at.
+using LiveSet = std::vector<bool>;
+
+static void
+add_live(LiveSet &live, const LiveSet &other)
+{
+    for (unsigned int i = 0; i < other.size(); i++) {
+        if (other[i]) {
+            live[i] = true;
+        }
+    }
+}
+
+class DeadStoreEliminator {
+private:
+    std::list<std::unique_ptr<StmtNode>> &stmts;
+
+    Program                      program;
+    std::vector<FunctionEffects> effects;
+
+    // Globals read anywhere, and so live whenever a function returns.
+    LiveSet read_anywhere;
+
+    // How often each variable is mentioned, other than by its declaration,
+    // indexed by function and frame slot.
+    std::vector<std::vector<int>> refs;
+
+    // Slots of the body being looked at, and what is live when it returns.
+    int     n_slots = 0;
+    LiveSet live_at_exit;
+
+    bool changed = false;
+
+    int slot(const VarInfo &info)
+    {
+        return info.fun_idx == 0 ? info.frame_idx
+                                 : program.n_globals + info.frame_idx;
+    }
+
+    int &refs_of(const VarInfo &info)
+    {
+        return refs[info.fun_idx][info.frame_idx];
+    }
+
+    static VarInfo &var_of(AssignNode *node)
+    {
+        return static_cast<VarNode *>(node->lhs.get())->var_info.value();
+    }
+
+    // Adds `delta` to the references of every variable `exp` reads.
+    void count_refs(ExpNode *exp, int delta)
+    {
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+        case ExpNode::StringExp: break;
+        case ExpNode::VarExp:
+            refs_of(static_cast<VarNode *>(exp)->var_info.value()) += delta;
+            break;
+        case ExpNode::UnopExp:
+            count_refs(static_cast<UnOpNode *>(exp)->e.get(), delta);
+            break;
+        case ExpNode::BinopExp:
+            count_refs(static_cast<BinOpNode *>(exp)->lhs.get(), delta);
+            count_refs(static_cast<BinOpNode *>(exp)->rhs.get(), delta);
+            break;
+        case ExpNode::CallExp:
+            for (auto &arg : static_cast<CallNode *>(exp)->args) {
+                count_refs(arg.get(), delta);
+            }
+            break;
+        }
+    }
+
+    void count_refs(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        for (auto &stmt : stmts) {
+            switch (stmt->kind) {
+            case StmtNode::AssignStmt: {
+                auto node = static_cast<AssignNode *>(stmt.get());
+                refs_of(var_of(node))++;
+                count_refs(node->rhs.get(), 1);
+                break;
+            }
+            case StmtNode::VardeclStmt:
+                count_refs(static_cast<VardeclNode *>(stmt.get())->rhs.get(),
+                           1);
+                break;
+            case StmtNode::IfStmt: {
+                auto node = static_cast<IfNode *>(stmt.get());
+                count_refs(node->cond.get(), 1);
+                count_refs(node->then_stmts);
+                count_refs(node->else_stmts);
+                break;
+            }
+            case StmtNode::WhileStmt: {
+                auto node = static_cast<WhileNode *>(stmt.get());
+                count_refs(node->cond.get(), 1);
+                count_refs(node->body_stmts);
+                count_refs(node->otherwise_stmts);
+                break;
+            }
+            case StmtNode::RepeatStmt: {
+                auto node = static_cast<RepeatNode *>(stmt.get());
+                count_refs(node->cond.get(), 1);
+                count_refs(node->body_stmts);
+                break;
+            }
+            case StmtNode::CallStmt: {
+                auto node = static_cast<CallStmtNode *>(stmt.get());
+                for (auto &arg : node->args) {
+                    count_refs(arg.get(), 1);
+                }
+                break;
+            }
+            case StmtNode::FundecStmt:
+                count_refs(static_cast<FundecNode *>(stmt.get())->body);
+                break;
+            case StmtNode::RetStmt: {
+                auto node = static_cast<RetNode *>(stmt.get());
+                if (node->ret_exp.has_value()) {
+                    count_refs(node->ret_exp->get(), 1);
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    bool removable_call(const FunInfo                               &fun_info,
+                        const std::vector<std::unique_ptr<ExpNode>> &args)
+    {
+        if (!effects[fun_info.var_idx_db].pure()) {
+            return false;
+        }
+        for (auto &arg : args) {
+            if (!removable(arg.get())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether evaluating `exp` has no effect besides computing its value.
+    bool removable(ExpNode *exp)
+    {
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+        case ExpNode::StringExp:
+        case ExpNode::VarExp: return true;
+        case ExpNode::UnopExp:
+            return removable(static_cast<UnOpNode *>(exp)->e.get());
+        case ExpNode::BinopExp: {
+            auto node = static_cast<BinOpNode *>(exp);
+            if ((node->op == Operator::Div || node->op == Operator::Rem)
+                && (node->rhs->kind != ExpNode::IntExp
+                    || static_cast<IntNode *>(node->rhs.get())->ival == 0)) {
+                return false;
+            }
+            return removable(node->lhs.get()) && removable(node->rhs.get());
+        }
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp);
+            return removable_call(node->fun_info.value(), node->args);
+        }
+        }
+        return false;
+    }
+
+    // Marks the variables evaluating `exp` reads as live.
+    void add_uses(ExpNode *exp, LiveSet &live)
+    {
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+        case ExpNode::StringExp: break;
+        case ExpNode::VarExp:
+            live[slot(static_cast<VarNode *>(exp)->var_info.value())] = true;
+            break;
+        case ExpNode::UnopExp:
+            add_uses(static_cast<UnOpNode *>(exp)->e.get(), live);
+            break;
+        case ExpNode::BinopExp:
+            add_uses(static_cast<BinOpNode *>(exp)->lhs.get(), live);
+            add_uses(static_cast<BinOpNode *>(exp)->rhs.get(), live);
+            break;
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp);
+            add_call_uses(node->fun_info.value(), node->args, live);
+            break;
+        }
+        }
+    }
+
+    void add_call_uses(const FunInfo                               &fun_info,
+                       const std::vector<std::unique_ptr<ExpNode>> &args,
+                       LiveSet                                     &live)
+    {
+        for (auto &arg : args) {
+            add_uses(arg.get(), live);
+        }
+        add_live(live, effects[fun_info.var_idx_db].reads);
+    }
+
+    // A dead value of a declaration that has to stay, since its variable is
+    // still assigned somewhere.
+    static std::unique_ptr<ExpNode> placeholder(VardeclNode *node)
+    {
+        std::unique_ptr<ExpNode> res;
+        if (node->type == Type::String) {
+            res = std::make_unique<StrNode>();
+        } else {
+            auto zero  = std::make_unique<IntNode>();
+            zero->ival = 0;
+            res        = std::move(zero);
+        }
+        res->pos        = node->rhs->pos;
+        res->value_type = node->type;
+        return res;
+    }
+
+    static std::unique_ptr<StmtNode> call_stmt(std::unique_ptr<ExpNode> &exp)
+    {
+        auto call     = static_cast<CallNode *>(exp.get());
+        auto res      = std::make_unique<CallStmtNode>();
+        res->name     = call->name;
+        res->args     = std::move(call->args);
+        res->fun_info = call->fun_info;
+        res->pos      = call->pos;
+        return res;
+    }
+
+    // Handles a store of `rhs` to `var`, which is dead unless it is in
+    // `live`. Returns whether the store has to stay; `rhs` is then counted
+    // as read.
+    bool store(const VarInfo &var, ExpNode *rhs, LiveSet &live)
+    {
+        if (live[slot(var)]) {
+            live[slot(var)] = false;
+            add_uses(rhs, live);
+            return true;
+        }
+        if (removable(rhs)) {
+            return false;
+        }
+        add_uses(rhs, live);
+        return true;
+    }
+
+    // Given what is live after `stmts`, returns what is live before them.
+    // With `rewrite`, dead stores go on the way; without, only the liveness
+    // that leaves is worked out.
+    LiveSet live_before(std::list<std::unique_ptr<StmtNode>> &stmts,
+                        LiveSet                               live,
+                        bool                                  rewrite)
+    {
+        auto it = stmts.end();
+        while (it != stmts.begin()) {
+            --it;
+            auto &stmt = *it;
+
+            switch (stmt->kind) {
+            case StmtNode::AssignStmt: {
+                auto  node = static_cast<AssignNode *>(stmt.get());
+                auto &var  = var_of(node);
+                bool  dead = !live[slot(var)];
+                bool  kept = store(var, node->rhs.get(), live);
+                if (!dead || !rewrite) {
+                    break;
+                }
+                if (!kept) {
+                    refs_of(var)--;
+                    count_refs(node->rhs.get(), -1);
+                    it      = stmts.erase(it);
+                    changed = true;
+                } else if (node->rhs->kind == ExpNode::CallExp) {
+                    refs_of(var)--;
+                    stmt    = call_stmt(node->rhs);
+                    changed = true;
+                }
+                break;
+            }
+            case StmtNode::VardeclStmt: {
+                auto  node = static_cast<VardeclNode *>(stmt.get());
+                auto &var  = node->var_info.value();
+                bool  dead = !live[slot(var)];
+                bool  kept = store(var, node->rhs.get(), live);
+                if (!dead || !rewrite) {
+                    break;
+                }
+                if (kept && refs_of(var) == 0
+                    && node->rhs->kind == ExpNode::CallExp) {
+                    stmt    = call_stmt(node->rhs);
+                    changed = true;
+                } else if (!kept && refs_of(var) == 0) {
+                    count_refs(node->rhs.get(), -1);
+                    it      = stmts.erase(it);
+                    changed = true;
+                } else if (!kept && node->rhs->kind != ExpNode::IntExp
+                           && node->rhs->kind != ExpNode::StringExp) {
+                    count_refs(node->rhs.get(), -1);
+                    node->rhs = placeholder(node);
+                    changed   = true;
+                }
+                break;
+            }
+            case StmtNode::IfStmt: {
+                auto node = static_cast<IfNode *>(stmt.get());
+                auto then_live = live_before(node->then_stmts, live, rewrite);
+                live = live_before(node->else_stmts, live, rewrite);
+                add_live(live, then_live);
+                add_uses(node->cond.get(), live);
+                break;
+            }
+            case StmtNode::WhileStmt: {
+                // The condition is tested before the first iteration, where
+                // the otherwise block may follow, and after every iteration,
+                // where the loop may end.
+                auto    node = static_cast<WhileNode *>(stmt.get());
+                LiveSet body(n_slots, false);
+                LiveSet retest;
+                while (true) {
+                    retest = live;
+                    add_live(retest, body);
+                    add_uses(node->cond.get(), retest);
+                    auto next = live_before(node->body_stmts, retest, false);
+                    if (next == body) {
+                        break;
+                    }
+                    body = std::move(next);
+                }
+                if (rewrite) {
+                    live_before(node->body_stmts, retest, true);
+                }
+                live = live_before(node->otherwise_stmts, live, rewrite);
+                add_live(live, body);
+                add_uses(node->cond.get(), live);
+                break;
+            }
+            case StmtNode::RepeatStmt: {
+                auto    node = static_cast<RepeatNode *>(stmt.get());
+                LiveSet body(n_slots, false);
+                LiveSet head;
+                while (true) {
+                    head = live;
+                    add_live(head, body);
+                    auto next = live_before(node->body_stmts, head, false);
+                    if (next == body) {
+                        break;
+                    }
+                    body = std::move(next);
+                }
+                if (rewrite) {
+                    live_before(node->body_stmts, head, true);
+                }
+                live = std::move(head);
+                add_uses(node->cond.get(), live);
+                break;
+            }
+            case StmtNode::CallStmt: {
+                auto  node = static_cast<CallStmtNode *>(stmt.get());
+                auto &info = node->fun_info.value();
+                if (!removable_call(info, node->args)) {
+                    add_call_uses(info, node->args, live);
+                } else if (rewrite) {
+                    for (auto &arg : node->args) {
+                        count_refs(arg.get(), -1);
+                    }
+                    it      = stmts.erase(it);
+                    changed = true;
+                }
+                break;
+            }
+            case StmtNode::FundecStmt: break;
+            case StmtNode::RetStmt: {
+                auto node = static_cast<RetNode *>(stmt.get());
+                live      = live_at_exit;
+                if (node->ret_exp.has_value()) {
+                    add_uses(node->ret_exp->get(), live);
+                }
+                break;
+            }
+            }
+        }
+        return live;
+    }
+
+    void eliminate(std::list<std::unique_ptr<StmtNode>> &body, int fun_idx)
+    {
+        int n_locals = fun_idx == 0 ? 0 : program.funs[fun_idx]->frame_size;
+        n_slots      = program.n_globals + n_locals;
+
+        // Nothing is read once the top level is done.
+        live_at_exit.assign(n_slots, false);
+        if (fun_idx != 0) {
+            add_live(live_at_exit, read_anywhere);
+        }
+        live_before(body, live_at_exit, true);
+    }
+
+public:
+    DeadStoreEliminator(std::list<std::unique_ptr<StmtNode>> &stmts)
+        : stmts(stmts)
+        , program(collect_program(stmts))
+    {
+    }
+
+    bool run()
+    {
+        effects = compute_effects(program);
+        read_anywhere.assign(program.n_globals, false);
+        for (auto &fun_effects : effects) {
+            add_live(read_anywhere, fun_effects.reads);
+        }
+
+        refs.resize(program.funs.size());
+        refs[0].assign(program.n_globals, 0);
+        for (unsigned int f = 1; f < program.funs.size(); f++) {
+            if (program.funs[f]) {
+                refs[f].assign(program.funs[f]->frame_size, 0);
+            }
+        }
+        count_refs(stmts);
+
+        // The top level comes last, so that the globals only functions
+        // mentioned have been dealt with there.
+        for (unsigned int f = 1; f < program.funs.size(); f++) {
+            if (program.funs[f]) {
+                eliminate(program.funs[f]->body, f);
+            }
+        }
+        eliminate(stmts, 0);
+        return changed;
+    }
+};
+
+bool
+eliminate_dead_stores(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    DeadStoreEliminator eliminator(stmts);
+    return eliminator.run();
+}
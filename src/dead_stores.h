@@ -0,0 +1,22 @@
+#pragma once
+
+#include <list>
+#include <memory>
+
+#include "ast.h"
+
+// Dead store elimination. A backward liveness analysis over every function
+// body and the top level finds the assignments and declarations whose value
+// is never read before being overwritten, or before the program ends for a
+// global. Locals die when their function returns; a global stays live out
+// of a function if anything reads it, and a call reads whatever its callee
+// may read (see compute_effects()).
+//
+// A dead store is deleted if computing its value has no effect: it calls
+// only functions that are pure, and divides only by nonzero constants. The
+// value of a dead store that calls an impure function is computed by a call
+// statement instead. Call statements to pure functions are deleted too. A
+// declaration whose variable ends up never mentioned again goes; otherwise
+// its dead value is replaced by 0 or "". Returns whether anything changed.
+bool
+eliminate_dead_stores(std::list<std::unique_ptr<StmtNode>> &stmts);
@@ -0,0 +1,250 @@
+#include "effects.h"
+
+// Passes each function's effects on to its callers until nothing changes.
+// `fails` is whether a function may fail by itself, not counting its calls.
+static void
+propagate_effects(std::vector<FunctionEffects>        &res,
+                  const std::vector<std::vector<int>> &callees,
+                  const std::vector<bool>             &fails,
+                  int                                  n_globals)
+{
+    int n_funs = res.size();
+
+    // Reads, writes and output only grow as they are passed on to callers;
+    // may_fail only shrinks.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int f = 0; f < n_funs; f++) {
+            auto &effects  = res[f];
+            bool  may_fail = fails[f];
+            for (int callee : callees[f]) {
+                auto &other = res[callee];
+                for (int g = 0; g < n_globals; g++) {
+                    if (other.reads[g] && !effects.reads[g]) {
+                        effects.reads[g] = true;
+                        changed          = true;
+                    }
+                    if (other.writes[g] && !effects.writes[g]) {
+                        effects.writes[g] = true;
+                        changed           = true;
+                    }
+                }
+                if (other.output && !effects.output) {
+                    effects.output = true;
+                    changed        = true;
+                }
+                may_fail = may_fail || other.may_fail;
+            }
+            if (may_fail != effects.may_fail) {
+                effects.may_fail = may_fail;
+                changed          = true;
+            }
+        }
+    }
+}
+
+std::vector<FunctionEffects>
+compute_effects(IRProgram &program)
+{
+    int                           n_funs = program.funs.size();
+    std::vector<FunctionEffects>  res(n_funs);
+    std::vector<std::vector<int>> callees(n_funs);
+    std::vector<bool>             fails(n_funs, false);
+
+    for (int f = 0; f < n_funs; f++) {
+        auto &effects = res[f];
+        effects.reads.assign(program.n_globals, false);
+        effects.writes.assign(program.n_globals, false);
+
+        auto *fun = program.funs[f].get();
+        if (fun == nullptr) {
+            effects.output   = true;
+            effects.may_fail = true;
+            fails[f]         = true;
+            continue;
+        }
+
+        // Divisors that are always the same nonzero constant.
+        std::vector<int>  n_defs(fun->n_regs(), 0);
+        std::vector<bool> nonzero(fun->n_regs(), false);
+        for (auto &block : fun->blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    n_defs[inst.dst]++;
+                    nonzero[inst.dst] = inst.op == IROp::Const && inst.imm != 0;
+                }
+            }
+        }
+
+        fails[f] = !find_loops(*fun, compute_dominators(*fun)).empty();
+        for (auto &block : fun->blocks) {
+            for (auto &inst : block.insts) {
+                switch (inst.op) {
+                case IROp::LoadGlobal: effects.reads[inst.imm] = true; break;
+                case IROp::StoreGlobal: effects.writes[inst.imm] = true; break;
+                case IROp::Call: callees[f].push_back(inst.imm); break;
+                case IROp::BinOp:
+                    if ((inst.binop == Operator::Div
+                         || inst.binop == Operator::Rem)
+                        && (inst.b < fun->n_params || n_defs[inst.b] != 1
+                            || !nonzero[inst.b])) {
+                        fails[f] = true;
+                    }
+                    break;
+                default: break;
+                }
+            }
+        }
+
+        // Until shown otherwise, calls may fail; that way functions that
+        // call each other in a cycle never stop failing.
+        effects.may_fail = fails[f] || !callees[f].empty();
+    }
+
+    propagate_effects(res, callees, fails, program.n_globals);
+    return res;
+}
+
+// What one body does by itself: the globals it reads and writes, the
+// functions it calls, and whether it may fail. Function declarations nested
+// in it are bodies of their own.
+struct BodyScan {
+    FunctionEffects  &effects;
+    std::vector<int> &callees;
+    bool              fails = false;
+
+    void global(std::optional<VarInfo> &info, std::vector<bool> &set)
+    {
+        if (info->fun_idx == 0) {
+            set[info->frame_idx] = true;
+        }
+    }
+
+    void scan_exp(ExpNode *exp)
+    {
+        switch (exp->kind) {
+        case ExpNode::IntExp:
+        case ExpNode::StringExp: break;
+        case ExpNode::VarExp:
+            global(static_cast<VarNode *>(exp)->var_info, effects.reads);
+            break;
+        case ExpNode::UnopExp:
+            scan_exp(static_cast<UnOpNode *>(exp)->e.get());
+            break;
+        case ExpNode::BinopExp: {
+            auto node = static_cast<BinOpNode *>(exp);
+            if ((node->op == Operator::Div || node->op == Operator::Rem)
+                && (node->rhs->kind != ExpNode::IntExp
+                    || static_cast<IntNode *>(node->rhs.get())->ival == 0)) {
+                fails = true;
+            }
+            scan_exp(node->lhs.get());
+            scan_exp(node->rhs.get());
+            break;
+        }
+        case ExpNode::CallExp: {
+            auto node = static_cast<CallNode *>(exp);
+            callees.push_back(node->fun_info->var_idx_db);
+            for (auto &arg : node->args) {
+                scan_exp(arg.get());
+            }
+            break;
+        }
+        }
+    }
+
+    void scan_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        for (auto &stmt : stmts) {
+            scan_stmt(stmt.get());
+        }
+    }
+
+    void scan_stmt(StmtNode *stmt)
+    {
+        switch (stmt->kind) {
+        case StmtNode::AssignStmt: {
+            auto node = static_cast<AssignNode *>(stmt);
+            global(static_cast<VarNode *>(node->lhs.get())->var_info,
+                   effects.writes);
+            scan_exp(node->rhs.get());
+            break;
+        }
+        case StmtNode::VardeclStmt: {
+            auto node = static_cast<VardeclNode *>(stmt);
+            global(node->var_info, effects.writes);
+            scan_exp(node->rhs.get());
+            break;
+        }
+        case StmtNode::IfStmt: {
+            auto node = static_cast<IfNode *>(stmt);
+            scan_exp(node->cond.get());
+            scan_stmts(node->then_stmts);
+            scan_stmts(node->else_stmts);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            auto node = static_cast<WhileNode *>(stmt);
+            fails     = true;
+            scan_exp(node->cond.get());
+            scan_stmts(node->body_stmts);
+            scan_stmts(node->otherwise_stmts);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            auto node = static_cast<RepeatNode *>(stmt);
+            fails     = true;
+            scan_exp(node->cond.get());
+            scan_stmts(node->body_stmts);
+            break;
+        }
+        case StmtNode::CallStmt: {
+            auto node = static_cast<CallStmtNode *>(stmt);
+            callees.push_back(node->fun_info->var_idx_db);
+            for (auto &arg : node->args) {
+                scan_exp(arg.get());
+            }
+            break;
+        }
+        case StmtNode::FundecStmt: break;
+        case StmtNode::RetStmt: {
+            auto node = static_cast<RetNode *>(stmt);
+            if (node->ret_exp.has_value()) {
+                scan_exp(node->ret_exp->get());
+            }
+            break;
+        }
+        }
+    }
+};
+
+std::vector<FunctionEffects>
+compute_effects(Program &program)
+{
+    int                           n_funs = program.funs.size();
+    std::vector<FunctionEffects>  res(n_funs);
+    std::vector<std::vector<int>> callees(n_funs);
+    std::vector<bool>             fails(n_funs, false);
+
+    for (int f = 0; f < n_funs; f++) {
+        auto &effects = res[f];
+        effects.reads.assign(program.n_globals, false);
+        effects.writes.assign(program.n_globals, false);
+
+        if (f != 0 && program.funs[f] == nullptr) {
+            effects.output   = true;
+            effects.may_fail = true;
+            fails[f]         = true;
+            continue;
+        }
+
+        BodyScan scan = { effects, callees[f] };
+        scan.scan_stmts(f == 0 ? program.stmts : program.funs[f]->body);
+        fails[f]         = scan.fails;
+        effects.may_fail = fails[f] || !callees[f].empty();
+    }
+
+    propagate_effects(res, callees, fails, program.n_globals);
+    return res;
+}
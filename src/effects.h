@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "ir.h"
+#include "program.h"
+
+// What calling a function can do besides computing its result, including
+// everything done by the functions it calls.
+struct FunctionEffects {
+    // Globals the function may read and write, indexed by global.
+    std::vector<bool> reads;
+    std::vector<bool> writes;
+
+    // Whether it may print or exit the program.
+    bool output = false;
+
+    // Whether it may raise a runtime error or never return: it divides by
+    // something other than a nonzero constant, loops, or calls a function
+    // that does, including itself.
+    bool may_fail = false;
+
+    // Whether a call does nothing but compute its result from its arguments
+    // and the globals it reads, and always returns.
+    bool pure() const
+    {
+        return !output && !may_fail
+               && std::find(writes.begin(), writes.end(), true) == writes.end();
+    }
+};
+
+// Summarizes every function of the program, indexed like IRProgram::funs.
+// Builtins print or exit.
+std::vector<FunctionEffects>
+compute_effects(IRProgram &program);
+
+// The same from the AST, indexed like Program::funs, with the top level at
+// index 0. A loop of any kind counts as one that may never end.
+std::vector<FunctionEffects>
+compute_effects(Program &program);
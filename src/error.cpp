@@ -1,44 +1,75 @@
 #include "error.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <vector>
 
-char const *RED_BEGIN = "\033[1;31m";
-char const *RED_END   = "\033[0m";
+char const *RED_BEGIN    = "\033[1;31m";
+char const *YELLOW_BEGIN = "\033[1;33m";
+char const *COLOR_END      = "\033[0m";
 
-static std::vector<std::string>
-split_string(const std::string &str)
+LineIndex::LineIndex(std::string_view src)
 {
-    std::vector<std::string> tokens;
+    line_starts.push_back(0);
 
-    std::stringstream ss(str);
-    std::string       token;
-    while (std::getline(ss, token, '\n')) {
-        tokens.push_back(token);
+    const char *begin = src.data();
+    const char *end   = begin + src.size();
+    for (const char *p = begin;
+         (p = (const char *)memchr(p, '\n', end - p)) != nullptr;
+         p++) {
+        line_starts.push_back(p + 1 - begin);
+    }
+}
+
+LineCol
+LineIndex::locate(SourcePos pos) const
+{
+    auto line = std::upper_bound(line_starts.begin(), line_starts.end(), pos);
+    int  idx  = line - line_starts.begin() - 1;
+    return { idx + 1, (int)(pos - line_starts[idx]) + 1 };
+}
+
+static std::vector<std::string_view>
+split_string(std::string_view str)
+{
+    std::vector<std::string_view> tokens;
+
+    size_t start = 0;
+    while (start < str.size()) {
+        size_t end = str.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = str.size();
+        }
+        tokens.push_back(str.substr(start, end - start));
+        start = end + 1;
     }
 
     return tokens;
 }
 
-void
-print_err(const std::string &src,
-          int                line_num,
-          int                col_num,
-          const std::string &message)
+static void
+print_excerpt(std::ostream      &out,
+              const char        *kind,
+              std::string_view   src,
+              const LineIndex   &line_index,
+              SourcePos          pos,
+              const std::string &message)
 {
-    assert(line_num > 0);
-    assert(col_num > 0);
+    assert(pos <= src.size());
+
+    auto [line_num, col_num] = line_index.locate(pos);
 
     const int up_limit   = 2;
     const int down_limit = 2;
 
     auto lines = split_string(src);
 
-    std::cout << RED_BEGIN
-              << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n";
-    std::cout << "Error on line " << line_num << ", column " << col_num
-              << ":\n";
+    out << "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n";
+    out << kind << " on line " << line_num << ", column " << col_num
+        << ":\n";
     for (int src_line_num = 1; src_line_num <= (int)lines.size();
          ++src_line_num) {
         // Actual index into the array:
@@ -46,17 +77,63 @@ print_err(const std::string &src,
 
         if (line_num - up_limit <= src_line_num
             && src_line_num <= line_num + down_limit) {
-            std::cout << (src_line_num == line_num ? ">> " : "   ")
-                      << lines[idx] << "\n";
+            out << (src_line_num == line_num ? ">> " : "   ") << lines[idx]
+                << "\n";
             if (src_line_num == line_num) {
                 for (int col = 0; col <= col_num + 1; col++) {
-                    std::cout << " ";
+                    out << " ";
                 }
-                std::cout << "^\n";
+                out << "^\n";
             }
         }
     }
 
-    std::cout << "Message: " << message << "\n";
-    std::cout << RED_END;
-}
\ No newline at end of file
+    out << "Message: " << message << "\n";
+}
+
+void
+print_err(std::string_view src, SourcePos pos, const std::string &message)
+{
+    std::cout << RED_BEGIN;
+    print_excerpt(std::cout, "Error", src, LineIndex(src), pos, message);
+    std::cout << COLOR_END;
+}
+
+struct Warning {
+    SourcePos   pos;
+    std::string message;
+};
+
+static std::vector<Warning> warnings;
+
+void
+add_warning(const std::string &message, SourcePos pos)
+{
+    for (auto &warning : warnings) {
+        if (warning.pos == pos && warning.message == message) {
+            return;
+        }
+    }
+    warnings.push_back({ pos, message });
+}
+
+void
+print_warnings(std::string_view src)
+{
+    if (warnings.empty()) {
+        return;
+    }
+
+    LineIndex line_index(src);
+    for (auto &warning : warnings) {
+        std::cerr << YELLOW_BEGIN;
+        print_excerpt(std::cerr,
+                      "Warning",
+                      src,
+                      line_index,
+                      warning.pos,
+                      warning.message);
+        std::cerr << COLOR_END;
+    }
+    warnings.clear();
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #define EXIT_LEXER_FAILURE (char)201
 #define EXIT_PARSER_FAILURE (char)202
@@ -8,32 +13,45 @@
 #define EXIT_TYPECHECK_FAILURE (char)204
 #define EXIT_RUNTIME_FAILURE (char)205
 
+// A position in the program source, as a byte offset from its start. Tokens,
+// AST nodes and IR instructions carry one of these instead of a line and
+// column, which only LineIndex works out, once something is to be reported.
+typedef uint32_t SourcePos;
+
+// Line and column numbers, both counting from 1.
+struct LineCol {
+    int line_num;
+    int col_num;
+};
+
+// The offsets at which the lines of a source start, found in one pass over it
+// so that each position is then located with a binary search.
+class LineIndex {
+private:
+    std::vector<uint32_t> line_starts;
+
+public:
+    LineIndex(std::string_view src);
+
+    LineCol locate(SourcePos pos) const;
+};
+
 class AlbatrossError : public std::runtime_error {
 private:
-    int  _line_num;
-    int  _col_num;
-    char _exit_code;
+    SourcePos _pos;
+    char      _exit_code;
 
 public:
-    AlbatrossError(const std::string &msg,
-                   int                line_num,
-                   int                col_num,
-                   char               exit_code)
+    AlbatrossError(const std::string &msg, SourcePos pos, char exit_code)
         : std::runtime_error(msg)
-        , _line_num(line_num)
-        , _col_num(col_num)
+        , _pos(pos)
         , _exit_code(exit_code)
     {
     }
 
-    int line_num()
-    {
-        return _line_num;
-    }
-
-    int col_num()
+    SourcePos pos()
     {
-        return _col_num;
+        return _pos;
     }
 
     char exit_code()
@@ -43,7 +61,14 @@ public:
 };
 
 void
-print_err(const std::string &src,
-          int                line_num,
-          int                col_num,
-          const std::string &message);
\ No newline at end of file
+print_err(std::string_view src, SourcePos pos, const std::string &message);
+
+// Warnings are for code that is legal but cannot do what was meant, found
+// while compiling. They are collected as they are found, once per position,
+// and printed to stderr (where they cannot mix with the program's output)
+// by print_warnings().
+void
+add_warning(const std::string &message, SourcePos pos);
+
+void
+print_warnings(std::string_view src);
@@ -0,0 +1,328 @@
+#include "gvn.h"
+
+#include <algorithm>
+#include <map>
+
+#include "liveness.h"
+#include "ssa.h"
+
+// What an instruction computes, in terms of the value numbers of its
+// operands.
+struct ValueKey {
+    IROp             op;
+    Operator         binop;
+    int64_t          imm;
+    std::vector<int> operands;
+
+    auto operator<=>(const ValueKey &) const = default;
+};
+
+static bool
+is_commutative(Operator op)
+{
+    return op == Operator::Add || op == Operator::Mul || op == Operator::Band
+           || op == Operator::Bor || op == Operator::Xor || op == Operator::Eq
+           || op == Operator::Ne;
+}
+
+class ValueNumberer {
+private:
+    IRFunction                         &fun;
+    const std::vector<FunctionEffects> &effects;
+    Dominators                          dom;
+
+    // The value number of every register: the register that first held the
+    // same value, in a block dominating the ones it is read in.
+    std::vector<int> vn;
+
+    // Whether a register is defined by a constant load, and definitions of
+    // each original register, counting parameters.
+    std::vector<bool> is_const;
+    std::vector<int>  n_defs;
+
+    // The value numbers of the instructions in the blocks dominating the
+    // one being looked at.
+    std::map<ValueKey, int> table;
+
+    // Registers holding a copy of a value number whose own register has
+    // several definitions (see destruct_ssa()), to be read in its place.
+    std::map<int, int> copies;
+
+    bool changed = false;
+
+    int origin(int reg)
+    {
+        return reg < (int)fun.ssa_origin.size() ? fun.ssa_origin[reg] : reg;
+    }
+
+    void analyze()
+    {
+        int n_regs = fun.n_regs();
+        vn.resize(n_regs);
+        for (int r = 0; r < n_regs; r++) {
+            vn[r] = r;
+        }
+        is_const.assign(n_regs, false);
+        n_defs.assign(n_regs, 0);
+
+        for (int p = 0; p < fun.n_params; p++) {
+            n_defs[p]++;
+        }
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    is_const[inst.dst] = inst.op == IROp::Const;
+                    n_defs[origin(inst.dst)]++;
+                }
+            }
+        }
+    }
+
+    // A register holding value number `value` that may be read anywhere it
+    // dominates, or -1 if copying it would gain nothing.
+    int reader(int value, bool make_copy)
+    {
+        if (n_defs[origin(value)] == 1) {
+            return value;
+        }
+        auto copy = copies.find(value);
+        if (copy != copies.end()) {
+            return copy->second;
+        }
+        if (!make_copy) {
+            return -1;
+        }
+        int reg = fun.new_reg(fun.reg_types[value]);
+        vn.push_back(value);
+        is_const.push_back(false);
+        n_defs.push_back(1);
+        copies[value] = reg;
+        return reg;
+    }
+
+    bool key_of(IRInst &inst, ValueKey &key)
+    {
+        key = { inst.op, Operator::Invalid, 0, {} };
+        switch (inst.op) {
+        case IROp::Const: key.imm = inst.imm; return true;
+        case IROp::UnOp:
+            key.binop    = inst.binop;
+            key.operands = { vn[inst.a] };
+            return true;
+        case IROp::BinOp: {
+            int a = vn[inst.a];
+            int b = vn[inst.b];
+            key.binop = inst.binop;
+            if (key.binop == Operator::Gt || key.binop == Operator::Ge) {
+                key.binop = key.binop == Operator::Gt ? Operator::Lt
+                                                      : Operator::Le;
+                std::swap(a, b);
+            } else if (is_commutative(key.binop) && b < a) {
+                std::swap(a, b);
+            }
+            key.operands = { a, b };
+            return true;
+        }
+        case IROp::Call: {
+            auto &callee = effects[inst.imm];
+            if (inst.dst < 0 || !callee.pure()
+                || std::find(callee.reads.begin(), callee.reads.end(), true)
+                       != callee.reads.end()) {
+                return false;
+            }
+            key.imm = inst.imm;
+            for (int arg : inst.args) {
+                key.operands.push_back(vn[arg]);
+            }
+            return true;
+        }
+        default: return false;
+        }
+    }
+
+    // Numbers the instructions of block `b`, adding the values it computes
+    // first to the table and to `added`.
+    void number_block(int b, std::vector<ValueKey> &added)
+    {
+        for (auto &inst : fun.blocks[b].insts) {
+            if (inst.op == IROp::Phi) {
+                continue;
+            }
+
+            // Reads of a value already held elsewhere read it from there.
+            // Constants stay where they are, as immediates.
+            for_each_use(inst, [&](int &reg) {
+                if (vn[reg] == reg || is_const[reg]) {
+                    return;
+                }
+                int from = reader(vn[reg], false);
+                if (from >= 0 && from != reg) {
+                    reg     = from;
+                    changed = true;
+                }
+            });
+
+            if (inst.dst < 0) {
+                continue;
+            }
+            if (inst.op == IROp::Mov) {
+                vn[inst.dst] = vn[inst.a];
+                continue;
+            }
+
+            ValueKey key;
+            if (!key_of(inst, key)) {
+                continue;
+            }
+            auto found = table.find(key);
+            if (found == table.end()) {
+                table.emplace(key, inst.dst);
+                added.push_back(std::move(key));
+                continue;
+            }
+
+            vn[inst.dst] = found->second;
+            if (inst.op == IROp::Const) {
+                continue;
+            }
+            IRInst mov;
+            mov.op  = IROp::Mov;
+            mov.dst = inst.dst;
+            mov.a   = reader(found->second, true);
+            mov.pos = inst.pos;
+            inst    = std::move(mov);
+            changed = true;
+        }
+    }
+
+    // Numbers the blocks in a preorder walk of the dominator tree, taking
+    // the values a block added back out of the table once the walk leaves
+    // it. The walk is iterative, like the renaming in construct_ssa().
+    void number_blocks()
+    {
+        std::vector<std::vector<ValueKey>> added(fun.blocks.size());
+        std::vector<std::pair<int, bool>>  stack = { { 0, false } };
+        while (!stack.empty()) {
+            auto [b, done] = stack.back();
+            stack.pop_back();
+            if (done) {
+                for (auto &key : added[b]) {
+                    table.erase(key);
+                }
+                added[b].clear();
+                continue;
+            }
+            stack.push_back({ b, true });
+
+            number_block(b, added[b]);
+            auto &children = dom.children[b];
+            for (auto child = children.rbegin(); child != children.rend();
+                 child++) {
+                stack.push_back({ *child, false });
+            }
+        }
+    }
+
+    // Puts every copy made by reader() right after the definition of the
+    // value it copies.
+    void insert_copies()
+    {
+        for (auto &block : fun.blocks) {
+            std::vector<IRInst> insts;
+            for (auto &inst : block.insts) {
+                int dst = inst.dst;
+                insts.push_back(std::move(inst));
+                auto copy = copies.find(dst);
+                if (dst < 0 || copy == copies.end()) {
+                    continue;
+                }
+                IRInst mov;
+                mov.op  = IROp::Mov;
+                mov.dst = copy->second;
+                mov.a   = dst;
+                mov.pos = insts.back().pos;
+                insts.push_back(std::move(mov));
+            }
+            block.insts = std::move(insts);
+        }
+    }
+
+    bool removable(IRInst &inst, std::vector<bool> &nonzero)
+    {
+        switch (inst.op) {
+        case IROp::Const:
+        case IROp::ConstStr:
+        case IROp::Mov:
+        case IROp::UnOp:
+        case IROp::LoadGlobal:
+        case IROp::Phi: return true;
+        case IROp::BinOp:
+            return (inst.binop != Operator::Div && inst.binop != Operator::Rem)
+                   || nonzero[inst.b];
+        case IROp::Call: return effects[inst.imm].pure();
+        default: return false;
+        }
+    }
+
+    // Deletes the instructions whose results are never read, and then the
+    // ones only those read, and so on.
+    void remove_unused()
+    {
+        std::vector<int>  uses(fun.n_regs(), 0);
+        std::vector<bool> nonzero(fun.n_regs(), false);
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                for_each_use(inst, [&](int reg) { uses[reg]++; });
+                if (inst.op == IROp::Const && inst.imm != 0) {
+                    nonzero[inst.dst] = true;
+                }
+            }
+        }
+
+        bool removed = true;
+        while (removed) {
+            removed = false;
+            for (auto &block : fun.blocks) {
+                std::vector<IRInst> insts;
+                for (auto &inst : block.insts) {
+                    if (inst.dst < 0 || uses[inst.dst] > 0
+                        || !removable(inst, nonzero)) {
+                        insts.push_back(std::move(inst));
+                        continue;
+                    }
+                    for_each_use(inst, [&](int reg) { uses[reg]--; });
+                    removed = true;
+                    changed = true;
+                }
+                block.insts = std::move(insts);
+            }
+        }
+    }
+
+public:
+    ValueNumberer(IRFunction &fun, const std::vector<FunctionEffects> &effects)
+        : fun(fun)
+        , effects(effects)
+    {
+    }
+
+    bool run()
+    {
+        construct_ssa(fun);
+        dom = compute_dominators(fun);
+        analyze();
+        number_blocks();
+        insert_copies();
+        remove_unused();
+        destruct_ssa(fun);
+        simplify_cfg(fun);
+        return changed;
+    }
+};
+
+bool
+number_values(IRFunction &fun, const std::vector<FunctionEffects> &effects)
+{
+    ValueNumberer numberer(fun, effects);
+    return numberer.run();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "effects.h"
+#include "ir.h"
+
+// Global value numbering over the dominator tree (Briggs, Cooper and
+// Simpson). In SSA form, an instruction computing what an instruction in a
+// dominating block (or earlier in its own) already has becomes a copy of
+// that result, and later reads take the result directly. Operators and
+// constants are compared by value: a + 1 is a + 1 whichever register holds
+// the 1, and commutative operands and > and >= are put in a standard order.
+//
+// Unary and binary operators are pure, even division, which cannot fail the
+// second time if it did not the first. A call is only matched with another
+// if `effects` shows the callee pure and reading no globals, so that its
+// result depends on nothing but its arguments. Instructions left computing
+// values nobody reads are deleted afterwards. Returns whether anything
+// changed.
+bool
+number_values(IRFunction &fun, const std::vector<FunctionEffects> &effects);
@@ -0,0 +1,219 @@
+#include "inline.h"
+
+#include <iterator>
+
+#include "liveness.h"
+
+static int
+function_size(const IRFunction &fun)
+{
+    int size = 0;
+    for (auto &block : fun.blocks) {
+        size += block.insts.size();
+    }
+    return size;
+}
+
+// Marks the blocks inside a loop.
+static std::vector<bool>
+loop_blocks(IRFunction &fun)
+{
+    std::vector<bool> in_loop(fun.blocks.size(), false);
+    for (auto &loop : find_loops(fun, compute_dominators(fun))) {
+        for (int b : loop.blocks) {
+            in_loop[b] = true;
+        }
+    }
+    return in_loop;
+}
+
+class Inliner {
+private:
+    IRFunction         &fun;
+    IRProgram          &library;
+    const InlineBudget &budget;
+
+    int growth = 0;
+
+    // Per function: -1 if not yet known, else whether it can call itself.
+    std::vector<int> recursive;
+
+    bool is_recursive(int fun_idx)
+    {
+        if (recursive[fun_idx] >= 0) {
+            return recursive[fun_idx];
+        }
+
+        std::vector<bool> seen(library.funs.size(), false);
+        std::vector<int>  work = { fun_idx };
+        bool              res  = false;
+        while (!work.empty() && !res) {
+            auto *callee = library.funs[work.back()].get();
+            work.pop_back();
+            if (callee == nullptr) {
+                continue;
+            }
+            for (auto &block : callee->blocks) {
+                for (auto &inst : block.insts) {
+                    if (inst.op != IROp::Call) {
+                        continue;
+                    }
+                    res = res || inst.imm == fun_idx;
+                    if (!seen[inst.imm]) {
+                        seen[inst.imm] = true;
+                        work.push_back(inst.imm);
+                    }
+                }
+            }
+        }
+
+        recursive[fun_idx] = res;
+        return res;
+    }
+
+    // Returns the callee's IR if a call to it fits the budget, or nullptr.
+    IRFunction *candidate(IRInst &call, bool hot)
+    {
+        auto *callee = library.funs[call.imm].get();
+        if (callee == nullptr || callee->osr || is_recursive(call.imm)) {
+            return nullptr;
+        }
+
+        int size  = function_size(*callee);
+        int limit = budget.callee_size * (hot ? HOT_CALL_FACTOR : 1);
+        if (size > limit || growth + size > budget.growth) {
+            return nullptr;
+        }
+        return callee;
+    }
+
+    void inline_call(int block_id, int index, IRFunction &callee)
+    {
+        IRInst call = std::move(fun.blocks[block_id].insts[index]);
+
+        // The code after the call moves to a block of its own, which the
+        // callee's returns jump to.
+        int   join  = fun.new_block();
+        auto &insts = fun.blocks[block_id].insts;
+        fun.blocks[join].insts.assign(
+            std::make_move_iterator(insts.begin() + index + 1),
+            std::make_move_iterator(insts.end()));
+        insts.erase(insts.begin() + index, insts.end());
+
+        std::vector<int> reg(callee.n_regs());
+        for (int r = 0; r < callee.n_regs(); r++) {
+            reg[r] = fun.new_reg(callee.reg_types[r]);
+        }
+        int base = fun.blocks.size();
+        for (unsigned int b = 0; b < callee.blocks.size(); b++) {
+            fun.new_block();
+        }
+
+        auto emit = [&](int block, IROp op, int dst, int a) {
+            IRInst inst;
+            inst.op  = op;
+            inst.dst = dst;
+            inst.a   = a;
+            inst.pos = call.pos;
+            fun.blocks[block].insts.push_back(std::move(inst));
+            return &fun.blocks[block].insts.back();
+        };
+
+        for (int p = 0; p < callee.n_params; p++) {
+            emit(block_id, IROp::Mov, reg[p], call.args[p]);
+        }
+        emit(block_id, IROp::Jmp, -1, -1)->target[0] = base;
+
+        for (auto &block : callee.blocks) {
+            int id = base + block.id;
+            for (auto inst : block.insts) {
+                if (inst.op == IROp::Ret) {
+                    if (call.dst >= 0 && inst.a >= 0) {
+                        emit(id, IROp::Mov, call.dst, reg[inst.a]);
+                    }
+                    emit(id, IROp::Jmp, -1, -1)->target[0] = join;
+                    continue;
+                }
+
+                for_each_use(inst, [&](int &r) { r = reg[r]; });
+                if (inst.dst >= 0) {
+                    inst.dst = reg[inst.dst];
+                }
+                for (int &target : inst.target) {
+                    if (target >= 0) {
+                        target += base;
+                    }
+                }
+                fun.blocks[id].insts.push_back(std::move(inst));
+            }
+        }
+
+        growth += function_size(callee);
+        compute_cfg(fun);
+    }
+
+public:
+    Inliner(IRFunction &fun, IRProgram &library, const InlineBudget &budget)
+        : fun(fun)
+        , library(library)
+        , budget(budget)
+        , recursive(library.funs.size(), -1)
+    {
+    }
+
+    bool run()
+    {
+        bool changed = false;
+
+        while (true) {
+            auto in_loop = loop_blocks(fun);
+
+            IRFunction *best       = nullptr;
+            int         best_block = -1;
+            int         best_index = -1;
+            int         best_size  = 0;
+            for (auto &block : fun.blocks) {
+                for (unsigned int i = 0; i < block.insts.size(); i++) {
+                    auto &inst = block.insts[i];
+                    if (inst.op != IROp::Call) {
+                        continue;
+                    }
+                    auto *callee = candidate(inst, in_loop[block.id]);
+                    if (callee == nullptr) {
+                        continue;
+                    }
+
+                    // Rank hot calls first, then small callees.
+                    int size = function_size(*callee);
+                    if (best == nullptr
+                        || (in_loop[block.id] && !in_loop[best_block])
+                        || (in_loop[block.id] == in_loop[best_block]
+                            && size < best_size)) {
+                        best       = callee;
+                        best_block = block.id;
+                        best_index = i;
+                        best_size  = size;
+                    }
+                }
+            }
+
+            if (best == nullptr) {
+                break;
+            }
+            inline_call(best_block, best_index, *best);
+            changed = true;
+        }
+
+        if (changed) {
+            simplify_cfg(fun);
+        }
+        return changed;
+    }
+};
+
+bool
+inline_calls(IRFunction &fun, IRProgram &library, const InlineBudget &budget)
+{
+    Inliner inliner(fun, library, budget);
+    return inliner.run();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ir.h"
+
+// How much inline_calls() may copy, in IR instructions. A callee is inlined
+// if it has at most `callee_size` instructions, or `callee_size` times
+// HOT_CALL_FACTOR for calls inside a loop, and the caller has not yet grown
+// by more than `growth` instructions.
+struct InlineBudget {
+    int callee_size = 20;
+    int growth      = 400;
+};
+
+constexpr int HOT_CALL_FACTOR = 4;
+
+// Replaces calls in `fun` with copies of the callee's IR from `library`
+// (indexed like IRProgram::funs): every callee register gets a fresh
+// register in `fun`, parameters are copied in from the arguments, and
+// returns become a copy to the call's result and a jump to the code after
+// the call. Calls made by an inlined body are considered in turn.
+//
+// Only functions that can never call themselves, directly or through other
+// functions, are inlined, so inlining stops by itself; on-stack replacement
+// entries are never inlined. Calls in loops are tried first, and among them
+// the smallest callees. Returns whether anything was inlined. `fun` is
+// expected out of SSA form, and is left that way with a clean CFG.
+bool
+inline_calls(IRFunction &fun, IRProgram &library, const InlineBudget &budget);
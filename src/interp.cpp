@@ -0,0 +1,231 @@
+#include "interp.h"
+
+#include <algorithm>
+
+#include "builtins.h"
+#include "error.h"
+
+// The value stack is sized so that it is never the limiting factor before the
+// call depth is.
+const size_t VALUE_STACK_SIZE = 1 << 20;
+
+Interpreter::Interpreter(Program &program)
+    : program(program)
+    , globals(program.n_globals, 0)
+    , stack(VALUE_STACK_SIZE, 0)
+{
+}
+
+Value &
+Interpreter::lookup(VarInfo &info)
+{
+    return info.fun_idx == 0 ? globals[info.frame_idx] : frame[info.frame_idx];
+}
+
+Value
+Interpreter::eval_call(FunInfo                               &info,
+                       std::vector<std::unique_ptr<ExpNode>> &args,
+                       SourcePos                              pos)
+{
+    // Evaluate arguments into the callee's frame, which starts right after the
+    // caller's.
+    auto   fun      = program.funs[info.var_idx_db];
+    size_t new_base = sp;
+    size_t new_size = fun != nullptr ? fun->frame_size : args.size();
+
+    if (new_base + new_size > stack.size() || depth >= MAX_CALL_DEPTH) {
+        throw AlbatrossError("Stack overflow", pos, EXIT_RUNTIME_FAILURE);
+    }
+
+    sp += new_size;
+    for (unsigned int i = 0; i < args.size(); i++) {
+        stack[new_base + i] = eval_exp(args[i].get());
+    }
+
+    if (fun == nullptr) {
+        Value arg = stack[new_base];
+        sp        = new_base;
+
+        switch (info.var_idx_db) {
+        case BuiltinPrintint: rt_printint(arg); break;
+        case BuiltinPrintstring: rt_printstring(arg); break;
+        case BuiltinExit:
+            rt_stats.instructions = n_steps;
+            rt_exit(arg);
+        default:
+            throw AlbatrossError("Unknown builtin " + std::to_string(info.var_idx_db),
+                                 pos,
+                                 EXIT_RUNTIME_FAILURE);
+        }
+        return 0;
+    }
+
+    Value *saved_frame = frame;
+    frame              = &stack[new_base];
+    depth++;
+
+    do {
+        ret_val = 0;
+    } while (exec_stmts(fun->body) == Flow::TailCall);
+
+    depth--;
+    frame = saved_frame;
+    sp    = new_base;
+
+    return ret_val;
+}
+
+Value
+Interpreter::eval_exp(ExpNode *exp)
+{
+    n_steps++;
+
+    switch (exp->kind) {
+    case ExpNode::IntExp: return static_cast<IntNode *>(exp)->ival;
+    case ExpNode::StringExp:
+        return str_value(
+            string_pool.get(static_cast<StrNode *>(exp)->str_idx));
+    case ExpNode::VarExp:
+        return lookup(static_cast<VarNode *>(exp)->var_info.value());
+    case ExpNode::BinopExp: {
+        auto node = static_cast<BinOpNode *>(exp);
+        int  lhs  = eval_exp(node->lhs.get());
+
+        // Logical operators short-circuit, so the rhs may never be evaluated.
+        if (node->op == Operator::And) {
+            return lhs ? eval_exp(node->rhs.get()) != 0 : 0;
+        } else if (node->op == Operator::Or) {
+            return lhs ? 1 : eval_exp(node->rhs.get()) != 0;
+        }
+
+        int rhs = eval_exp(node->rhs.get());
+        if ((node->op == Operator::Div || node->op == Operator::Rem)
+            && rhs == 0) {
+            throw AlbatrossError("Division by zero",
+                                 node->pos,
+                                 EXIT_RUNTIME_FAILURE);
+        }
+        return eval_binop(node->op, lhs, rhs);
+    }
+    case ExpNode::UnopExp: {
+        auto node = static_cast<UnOpNode *>(exp);
+        return eval_unop(node->op, eval_exp(node->e.get()));
+    }
+    case ExpNode::CallExp: {
+        auto node = static_cast<CallNode *>(exp);
+        return eval_call(node->fun_info.value(), node->args, node->pos);
+    }
+    }
+
+    return 0;
+}
+
+Interpreter::Flow
+Interpreter::exec_stmt(StmtNode *stmt)
+{
+    n_steps++;
+
+    switch (stmt->kind) {
+    case StmtNode::VardeclStmt: {
+        auto node                      = static_cast<VardeclNode *>(stmt);
+        lookup(node->var_info.value()) = eval_exp(node->rhs.get());
+        break;
+    }
+    case StmtNode::AssignStmt: {
+        auto node = static_cast<AssignNode *>(stmt);
+        auto lhs  = static_cast<VarNode *>(node->lhs.get());
+        lookup(lhs->var_info.value()) = eval_exp(node->rhs.get());
+        break;
+    }
+    case StmtNode::IfStmt: {
+        auto node = static_cast<IfNode *>(stmt);
+        return eval_exp(node->cond.get()) ? exec_stmts(node->then_stmts) :
+                                            exec_stmts(node->else_stmts);
+    }
+    case StmtNode::WhileStmt: {
+        // The otherwise block runs only if the body never does.
+        auto node = static_cast<WhileNode *>(stmt);
+        if (!eval_exp(node->cond.get())) {
+            return exec_stmts(node->otherwise_stmts);
+        }
+
+        do {
+            Flow flow = exec_stmts(node->body_stmts);
+            if (flow != Flow::Next) {
+                return flow;
+            }
+        } while (eval_exp(node->cond.get()));
+        break;
+    }
+    case StmtNode::RepeatStmt: {
+        // The count is evaluated once, before the first iteration.
+        auto node  = static_cast<RepeatNode *>(stmt);
+        int  count = eval_exp(node->cond.get());
+        for (int i = 0; i < count; i++) {
+            Flow flow = exec_stmts(node->body_stmts);
+            if (flow != Flow::Next) {
+                return flow;
+            }
+        }
+        break;
+    }
+    case StmtNode::CallStmt: {
+        auto node = static_cast<CallStmtNode *>(stmt);
+        eval_call(node->fun_info.value(), node->args, node->pos);
+        break;
+    }
+    case StmtNode::FundecStmt: break; // Functions are looked up by index
+    case StmtNode::RetStmt: {
+        auto node = static_cast<RetNode *>(stmt);
+        if (node->tail_call) {
+            // The arguments are evaluated above the frame, since they may
+            // read the parameters they are about to replace.
+            auto  &args = static_cast<CallNode *>(node->ret_exp->get())->args;
+            size_t base = sp;
+            if (base + args.size() > stack.size()) {
+                throw AlbatrossError("Stack overflow",
+                                     node->pos,
+                                     EXIT_RUNTIME_FAILURE);
+            }
+
+            sp += args.size();
+            for (unsigned int i = 0; i < args.size(); i++) {
+                stack[base + i] = eval_exp(args[i].get());
+            }
+            std::copy(&stack[base], &stack[base] + args.size(), frame);
+            sp = base;
+            return Flow::TailCall;
+        }
+
+        ret_val = node->ret_exp.has_value() ?
+                      eval_exp(node->ret_exp.value().get()) :
+                      0;
+        return Flow::Return;
+    }
+    }
+
+    return Flow::Next;
+}
+
+Interpreter::Flow
+Interpreter::exec_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    for (auto &stmt : stmts) {
+        Flow flow = exec_stmt(stmt.get());
+        if (flow != Flow::Next) {
+            return flow;
+        }
+    }
+
+    return Flow::Next;
+}
+
+int
+Interpreter::run()
+{
+    Flow flow             = exec_stmts(program.stmts);
+    rt_stats.instructions = n_steps;
+
+    // Falling off the end of the program is the same as returning 0.
+    return flow == Flow::Return ? ret_val : 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+#include "program.h"
+#include "runtime.h"
+
+// A tree-walking interpreter over the resolved, typechecked AST. Variables are
+// addressed by VarInfo::frame_idx within the frame of the function that
+// declared them; top-level variables live in the global frame.
+//
+// This is the reference engine: it is the simplest thing that runs every
+// program, and its instructions/s figure (one instruction per evaluated AST
+// node) is the baseline the other engines are measured against.
+class Interpreter {
+private:
+    // Statements report whether execution should fall through to the next
+    // statement, unwind to the caller because of a return, or unwind to the
+    // start of the function for a self tail call, whose arguments have
+    // already replaced the parameters.
+    enum class Flow { Next, Return, TailCall };
+
+    Program &program;
+
+    std::vector<Value> globals;
+
+    // Frames are windows into one preallocated value stack, so calls do not
+    // allocate.
+    std::vector<Value> stack;
+    size_t             sp    = 0;
+    Value             *frame = nullptr;
+    int                depth = 0;
+
+    Value    ret_val = 0;
+    uint64_t n_steps = 0;
+
+    Value &lookup(VarInfo &info);
+
+    Value eval_exp(ExpNode *exp);
+    Value eval_call(FunInfo                               &info,
+                    std::vector<std::unique_ptr<ExpNode>> &args,
+                    SourcePos                              pos);
+
+    Flow exec_stmt(StmtNode *stmt);
+    Flow exec_stmts(std::list<std::unique_ptr<StmtNode>> &stmts);
+
+public:
+    Interpreter(Program &program);
+
+    // Runs the top-level statements and returns the program's exit code.
+    int run();
+};
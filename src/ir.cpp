@@ -0,0 +1,441 @@
+#include "ir.h"
+
+#include <algorithm>
+
+void
+compute_cfg(IRFunction &fun)
+{
+    for (auto &block : fun.blocks) {
+        block.succs.clear();
+        block.preds.clear();
+    }
+
+    for (auto &block : fun.blocks) {
+        auto &term = block.terminator();
+        switch (term.op) {
+        case IROp::Jmp: block.succs = { term.target[0] }; break;
+        case IROp::Br:
+            block.succs = { term.target[0] };
+            if (term.target[1] != term.target[0]) {
+                block.succs.push_back(term.target[1]);
+            }
+            break;
+        default: break;
+        }
+
+        for (int succ : block.succs) {
+            fun.blocks[succ].preds.push_back(block.id);
+        }
+    }
+}
+
+static void
+postorder(IRFunction       &fun,
+          int               id,
+          std::vector<bool> &visited,
+          std::vector<int>  &order)
+{
+    // Iterative DFS; generated programs can nest deeply enough that recursion
+    // over blocks is a liability.
+    std::vector<std::pair<int, unsigned int>> stack = { { id, 0 } };
+    visited[id]                                    = true;
+
+    while (!stack.empty()) {
+        auto &[cur, next] = stack.back();
+        auto &succs       = fun.blocks[cur].succs;
+
+        if (next < succs.size()) {
+            int succ = succs[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back({ succ, 0 });
+            }
+        } else {
+            order.push_back(cur);
+            stack.pop_back();
+        }
+    }
+}
+
+std::vector<int>
+reverse_postorder(IRFunction &fun)
+{
+    std::vector<bool> visited(fun.blocks.size(), false);
+    std::vector<int>  order;
+
+    postorder(fun, 0, visited, order);
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+Dominators
+compute_dominators(IRFunction &fun)
+{
+    // The iterative algorithm of Cooper, Harvey and Kennedy, "A Simple, Fast
+    // Dominance Algorithm".
+    int              n_blocks = fun.blocks.size();
+    auto             rpo      = reverse_postorder(fun);
+    std::vector<int> rpo_idx(n_blocks, -1);
+    for (unsigned int i = 0; i < rpo.size(); i++) {
+        rpo_idx[rpo[i]] = i;
+    }
+
+    Dominators res;
+    res.idom.assign(n_blocks, -1);
+    res.idom[0] = 0;
+
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (rpo_idx[a] > rpo_idx[b]) {
+                a = res.idom[a];
+            }
+            while (rpo_idx[b] > rpo_idx[a]) {
+                b = res.idom[b];
+            }
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int id : rpo) {
+            if (id == 0) {
+                continue;
+            }
+
+            int idom = -1;
+            for (int pred : fun.blocks[id].preds) {
+                if (res.idom[pred] >= 0) {
+                    idom = idom < 0 ? pred : intersect(pred, idom);
+                }
+            }
+            if (idom != res.idom[id]) {
+                res.idom[id] = idom;
+                changed      = true;
+            }
+        }
+    }
+
+    res.children.resize(n_blocks);
+    for (int id : rpo) {
+        if (id != 0) {
+            res.children[res.idom[id]].push_back(id);
+        }
+    }
+
+    res.enter.assign(n_blocks, -1);
+    res.leave.assign(n_blocks, -1);
+    int                               time  = 0;
+    std::vector<std::pair<int, bool>> stack = { { 0, false } };
+    while (!stack.empty()) {
+        auto [id, done] = stack.back();
+        stack.pop_back();
+        if (done) {
+            res.leave[id] = time++;
+            continue;
+        }
+        res.enter[id] = time++;
+        stack.push_back({ id, true });
+        for (int child : res.children[id]) {
+            stack.push_back({ child, false });
+        }
+    }
+    return res;
+}
+
+std::vector<Loop>
+find_loops(IRFunction &fun, const Dominators &dom)
+{
+    int                           n_blocks = fun.blocks.size();
+    std::vector<Loop>             loops;
+    std::vector<int>              loop_of(n_blocks, -1);
+    std::vector<std::vector<int>> back_edges;
+
+    for (auto &block : fun.blocks) {
+        for (int header : block.succs) {
+            if (!dom.dominates(header, block.id)) {
+                continue;
+            }
+            if (loop_of[header] < 0) {
+                loop_of[header] = loops.size();
+                loops.push_back(Loop{ header, { header }, -1 });
+                back_edges.emplace_back();
+            }
+            back_edges[loop_of[header]].push_back(block.id);
+        }
+    }
+
+    // Each loop is collected in one go, marking its blocks with its index.
+    std::vector<int> mark(n_blocks, -1);
+    for (unsigned int l = 0; l < loops.size(); l++) {
+        auto            &loop = loops[l];
+        mark[loop.header]     = l;
+        std::vector<int> work = back_edges[l];
+        std::reverse(work.begin(), work.end());
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            if (mark[b] == (int)l) {
+                continue;
+            }
+            mark[b] = l;
+            loop.blocks.push_back(b);
+            for (int pred : fun.blocks[b].preds) {
+                work.push_back(pred);
+            }
+        }
+    }
+
+    // An enclosing loop has more blocks than any loop inside it.
+    std::stable_sort(loops.begin(), loops.end(), [](auto &a, auto &b) {
+        return a.blocks.size() < b.blocks.size();
+    });
+
+    // So the first loop after a loop to contain its header encloses it
+    // directly.
+    for (unsigned int l = 0; l < loops.size(); l++) {
+        loop_of[loops[l].header] = l;
+    }
+    for (unsigned int l = 0; l < loops.size(); l++) {
+        for (int b : loops[l].blocks) {
+            int inner = loop_of[b];
+            if (inner >= 0 && inner != (int)l && loops[inner].parent < 0) {
+                loops[inner].parent = l;
+            }
+        }
+    }
+    return loops;
+}
+
+void
+remove_unreachable_blocks(IRFunction &fun)
+{
+    compute_cfg(fun);
+
+    std::vector<bool> visited(fun.blocks.size(), false);
+    std::vector<int>  order;
+    postorder(fun, 0, visited, order);
+
+    // Assign new ids in the original order so the entry block stays first.
+    std::vector<int> new_id(fun.blocks.size(), -1);
+    int              n_live = 0;
+    for (unsigned int i = 0; i < fun.blocks.size(); i++) {
+        if (visited[i]) {
+            new_id[i] = n_live++;
+        }
+    }
+
+    std::vector<BasicBlock> blocks;
+    blocks.reserve(n_live);
+    for (auto &block : fun.blocks) {
+        if (new_id[block.id] < 0) {
+            continue;
+        }
+
+        auto &term = block.terminator();
+        for (int &target : term.target) {
+            if (target >= 0) {
+                target = new_id[target];
+            }
+        }
+
+        block.id = new_id[block.id];
+        blocks.push_back(std::move(block));
+    }
+
+    fun.blocks = std::move(blocks);
+    compute_cfg(fun);
+}
+
+// Follows a chain of blocks that only jump elsewhere to its final target.
+static int
+forward_target(IRFunction &fun, int target)
+{
+    // Bound the walk so that an empty infinite loop terminates.
+    for (unsigned int i = 0; i < fun.blocks.size(); i++) {
+        auto &block = fun.blocks[target];
+        if (block.insts.size() != 1 || block.insts[0].op != IROp::Jmp
+            || block.insts[0].target[0] == target) {
+            break;
+        }
+        target = block.insts[0].target[0];
+    }
+    return target;
+}
+
+void
+simplify_cfg(IRFunction &fun)
+{
+    for (auto &block : fun.blocks) {
+        auto &term = block.terminator();
+        for (int &target : term.target) {
+            if (target >= 0) {
+                target = forward_target(fun, target);
+            }
+        }
+
+        if (term.op == IROp::Br && term.target[0] == term.target[1]) {
+            term.op = IROp::Jmp;
+            term.a  = -1;
+        }
+    }
+
+    remove_unreachable_blocks(fun);
+
+    // Merge blocks into their predecessor when the two are always executed
+    // together. Merged blocks are left empty and unreachable.
+    for (auto &block : fun.blocks) {
+        while (block.terminator().op == IROp::Jmp) {
+            int   succ_id = block.terminator().target[0];
+            auto &succ    = fun.blocks[succ_id];
+            if (succ_id == block.id || succ_id == 0 || succ.preds.size() != 1) {
+                break;
+            }
+
+            block.insts.pop_back();
+            for (auto &inst : succ.insts) {
+                block.insts.push_back(std::move(inst));
+            }
+            IRInst self_loop;
+            self_loop.op        = IROp::Jmp;
+            self_loop.target[0] = succ_id;
+            succ.insts          = { self_loop };
+            succ.preds.clear();
+
+            // The successors of the merged block now have this block as
+            // their predecessor.
+            for (int next : block.terminator().target) {
+                if (next < 0) {
+                    continue;
+                }
+                for (int &pred : fun.blocks[next].preds) {
+                    if (pred == succ_id) {
+                        pred = block.id;
+                    }
+                }
+            }
+        }
+    }
+
+    remove_unreachable_blocks(fun);
+}
+
+static std::string
+reg_str(int reg)
+{
+    return "r" + std::to_string(reg);
+}
+
+static std::string
+escape_str(std::string_view s)
+{
+    std::string res;
+    for (char c : s) {
+        switch (c) {
+        case '\n': res += "\\n"; break;
+        case '\t': res += "\\t"; break;
+        case '\\': res += "\\\\"; break;
+        case '"': res += "\\\""; break;
+        default: res += c;
+        }
+    }
+    return res;
+}
+
+static void
+print_inst(IRInst &inst, std::ostream &out)
+{
+    out << "    ";
+    if (inst.dst >= 0) {
+        out << reg_str(inst.dst) << " = ";
+    }
+
+    switch (inst.op) {
+    case IROp::Const: out << inst.imm; break;
+    case IROp::ConstStr:
+        out << "\"" << escape_str(string_pool.get(inst.imm)->view()) << "\"";
+        break;
+    case IROp::Mov: out << reg_str(inst.a); break;
+    case IROp::BinOp:
+        out << reg_str(inst.a) << " " << op_str(inst.binop) << " "
+            << reg_str(inst.b);
+        if (inst.binop == Operator::Div || inst.binop == Operator::Rem) {
+            out << (inst.check_zero ? "" : " nonzero")
+                << (inst.check_overflow ? "" : " nowrap");
+        }
+        break;
+    case IROp::UnOp: out << op_str(inst.binop) << reg_str(inst.a); break;
+    case IROp::LoadGlobal: out << "load g" << inst.imm; break;
+    case IROp::StoreGlobal:
+        out << "store g" << inst.imm << ", " << reg_str(inst.a);
+        break;
+    case IROp::Call: {
+        out << "call f" << inst.imm << "(";
+        for (unsigned int i = 0; i < inst.args.size(); i++) {
+            out << (i > 0 ? ", " : "") << reg_str(inst.args[i]);
+        }
+        out << ")";
+        break;
+    }
+    case IROp::Phi: {
+        out << "phi(";
+        for (unsigned int i = 0; i < inst.args.size(); i++) {
+            out << (i > 0 ? ", " : "") << reg_str(inst.args[i]);
+        }
+        out << ")";
+        break;
+    }
+    case IROp::Jmp: out << "jmp L" << inst.target[0]; break;
+    case IROp::Br:
+        out << "br " << reg_str(inst.a) << ", L" << inst.target[0] << ", L"
+            << inst.target[1];
+        break;
+    case IROp::Ret:
+        out << "ret";
+        if (inst.a >= 0) {
+            out << " " << reg_str(inst.a);
+        }
+        break;
+    }
+
+    out << "\n";
+}
+
+void
+print_ir(IRFunction &fun, std::ostream &out)
+{
+    out << "fun f" << fun.fun_idx << " " << fun.name << "(";
+    for (int i = 0; i < fun.n_params; i++) {
+        out << (i > 0 ? ", " : "") << reg_str(i) << " "
+            << type_to_str(fun.reg_types[i]);
+    }
+    out << ") " << type_to_str(fun.ret_type) << "\n";
+
+    for (auto &block : fun.blocks) {
+        out << "L" << block.id << ":";
+        if (!block.preds.empty()) {
+            out << "  ; preds";
+            for (int pred : block.preds) {
+                out << " L" << pred;
+            }
+        }
+        out << "\n";
+
+        for (auto &inst : block.insts) {
+            print_inst(inst, out);
+        }
+    }
+}
+
+void
+print_ir(IRProgram &program, std::ostream &out)
+{
+    out << "globals " << program.n_globals << "\n";
+    for (auto &fun : program.funs) {
+        if (fun) {
+            out << "\n";
+            print_ir(*fun, out);
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+// A linear, three-address IR organized into basic blocks.
+//
+// Following the design in frame.h, every function has an unbounded set of
+// virtual registers. A function's parameters and locals are pinned to the
+// registers matching their frame slots (r0 is the first parameter, and so on);
+// temporaries are numbered after them. Globals are not registers: they live in
+// memory and are accessed with explicit loads and stores.
+//
+// Registers may be assigned more than once; the IR is only in SSA form while
+// optimization passes that need it run (see ssa.h).
+
+enum class IROp : unsigned char {
+    Const,       // dst = imm
+    ConstStr,    // dst = string_pool[imm]
+    Mov,         // dst = a
+    BinOp,       // dst = a <op> b
+    UnOp,        // dst = <op> a
+    LoadGlobal,  // dst = global[imm]
+    StoreGlobal, // global[imm] = a
+    Call,        // dst = fun[imm](args...); dst is -1 for void calls
+    Phi,         // dst = args[i] when entered from preds[i]; SSA form only
+
+    // Terminators. Every block ends in exactly one of these.
+    Jmp, // goto target[0]
+    Br,  // if a goto target[0] else goto target[1]
+    Ret, // return a; a is -1 if there is no value
+};
+
+struct IRInst {
+    IROp     op;
+    Operator binop = Operator::Invalid;
+
+    int dst = -1;
+    int a   = -1;
+    int b   = -1;
+
+    int64_t          imm = 0;
+    std::vector<int> args;
+    int              target[2] = { -1, -1 };
+
+    // For Div and Rem: whether the divisor may be 0, and whether this may be
+    // INT_MIN / -1, which wraps. Cleared where narrow_ranges() proves
+    // otherwise, so that no check is made.
+    bool check_zero     = true;
+    bool check_overflow = true;
+
+    // Source position, for runtime errors raised by this instruction.
+    SourcePos pos = -1;
+
+    bool is_terminator() const
+    {
+        return op == IROp::Jmp || op == IROp::Br || op == IROp::Ret;
+    }
+};
+
+struct BasicBlock {
+    int                 id;
+    std::vector<IRInst> insts;
+
+    // Control flow edges, filled in by compute_cfg().
+    std::vector<int> succs;
+    std::vector<int> preds;
+
+    IRInst &terminator()
+    {
+        return insts.back();
+    }
+};
+
+struct IRFunction {
+    std::string name;
+
+    // FunInfo::var_idx_db of the function; 0 for the top-level statements.
+    int  fun_idx  = 0;
+    int  n_params = 0;
+    Type ret_type = Type::Void;
+
+    // Set for on-stack replacement entries (see lower_function()), which
+    // resume a running activation and so cannot be called recursively.
+    bool osr = false;
+
+    // Type of every virtual register, indexed by register number.
+    std::vector<Type> reg_types;
+
+    // In SSA form, the register each register is a version of. Registers
+    // created after construct_ssa() have no entry and stand for themselves.
+    std::vector<int> ssa_origin;
+
+    // blocks[0] is the entry block.
+    std::vector<BasicBlock> blocks;
+
+    int new_reg(Type type)
+    {
+        reg_types.push_back(type);
+        return reg_types.size() - 1;
+    }
+
+    int new_block()
+    {
+        blocks.push_back(BasicBlock{ (int)blocks.size(), {}, {}, {} });
+        return blocks.size() - 1;
+    }
+
+    int n_regs() const
+    {
+        return reg_types.size();
+    }
+};
+
+struct IRProgram {
+    // Indexed by FunInfo::var_idx_db. Slot 0 holds the top-level statements;
+    // builtins have no IR and map to nullptr.
+    std::vector<std::unique_ptr<IRFunction>> funs;
+    int                                      n_globals = 0;
+};
+
+// Recomputes the predecessor and successor lists of every block from the
+// block terminators.
+void
+compute_cfg(IRFunction &fun);
+
+// Removes blocks that cannot be reached from the entry block, renumbers the
+// remaining blocks densely and recomputes the CFG.
+void
+remove_unreachable_blocks(IRFunction &fun);
+
+// Straightens the CFG: threads jumps through blocks that contain nothing but a
+// jump, merges blocks into their only predecessor and drops unreachable blocks.
+void
+simplify_cfg(IRFunction &fun);
+
+// Returns block ids in reverse postorder, starting at the entry block.
+std::vector<int>
+reverse_postorder(IRFunction &fun);
+
+// The dominator tree. idom[b] is the immediate dominator of block b, with the
+// entry block as its own and -1 for unreachable blocks.
+struct Dominators {
+    std::vector<int>              idom;
+    std::vector<std::vector<int>> children;
+
+    // When a walk of the tree enters and leaves each block, -1 for
+    // unreachable blocks. A block dominates exactly the blocks entered
+    // while it is being walked.
+    std::vector<int> enter;
+    std::vector<int> leave;
+
+    bool dominates(int a, int b) const
+    {
+        return a == b
+               || (enter[a] >= 0 && enter[b] >= 0 && enter[a] < enter[b]
+                   && leave[b] < leave[a]);
+    }
+};
+
+Dominators
+compute_dominators(IRFunction &fun);
+
+// A natural loop: the header and every block that reaches a back edge to it
+// (an edge from a block the header dominates) without passing through the
+// header. All back edges to the same header make one loop.
+struct Loop {
+    int              header;
+    std::vector<int> blocks;
+    int              parent; // the innermost loop enclosing it, or -1
+};
+
+// Returns the loops of a function, innermost first: a loop comes before any
+// loop enclosing it. Takes time in proportion to the total size of the
+// loops.
+std::vector<Loop>
+find_loops(IRFunction &fun, const Dominators &dom);
+
+void
+print_ir(IRFunction &fun, std::ostream &out);
+
+void
+print_ir(IRProgram &program, std::ostream &out);
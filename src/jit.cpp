@@ -0,0 +1,1144 @@
+#include "jit.h"
+
+#include <bit>
+#include <climits>
+
+#include "builtins.h"
+#include "liveness.h"
+#include "lower_ir.h"
+#include "regalloc.h"
+
+// Reserve for all generated code; only the pages in use are ever committed.
+const size_t CODE_ARENA_SIZE = 1 << 30;
+
+// Extra stack on top of MAX_CALL_DEPTH generated frames, for the runtime
+// functions generated code calls into.
+const size_t RUNTIME_STACK_RESERVE = 8 << 20;
+
+// Frame size that functions recompiled while running are allowed, when that
+// is more than the largest frame compiled up front.
+const size_t TIER_FRAME_BUDGET = 16 << 10;
+
+const char *const DIVISION_BY_ZERO = "Division by zero";
+const char *const STACK_OVERFLOW   = "Stack overflow";
+
+void
+emit_call_runtime(Assembler &as, const void *fn)
+{
+    as.mov(RAX, (int64_t)fn);
+    as.call(RAX);
+}
+
+Label &
+ErrorStubs::add(const char *msg, SourcePos pos)
+{
+    stubs.push_back(std::make_unique<Stub>());
+    auto &stub = *stubs.back();
+    stub.msg   = msg;
+    stub.pos   = pos;
+    return stub.label;
+}
+
+void
+ErrorStubs::emit(Assembler &as)
+{
+    for (auto &stub : stubs) {
+        // Errors can be raised with arguments pushed, so realign the stack
+        // for the call; rt_error never returns.
+        as.bind(stub->label);
+        as.alu(AluAnd, RSP, -16, true);
+        as.mov(RDI, (int64_t)stub->msg);
+        as.mov(RSI, stub->pos);
+        emit_call_runtime(as, (void *)rt_error);
+    }
+}
+
+static Cond
+compare_cond(Operator op)
+{
+    switch (op) {
+    case Operator::Eq: return CondE;
+    case Operator::Ne: return CondNE;
+    case Operator::Lt: return CondL;
+    case Operator::Le: return CondLE;
+    case Operator::Gt: return CondG;
+    case Operator::Ge: return CondGE;
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+static bool
+is_compare(Operator op)
+{
+    switch (op) {
+    case Operator::Eq:
+    case Operator::Ne:
+    case Operator::Lt:
+    case Operator::Le:
+    case Operator::Gt:
+    case Operator::Ge: return true;
+    default: return false;
+    }
+}
+
+static bool
+is_commutative(Operator op)
+{
+    switch (op) {
+    case Operator::Add:
+    case Operator::Mul:
+    case Operator::Band:
+    case Operator::Bor:
+    case Operator::Xor:
+    case Operator::Eq:
+    case Operator::Ne: return true;
+    default: return false;
+    }
+}
+
+static int64_t
+align16(int64_t n)
+{
+    return (n + 15) & ~15;
+}
+
+class X86Compiler {
+private:
+    IRFunction &fun;
+    Assembler   as;
+    void      **fun_table;
+
+    // Registers with a single definition that loads a constant are never
+    // materialized; their uses take the constant as an immediate instead.
+    std::vector<bool>    is_const;
+    std::vector<int64_t> const_val;
+    std::vector<int>     n_uses;
+
+    RegAllocation alloc;
+
+    // Frame offsets of the stack slots of registers that have one, and of
+    // the saved callee-saved registers.
+    std::vector<int> slot_offset;
+    std::vector<int> saved_offset;
+    int              frame_size = 0;
+
+    // The instruction being compiled reads its operands at position `pos`
+    // and writes its result at `pos + 1` (see regalloc.h).
+    int cur_block = 0;
+    int pos       = 0;
+
+    Label              entry;
+    std::vector<Label> block_labels;
+
+    // Branches that need reloads on the way to their target go through
+    // these, emitted after the body.
+    struct EdgeStub {
+        Label label;
+        int   pred;
+        int   succ;
+    };
+    std::vector<std::unique_ptr<EdgeStub>> edge_stubs;
+
+    ErrorStubs error_stubs;
+
+    // Where a register's value is when an instruction reads it.
+    struct Operand {
+        enum { Imm, Register, Memory } kind = Imm;
+        int64_t imm                         = 0;
+        Reg     reg                         = RAX;
+        Mem     mem                         = Mem{ RBP, 0 };
+    };
+
+    // A move into a register, as part of a set of moves that all read their
+    // sources before any of them writes.
+    struct Move {
+        Reg     dst;
+        Operand src;
+        bool    wide;
+    };
+
+    bool is_str(int reg)
+    {
+        return fun.reg_types[reg] == Type::String;
+    }
+
+    Mem slot(int reg)
+    {
+        return Mem{ RBP, slot_offset[reg] };
+    }
+
+    Operand operand(int reg)
+    {
+        Operand op;
+        if (is_const[reg]) {
+            op.kind = Operand::Imm;
+            op.imm  = const_val[reg];
+        } else if (alloc.in_reg(reg, pos)) {
+            op.kind = Operand::Register;
+            op.reg  = (Reg)alloc.regs[reg].reg;
+        } else {
+            op.kind = Operand::Memory;
+            op.mem  = slot(reg);
+        }
+        return op;
+    }
+
+    void load(Reg dst, Operand src, bool wide)
+    {
+        switch (src.kind) {
+        case Operand::Imm: as.mov(dst, src.imm); break;
+        case Operand::Register:
+            if (src.reg != dst) {
+                as.mov(dst, src.reg);
+            }
+            break;
+        case Operand::Memory: as.mov(dst, src.mem, wide); break;
+        }
+    }
+
+    void load(Reg dst, int reg)
+    {
+        load(dst, operand(reg), is_str(reg));
+    }
+
+    // The register to compute a value for `reg` in: its own if it has one
+    // once the instruction is done, RAX otherwise.
+    Reg dst_reg(int reg)
+    {
+        if (alloc.in_reg(reg, pos + 1)) {
+            return (Reg)alloc.regs[reg].reg;
+        }
+        return RAX;
+    }
+
+    // Writes the result of the current instruction, computed in `src`, to
+    // the register's home: its physical register, its stack slot or both.
+    void store(int reg, Reg src)
+    {
+        if (alloc.in_reg(reg, pos + 1) && alloc.regs[reg].reg != src) {
+            as.mov((Reg)alloc.regs[reg].reg, src);
+        }
+        if (alloc.regs[reg].in_slot) {
+            as.mov(slot(reg), src, is_str(reg));
+        }
+    }
+
+    void emit_alu(AluOp op, Reg dst, Operand &src)
+    {
+        switch (src.kind) {
+        case Operand::Imm: as.alu(op, dst, (int32_t)src.imm); break;
+        case Operand::Register: as.alu(op, dst, src.reg); break;
+        case Operand::Memory: as.alu(op, dst, src.mem); break;
+        }
+    }
+
+    // Sets the flags for `x != 0`.
+    void emit_test(Operand x)
+    {
+        switch (x.kind) {
+        case Operand::Imm:
+            as.mov(RAX, x.imm);
+            as.test(RAX, RAX);
+            break;
+        case Operand::Register: as.test(x.reg, x.reg); break;
+        case Operand::Memory: as.alu(AluCmp, x.mem, 0); break;
+        }
+    }
+
+    void emit_moves(std::vector<Move> moves)
+    {
+        // Register-to-register moves go first, each one as soon as no other
+        // move still has to read its destination. What is left then are
+        // cycles, which are broken by copying one register to RAX. Loads from
+        // memory and immediates overwrite no source and come last.
+        std::vector<Move> reg_moves;
+        for (auto &m : moves) {
+            if (m.src.kind == Operand::Register && m.src.reg != m.dst) {
+                reg_moves.push_back(m);
+            }
+        }
+
+        while (!reg_moves.empty()) {
+            bool progress = false;
+            for (unsigned int i = 0; i < reg_moves.size() && !progress; i++) {
+                bool read_later = false;
+                for (auto &other : reg_moves) {
+                    read_later |= other.src.reg == reg_moves[i].dst;
+                }
+                if (!read_later) {
+                    as.mov(reg_moves[i].dst, reg_moves[i].src.reg);
+                    reg_moves.erase(reg_moves.begin() + i);
+                    progress = true;
+                }
+            }
+
+            if (!progress) {
+                Reg r = reg_moves[0].dst;
+                as.mov(RAX, r);
+                for (auto &m : reg_moves) {
+                    if (m.src.reg == r) {
+                        m.src.reg = RAX;
+                    }
+                }
+            }
+        }
+
+        for (auto &m : moves) {
+            if (m.src.kind != Operand::Register) {
+                load(m.dst, m.src, m.wide);
+            }
+        }
+    }
+
+    Label &error_stub(const char *msg, IRInst &inst)
+    {
+        return error_stubs.add(msg, inst.pos);
+    }
+
+    void call_runtime(const void *fn)
+    {
+        emit_call_runtime(as, fn);
+    }
+
+    void analyze()
+    {
+        int              n_regs = fun.n_regs();
+        std::vector<int> n_defs(n_regs, 0);
+
+        is_const.assign(n_regs, false);
+        const_val.assign(n_regs, 0);
+        n_uses.assign(n_regs, 0);
+
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                for_each_use(inst, [&](int reg) { n_uses[reg]++; });
+                if (inst.dst >= 0) {
+                    n_defs[inst.dst]++;
+                    if (inst.op == IROp::Const) {
+                        const_val[inst.dst] = inst.imm;
+                    }
+                }
+            }
+        }
+
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.op == IROp::Const && n_defs[inst.dst] == 1
+                    && inst.dst >= fun.n_params) {
+                    is_const[inst.dst] = true;
+                }
+            }
+        }
+    }
+
+    void layout_frame()
+    {
+        int n_slots = 0;
+
+        saved_offset.clear();
+        for (unsigned int i = 0; i < alloc.callee_saved.size(); i++) {
+            saved_offset.push_back(-8 * ++n_slots);
+        }
+
+        // Parameters passed on the stack stay where the caller put them.
+        slot_offset.assign(fun.n_regs(), 0);
+        for (int r = 0; r < fun.n_regs(); r++) {
+            if (r < fun.n_params && r >= N_ARG_REGS) {
+                slot_offset[r] = 16 + 8 * (r - N_ARG_REGS);
+            } else if (alloc.regs[r].in_slot) {
+                slot_offset[r] = -8 * ++n_slots;
+            }
+        }
+
+        frame_size = align16(8 * n_slots);
+    }
+
+    void emit_prologue()
+    {
+        as.bind(entry);
+        as.push(RBP);
+        as.mov(RBP, RSP);
+        if (frame_size > 0) {
+            as.alu(AluSub, RSP, frame_size, true);
+        }
+        for (unsigned int i = 0; i < alloc.callee_saved.size(); i++) {
+            as.mov(Mem{ RBP, saved_offset[i] }, alloc.callee_saved[i]);
+        }
+
+        // Parameters passed in registers are stored to their slots, if they
+        // have one, before all parameters move to their registers at once.
+        std::vector<Move> moves;
+        for (int p = 0; p < fun.n_params; p++) {
+            auto &a = alloc.regs[p];
+            if (!alloc.liveness.is_live_in(0, p)) {
+                continue;
+            }
+
+            Operand src;
+            if (p < N_ARG_REGS) {
+                src.kind = Operand::Register;
+                src.reg  = ARG_REGS[p];
+                if (a.in_slot) {
+                    as.mov(slot(p), ARG_REGS[p]);
+                }
+            } else {
+                src.kind = Operand::Memory;
+                src.mem  = slot(p);
+            }
+            if (alloc.in_reg(p, 0)) {
+                moves.push_back(Move{ (Reg)a.reg, src, is_str(p) });
+            }
+        }
+        emit_moves(moves);
+    }
+
+    void emit_epilogue()
+    {
+        for (unsigned int i = 0; i < alloc.callee_saved.size(); i++) {
+            as.mov(alloc.callee_saved[i], Mem{ RBP, saved_offset[i] });
+        }
+        as.mov(RSP, RBP);
+        as.pop(RBP);
+        as.ret();
+    }
+
+    int block_end(int block)
+    {
+        return alloc.block_start[block] + 2 * fun.blocks[block].insts.size()
+               - 1;
+    }
+
+    // Reloads the registers that are in memory at the end of `pred` but
+    // expected in a register at the start of `succ`. Returns whether there
+    // are any, without emitting anything if `emit` is false.
+    bool emit_reloads(int pred, int succ, bool emit = true)
+    {
+        int  end    = block_end(pred);
+        int  start  = alloc.block_start[succ];
+        bool reload = false;
+
+        for (int r : alloc.liveness.live_in[succ]) {
+            if (alloc.in_reg(r, start) && !alloc.in_reg(r, end)) {
+                reload = true;
+                if (emit) {
+                    as.mov((Reg)alloc.regs[r].reg, slot(r), is_str(r));
+                }
+            }
+        }
+        return reload;
+    }
+
+    // The label for a conditional branch from the current block to `succ`.
+    Label &edge_label(int succ)
+    {
+        if (!emit_reloads(cur_block, succ, false)) {
+            return block_labels[succ];
+        }
+
+        edge_stubs.push_back(std::make_unique<EdgeStub>());
+        auto &stub = *edge_stubs.back();
+        stub.pred  = cur_block;
+        stub.succ  = succ;
+        return stub.label;
+    }
+
+    // Emits `cmp a, b` for an int comparison and returns the condition that
+    // holds when the comparison is true.
+    Cond emit_compare(IRInst &inst)
+    {
+        Cond    cond = compare_cond(inst.binop);
+        Operand x    = operand(inst.a);
+        Operand y    = operand(inst.b);
+
+        if (x.kind == Operand::Imm && y.kind != Operand::Imm) {
+            std::swap(x, y);
+            cond = swap_operands(cond);
+        }
+        if (x.kind == Operand::Imm
+            || (x.kind == Operand::Memory && y.kind == Operand::Memory)) {
+            load(RAX, x, false);
+            x.kind = Operand::Register;
+            x.reg  = RAX;
+        }
+
+        if (x.kind == Operand::Register) {
+            emit_alu(AluCmp, x.reg, y);
+        } else if (y.kind == Operand::Register) {
+            as.alu(AluCmp, x.mem, y.reg);
+        } else {
+            as.alu(AluCmp, x.mem, (int32_t)y.imm);
+        }
+        return cond;
+    }
+
+    // Division by a constant needs no checks and, unless the divisor is
+    // INT_MIN, no idiv: powers of two shift, and anything else multiplies by
+    // a fixed-point reciprocal.
+    void compile_div_const(IRInst &inst, int d)
+    {
+        bool is_div = inst.binop == Operator::Div;
+
+        if (d == 0) {
+            as.jmp(error_stub(DIVISION_BY_ZERO, inst));
+            return;
+        }
+
+        load(R11, inst.a);
+        if (d == 1 || d == -1) {
+            as.mov(RAX, R11, false);
+            if (!is_div) {
+                as.alu(AluXor, RAX, RAX);
+            } else if (d == -1) {
+                as.neg(RAX);
+            }
+            store(inst.dst, RAX);
+            return;
+        }
+        if (d == INT_MIN) {
+            as.mov(RAX, R11, false);
+            as.mov(R11, d);
+            as.cdq();
+            as.idiv(R11);
+            store(inst.dst, is_div ? RAX : RDX);
+            return;
+        }
+
+        // Divide by |d|, rounding toward zero, then fix the sign.
+        uint32_t ad = d < 0 ? 0u - (uint32_t)d : d;
+        if ((ad & (ad - 1)) == 0) {
+            // An arithmetic shift rounds down; adding |d| - 1 to negative
+            // dividends first makes it round toward zero.
+            int k = std::countr_zero(ad);
+            as.mov(RAX, R11, false);
+            as.shift(ShiftSar, RAX, 31);
+            as.shift(ShiftShr, RAX, 32 - k);
+            as.alu(AluAdd, RAX, R11);
+            as.shift(ShiftSar, RAX, k);
+        } else {
+            // Granlund and Montgomery, "Division by Invariant Integers using
+            // Multiplication", figure 5.2, keeping the whole 64-bit product:
+            // x / |d| is (x * m) >> (31 + l), plus one if x is negative.
+            int      l = std::bit_width(ad - 1);
+            uint64_t m = 1 + (uint64_t(1) << (31 + l)) / ad;
+            as.movsxd(RAX, R11);
+            as.mov(RDX, (int64_t)m);
+            as.imul(RAX, RDX, true);
+            as.shift(ShiftSar, RAX, 31 + l, true);
+            as.mov(RDX, R11, false);
+            as.shift(ShiftSar, RDX, 31);
+            as.alu(AluSub, RAX, RDX);
+        }
+        if (d < 0) {
+            as.neg(RAX);
+        }
+
+        if (is_div) {
+            store(inst.dst, RAX);
+        } else {
+            as.imul(RAX, RAX, d);
+            as.alu(AluSub, R11, RAX);
+            store(inst.dst, R11);
+        }
+    }
+
+    void compile_div(IRInst &inst)
+    {
+        Operand b = operand(inst.b);
+        if (b.kind == Operand::Imm) {
+            compile_div_const(inst, (int)b.imm);
+            return;
+        }
+
+        // idiv traps on both a zero divisor and INT_MIN / -1; the latter
+        // wraps to INT_MIN with a remainder of 0. Either check is left out
+        // where range analysis showed it cannot happen.
+        bool  is_div = inst.binop == Operator::Div;
+        Label done;
+        Label minus_one;
+
+        load(RAX, inst.a);
+        if (inst.check_zero) {
+            emit_test(b);
+            as.jcc(CondE, error_stub(DIVISION_BY_ZERO, inst));
+        }
+        if (inst.check_overflow) {
+            if (b.kind == Operand::Register) {
+                as.alu(AluCmp, b.reg, -1);
+            } else {
+                as.alu(AluCmp, b.mem, -1);
+            }
+            as.jcc(CondE, minus_one);
+        }
+
+        as.cdq();
+        if (b.kind == Operand::Register) {
+            as.idiv(b.reg);
+        } else {
+            as.idiv(b.mem);
+        }
+        if (!is_div) {
+            as.mov(RAX, RDX, false);
+        }
+        as.jmp(done);
+
+        as.bind(minus_one);
+        if (is_div) {
+            as.neg(RAX);
+        } else {
+            as.alu(AluXor, RAX, RAX);
+        }
+        as.bind(done);
+        store(inst.dst, RAX);
+    }
+
+    void compile_binop(IRInst &inst)
+    {
+        if (inst.binop == Operator::Div || inst.binop == Operator::Rem) {
+            compile_div(inst);
+            return;
+        }
+
+        if (is_compare(inst.binop)) {
+            Cond cond = emit_compare(inst);
+            as.setcc(cond, RAX);
+            as.movzxb(RAX, RAX);
+            store(inst.dst, RAX);
+            return;
+        }
+
+        int a = inst.a;
+        int b = inst.b;
+        if (is_const[a] && !is_const[b] && is_commutative(inst.binop)) {
+            std::swap(a, b);
+        }
+
+        // The result may share a register with an operand that dies here;
+        // make sure the other operand is not overwritten before it is read.
+        Reg     d = dst_reg(inst.dst);
+        Operand y = operand(b);
+        if (y.kind == Operand::Register && y.reg == d && a != b) {
+            if (is_commutative(inst.binop)) {
+                std::swap(a, b);
+                y = operand(b);
+            } else {
+                d = RAX;
+            }
+        }
+
+        load(d, a);
+        if (inst.binop == Operator::Mul) {
+            if (y.kind == Operand::Imm && (int)y.imm > 0
+                && std::has_single_bit((uint32_t)y.imm)) {
+                as.shift(ShiftShl, d, std::countr_zero((uint32_t)y.imm));
+                store(inst.dst, d);
+                return;
+            }
+            switch (y.kind) {
+            case Operand::Imm: as.imul(d, d, (int32_t)y.imm); break;
+            case Operand::Register: as.imul(d, y.reg); break;
+            case Operand::Memory: as.imul(d, y.mem); break;
+            }
+            store(inst.dst, d);
+            return;
+        }
+
+        AluOp op;
+        switch (inst.binop) {
+        case Operator::Add: op = AluAdd; break;
+        case Operator::Sub: op = AluSub; break;
+        case Operator::Band: op = AluAnd; break;
+        case Operator::Bor: op = AluOr; break;
+        case Operator::Xor: op = AluXor; break;
+        default: perror("Invalid operator"); exit(EXIT_FAILURE);
+        }
+
+        emit_alu(op, d, y);
+        store(inst.dst, d);
+    }
+
+    void compile_call(IRInst &inst)
+    {
+        int callee = inst.imm;
+
+        // No register the allocator gives out survives a call with a value
+        // still needed afterwards in a caller-saved register.
+        if (is_builtin(callee)) {
+            load(RDI, inst.args[0]);
+            switch (callee) {
+            case BuiltinPrintint: call_runtime((void *)rt_printint); break;
+            case BuiltinPrintstring: call_runtime((void *)rt_printstring); break;
+            case BuiltinExit:
+                as.movsxd(RDI, RDI);
+                call_runtime((void *)rt_exit);
+                break;
+            }
+            return;
+        }
+
+        as.alu(AluSub, DEPTH_REG, 1, true);
+        as.jcc(CondE, error_stub(STACK_OVERFLOW, inst));
+
+        // Arguments past the sixth are pushed right to left, keeping the
+        // stack 16-byte aligned at the call.
+        int argc     = inst.args.size();
+        int n_stack  = std::max(0, argc - N_ARG_REGS);
+        int padding  = n_stack % 2;
+        if (padding) {
+            as.alu(AluSub, RSP, 8, true);
+        }
+        for (int i = argc - 1; i >= N_ARG_REGS; i--) {
+            load(RAX, inst.args[i]);
+            as.push(RAX);
+        }
+
+        std::vector<Move> moves;
+        for (int i = 0; i < argc && i < N_ARG_REGS; i++) {
+            int arg = inst.args[i];
+            moves.push_back(Move{ ARG_REGS[i], operand(arg), is_str(arg) });
+        }
+        emit_moves(moves);
+
+        if (callee == fun.fun_idx && !fun.osr) {
+            as.call(entry);
+        } else {
+            as.call_indirect(&fun_table[callee]);
+        }
+
+        if (n_stack + padding > 0) {
+            as.alu(AluAdd, RSP, 8 * (n_stack + padding), true);
+        }
+        as.alu(AluAdd, DEPTH_REG, 1, true);
+
+        if (inst.dst >= 0) {
+            store(inst.dst, RAX);
+        }
+    }
+
+    // Emits a conditional branch to `target[0]` if `cond` holds and to
+    // `target[1]` otherwise, falling through to `next_block` if possible.
+    void emit_branch(Cond cond, IRInst &term, int next_block)
+    {
+        int t = term.target[0];
+        int f = term.target[1];
+        if (t == next_block) {
+            as.jcc(negate(cond), edge_label(f));
+            emit_reloads(cur_block, t);
+        } else {
+            as.jcc(cond, edge_label(t));
+            emit_reloads(cur_block, f);
+            if (f != next_block) {
+                as.jmp(block_labels[f]);
+            }
+        }
+    }
+
+    // A compare whose only use is the branch right after it sets the flags
+    // for the branch instead of materializing a boolean.
+    bool fuses_with_branch(BasicBlock &block, unsigned int i)
+    {
+        auto &inst = block.insts[i];
+        if (inst.op != IROp::BinOp || !is_compare(inst.binop)
+            || i + 2 != block.insts.size()) {
+            return false;
+        }
+        auto &term = block.insts[i + 1];
+        return term.op == IROp::Br && term.a == inst.dst
+               && n_uses[inst.dst] == 1 && !is_const[inst.dst];
+    }
+
+    void compile_inst(IRInst &inst, int next_block)
+    {
+        switch (inst.op) {
+        case IROp::Const:
+            if (!is_const[inst.dst]) {
+                Reg d = dst_reg(inst.dst);
+                as.mov(d, (int64_t)(int32_t)inst.imm);
+                store(inst.dst, d);
+            }
+            break;
+        case IROp::ConstStr: {
+            Reg d = dst_reg(inst.dst);
+            as.mov(d, (int64_t)string_pool.get(inst.imm));
+            store(inst.dst, d);
+            break;
+        }
+        case IROp::Mov: {
+            Reg d = dst_reg(inst.dst);
+            load(d, inst.a);
+            store(inst.dst, d);
+            break;
+        }
+        case IROp::BinOp: compile_binop(inst); break;
+        case IROp::UnOp:
+            if (inst.binop == Operator::Neg) {
+                Reg d = dst_reg(inst.dst);
+                load(d, inst.a);
+                as.neg(d);
+                store(inst.dst, d);
+            } else {
+                emit_test(operand(inst.a));
+                as.setcc(CondE, RAX);
+                as.movzxb(RAX, RAX);
+                store(inst.dst, RAX);
+            }
+            break;
+        case IROp::LoadGlobal: {
+            Reg d = dst_reg(inst.dst);
+            as.mov(d, Mem{ GLOBALS_REG, (int32_t)(8 * inst.imm) });
+            store(inst.dst, d);
+            break;
+        }
+        case IROp::StoreGlobal: {
+            // Globals are shared with the other engines, which expect ints
+            // sign-extended to 64 bits.
+            Operand x = operand(inst.a);
+            if (is_str(inst.a) || x.kind == Operand::Imm) {
+                load(RAX, x, true);
+            } else if (x.kind == Operand::Register) {
+                as.movsxd(RAX, x.reg);
+            } else {
+                as.movsxd(RAX, x.mem);
+            }
+            as.mov(Mem{ GLOBALS_REG, (int32_t)(8 * inst.imm) }, RAX);
+            break;
+        }
+        case IROp::Call: compile_call(inst); break;
+        case IROp::Phi: perror("Phi outside SSA form"); exit(EXIT_FAILURE);
+        case IROp::Jmp:
+            emit_reloads(cur_block, inst.target[0]);
+            if (inst.target[0] != next_block) {
+                as.jmp(block_labels[inst.target[0]]);
+            }
+            break;
+        case IROp::Br:
+            if (is_const[inst.a]) {
+                int target = inst.target[const_val[inst.a] ? 0 : 1];
+                emit_reloads(cur_block, target);
+                if (target != next_block) {
+                    as.jmp(block_labels[target]);
+                }
+            } else {
+                emit_test(operand(inst.a));
+                emit_branch(CondNE, inst, next_block);
+            }
+            break;
+        case IROp::Ret:
+            if (inst.a >= 0) {
+                load(RAX, inst.a);
+            }
+            emit_epilogue();
+            break;
+        }
+    }
+
+public:
+    X86Compiler(IRFunction &fun, void **fun_table)
+        : fun(fun)
+        , fun_table(fun_table)
+    {
+    }
+
+    // Returns the size of the native frame: return address, saved RBP, saved
+    // registers and spill slots.
+    size_t compile()
+    {
+        analyze();
+        alloc = allocate_registers(fun, is_const);
+        layout_frame();
+
+        block_labels.resize(fun.blocks.size());
+        emit_prologue();
+
+        for (unsigned int b = 0; b < fun.blocks.size(); b++) {
+            auto &block = fun.blocks[b];
+            int   next  = b + 1;
+            cur_block   = b;
+            pos         = alloc.block_start[b];
+            as.bind(block_labels[b]);
+
+            for (unsigned int i = 0; i < block.insts.size(); i++, pos += 2) {
+                if (fuses_with_branch(block, i)) {
+                    Cond cond = emit_compare(block.insts[i]);
+                    pos += 2;
+                    emit_branch(cond, block.insts[i + 1], next);
+                    break;
+                }
+                compile_inst(block.insts[i], next);
+            }
+        }
+
+        for (auto &stub : edge_stubs) {
+            as.bind(stub->label);
+            emit_reloads(stub->pred, stub->succ);
+            as.jmp(block_labels[stub->succ]);
+        }
+
+        error_stubs.emit(as);
+        return 16 + frame_size;
+    }
+
+    Assembler &assembler()
+    {
+        return as;
+    }
+};
+
+JIT::JIT(int n_funs, int n_globals)
+    : arena(CODE_ARENA_SIZE)
+    , globals(n_globals, 0)
+    , baseline_frames(n_funs, 0)
+{
+    fun_table = (void **)arena.allocate_data(n_funs * sizeof(void *));
+    compile_entry();
+}
+
+void
+JIT::compile_entry()
+{
+    // Six callee-saved pushes on top of the return address leave the stack
+    // 8 bytes off 16-byte alignment.
+    const Reg saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+    Assembler as;
+    for (Reg r : saved) {
+        as.push(r);
+    }
+    as.alu(AluSub, RSP, 8, true);
+    as.mov(GLOBALS_REG, RSI);
+    as.mov(DEPTH_REG, RDX);
+    as.call(RDI);
+    as.alu(AluAdd, RSP, 8, true);
+    for (int i = 5; i >= 0; i--) {
+        as.pop(saved[i]);
+    }
+    as.ret();
+
+    entry = (EntryFn)arena.install(as);
+}
+
+void
+JIT::count_compile(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()
+                                            - start;
+    rt_stats.compiled++;
+    rt_stats.compile_seconds += elapsed.count();
+}
+
+void *
+JIT::install(Assembler &as, size_t frame_size, size_t max_frame)
+{
+    if (max_frame > 0 && frame_size > max_frame) {
+        return nullptr;
+    }
+    max_frame_size = std::max(max_frame_size, frame_size);
+    return arena.install(as);
+}
+
+void
+JIT::enable_tiering(Program          &program,
+                    int               call_threshold,
+                    int               loop_threshold,
+                    const OptOptions &options)
+{
+    int n_funs           = program.funs.size();
+    this->program        = &program;
+    this->loop_threshold = loop_threshold;
+    opt_options          = options;
+    optimized.assign(n_funs, false);
+
+    counters = (TierCounters *)arena.allocate_data(n_funs
+                                                   * sizeof(TierCounters));
+    for (int i = 0; i < n_funs; i++) {
+        counters[i] = TierCounters{ call_threshold, loop_threshold };
+    }
+}
+
+void
+JIT::tier_up(int fun_idx)
+{
+    // Activations that were already running keep counting; keep them from
+    // coming back here any time soon.
+    counters[fun_idx].calls = INT32_MAX;
+    if (optimized[fun_idx]) {
+        return;
+    }
+    optimized[fun_idx] = true;
+
+    // The library's copy stays as it is for inlining elsewhere.
+    auto       start = std::chrono::steady_clock::now();
+    IRFunction ir    = library_function(fun_idx);
+    if (compile(ir, start)) {
+        rt_stats.tier_ups++;
+    }
+}
+
+IRProgram &
+JIT::ir_library()
+{
+    if (!library) {
+        library            = std::make_unique<IRProgram>();
+        library->n_globals = program->n_globals;
+        library->funs.resize(program->funs.size());
+
+        // Summarized from the AST rather than the IR, which would take
+        // lowering every function up front.
+        if (opt_options.level >= OptLevel::O2) {
+            library_effects = compute_effects(*program);
+        }
+    }
+    return *library;
+}
+
+void
+JIT::push_callees(const IRFunction                  &fun,
+                  std::vector<std::pair<int, bool>> &stack)
+{
+    for (auto &block : fun.blocks) {
+        for (auto &inst : block.insts) {
+            if (inst.op == IROp::Call && program->funs[inst.imm]
+                && !ir_library().funs[inst.imm]) {
+                stack.push_back({ inst.imm, false });
+            }
+        }
+    }
+}
+
+void
+JIT::load_library(std::vector<std::pair<int, bool>> &stack)
+{
+    // Each function is lowered when first popped and optimized when popped
+    // again, after everything it calls, so it inlines optimized callees.
+    IRProgram &library = ir_library();
+    while (!stack.empty()) {
+        auto [fun_idx, callees_done] = stack.back();
+        stack.pop_back();
+        if (callees_done) {
+            optimize_function(*library.funs[fun_idx],
+                              library,
+                              library_effects,
+                              opt_options);
+        } else if (!library.funs[fun_idx]) {
+            library.funs[fun_idx] = lower_function(program->funs[fun_idx],
+                                                   nullptr,
+                                                   opt_options);
+            stack.push_back({ fun_idx, true });
+            push_callees(*library.funs[fun_idx], stack);
+        }
+    }
+}
+
+IRFunction &
+JIT::library_function(int fun_idx)
+{
+    std::vector<std::pair<int, bool>> stack = { { fun_idx, false } };
+    load_library(stack);
+    return *library->funs[fun_idx];
+}
+
+void *
+JIT::osr(int fun_idx, StmtNode *loop)
+{
+    // Other baseline activations may still be looping; let them come back
+    // for the code once they get hot too.
+    counters[fun_idx].loops = loop_threshold;
+    if (fun_idx != 0) {
+        tier_up(fun_idx);
+    }
+
+    auto cached = osr_code.find(loop);
+    if (cached != osr_code.end()) {
+        return cached->second;
+    }
+
+    auto                        start = std::chrono::steady_clock::now();
+    std::unique_ptr<IRFunction> ir;
+    if (fun_idx == 0) {
+        ir = lower_top_level(*program, loop, opt_options);
+    } else {
+        ir = lower_function(program->funs[fun_idx], loop, opt_options);
+    }
+
+    // Only what the entry may call joins the library.
+    std::vector<std::pair<int, bool>> stack;
+    push_callees(*ir, stack);
+    load_library(stack);
+    optimize_function(*ir, *library, library_effects, opt_options);
+
+    // The entry runs on top of the baseline frame it takes over from, and
+    // the two together have to fit in one frame's share of the stack.
+    void  *code     = nullptr;
+    size_t baseline = baseline_frames[fun_idx];
+    if (baseline < frame_budget) {
+        code = compile_ir(*ir, frame_budget - baseline);
+    }
+    count_compile(start);
+    if (code) {
+        rt_stats.osr_entries++;
+    } else {
+        // The rest of this body will not fit either; stop paying for a
+        // compile at every loop that gets hot after this one.
+        counters[fun_idx].loops = INT32_MAX;
+    }
+
+    osr_code[loop] = code;
+    return code;
+}
+
+void *
+JIT::compile_ir(IRFunction &fun, size_t max_frame)
+{
+    X86Compiler compiler(fun, fun_table);
+
+    // Calls push at most one stack slot per argument, plus padding.
+    size_t frame    = compiler.compile();
+    size_t max_args = 0;
+    for (auto &block : fun.blocks) {
+        for (auto &inst : block.insts) {
+            if (inst.op == IROp::Call) {
+                max_args = std::max(max_args, inst.args.size());
+            }
+        }
+    }
+
+    void *code = install(compiler.assembler(),
+                         frame + 8 * (max_args + 1),
+                         max_frame);
+    return code;
+}
+
+bool
+JIT::compile(IRFunction &fun)
+{
+    return compile(fun, std::chrono::steady_clock::now());
+}
+
+bool
+JIT::compile(IRFunction &fun, std::chrono::steady_clock::time_point start)
+{
+    void *code = compile_ir(fun, frame_budget);
+    count_compile(start);
+    if (!code) {
+        return false;
+    }
+
+    fun_table[fun.fun_idx] = code;
+    return true;
+}
+
+int
+JIT::run()
+{
+    rt_stats.counted = false;
+
+    frame_budget = max_frame_size;
+    if (counters) {
+        frame_budget = std::max(frame_budget, TIER_FRAME_BUDGET);
+    }
+
+    size_t stack_size = frame_budget * (MAX_CALL_DEPTH + 1)
+                        + RUNTIME_STACK_RESERVE;
+    return rt_run_with_stack(stack_size, [&]() {
+        return (int)entry(fun_table[0], globals.data(), MAX_CALL_DEPTH + 1);
+    });
+}
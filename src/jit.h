@@ -0,0 +1,175 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "effects.h"
+#include "ir.h"
+#include "pass_manager.h"
+#include "program.h"
+#include "runtime.h"
+#include "x86.h"
+
+// Native code generation. Every function, including the top level, becomes a
+// native function following the System V calling convention: arguments
+// arrive in RDI, RSI, RDX, RCX, R8, R9 and then on the stack, and the result
+// is returned in RAX. Ints are 32-bit values; only the low half of a register
+// or stack slot holding one is meaningful.
+//
+// Two registers are reserved across all generated code: R14 holds the address
+// of the globals and R15 counts down the calls left before MAX_CALL_DEPTH.
+//
+// Calls between Albatross functions go through a table of code addresses
+// indexed by FunInfo::var_idx_db, except self-recursive calls, which jump
+// straight to the start of the function.
+//
+// There are two compilers: an optimizing one working on the IR (jit.cpp), with
+// virtual registers allocated to machine registers by linear scan
+// (regalloc.h), and a single-pass baseline one working on the AST
+// (baseline_jit.cpp). Neither uses RBX, R12 or R13 across a call without
+// saving them.
+//
+// With tiering enabled, every function starts out as baseline code that
+// counts its calls and loop back-edges. When either count reaches its
+// threshold the function is recompiled by the optimizing compiler and its
+// function table entry is patched, so that later calls run the new code.
+// Activations already running in a hot loop move over to optimized code by
+// on-stack replacement: the loop's back-edge counter runs out and calls into
+// the JIT, which compiles an entry into the middle of the loop from the IR
+// (see lower_function()). The baseline code then passes its locals and loop
+// counters to that entry and returns whatever it returns.
+
+const Reg ARG_REGS[]  = { RDI, RSI, RDX, RCX, R8, R9 };
+const int N_ARG_REGS  = sizeof(ARG_REGS) / sizeof(ARG_REGS[0]);
+const Reg GLOBALS_REG = R14;
+const Reg DEPTH_REG   = R15;
+
+extern const char *const DIVISION_BY_ZERO;
+extern const char *const STACK_OVERFLOW;
+
+// Calls a C++ function through RAX.
+void
+emit_call_runtime(Assembler &as, const void *fn);
+
+// Out-of-line calls to rt_error, collected while compiling a function and
+// emitted after its body so that the error paths stay off the hot path.
+class ErrorStubs {
+private:
+    struct Stub {
+        Label       label;
+        const char *msg;
+        SourcePos   pos;
+    };
+    std::vector<std::unique_ptr<Stub>> stubs;
+
+public:
+    Label &add(const char *msg, SourcePos pos);
+    void   emit(Assembler &as);
+};
+
+// Countdowns of the calls and loop back-edges left before a function is
+// recompiled, decremented by its baseline code.
+struct TierCounters {
+    int32_t calls;
+    int32_t loops;
+};
+
+class JIT {
+private:
+    typedef int64_t (*EntryFn)(void *code, Value *globals, int64_t depth);
+
+    CodeArena arena;
+
+    std::vector<Value> globals;
+
+    // Code addresses by var_idx_db, in memory generated code can reach with a
+    // rel32 displacement.
+    void **fun_table;
+
+    // Switches from C++ to generated code: saves the callee-saved registers,
+    // sets up R14 and R15 and calls `code`.
+    EntryFn entry;
+
+    // Largest native frame of any function, to size the stack.
+    size_t max_frame_size = 0;
+
+    // Frame size of each function's baseline code.
+    std::vector<size_t> baseline_frames;
+
+    // Tiering state; `counters` is null unless tiering is enabled.
+    Program                                *program        = nullptr;
+    TierCounters                           *counters       = nullptr;
+    int                                     loop_threshold = 0;
+    std::vector<bool>                       optimized;
+    std::unordered_map<StmtNode *, void *> osr_code;
+
+    // The optimized IR of the program's functions, to recompile them from
+    // and inline into on-stack replacement entries. A function is lowered
+    // the first time it gets hot or hot code may call it; until then its
+    // entry is null.
+    OptOptions                   opt_options;
+    std::unique_ptr<IRProgram>   library;
+    std::vector<FunctionEffects> library_effects;
+
+    // Once code is running the stack cannot grow, so functions recompiled
+    // from then on must fit in this frame size.
+    size_t frame_budget = 0;
+
+    void  compile_entry();
+    void *compile_ir(IRFunction &fun, size_t max_frame);
+
+    // Compiles a function, counting the time since `start` as compile time.
+    bool compile(IRFunction &fun, std::chrono::steady_clock::time_point start);
+
+    // Places code in the arena and returns its address, or returns nullptr
+    // if it needs a frame larger than `max_frame` (0 for no limit).
+    void *install(Assembler &as, size_t frame_size, size_t max_frame);
+    void count_compile(std::chrono::steady_clock::time_point start);
+
+    IRProgram &ir_library();
+
+    // Pushes the functions `fun` calls that are not in the library yet.
+    void push_callees(const IRFunction                  &fun,
+                      std::vector<std::pair<int, bool>> &stack);
+
+    // Lowers and optimizes the functions on `stack`, all pushed as false,
+    // into the library along with everything they call.
+    void        load_library(std::vector<std::pair<int, bool>> &stack);
+    IRFunction &library_function(int fun_idx);
+
+public:
+    JIT(int n_funs, int n_globals);
+
+    // Compiles a function with the optimizing compiler. Returns false if the
+    // code was dropped because its frame does not fit in the running stack.
+    bool compile(IRFunction &fun);
+
+    // Compiles a function (or the top level, for index 0) straight from the
+    // AST with the baseline compiler.
+    void compile_baseline(Program &program, int fun_idx);
+
+    // Makes baseline code compiled from now on count calls and back-edges,
+    // recompiling a function after `call_threshold` calls or
+    // `loop_threshold` back-edges. Recompiled code is optimized as
+    // `options` say.
+    void enable_tiering(Program          &program,
+                        int               call_threshold,
+                        int               loop_threshold,
+                        const OptOptions &options);
+
+    // Recompiles a function with the optimizing compiler. Called from
+    // baseline code when its call counter runs out.
+    void tier_up(int fun_idx);
+
+    // Returns an on-stack replacement entry into `loop`, a hot loop in a
+    // function (or the top level), or nullptr if there is none. Called from
+    // baseline code when the function's back-edge counter runs out; also
+    // tiers up the function itself.
+    void *osr(int fun_idx, StmtNode *loop);
+
+    // Runs the top-level code and returns the program's exit code.
+    int run();
+};
@@ -1,13 +1,15 @@
 #include "lexer.h"
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "compiler_stages.h"
 #include "error.h"
+#include "scan.h"
 
 bool
 is_alpha(char c)
@@ -74,28 +76,24 @@ ProgramText::peek()
 }
 
 // If the lexer has not processed the entire stream yet, advances the
-// ProgramText's idx to the next character, incrementing the current column
-// number. If idx ends on a newline sequence (i.e. the character \n or the
-// sequence \r\n), advance_char() skips over the newline and adjusts the line
-// and column numbers accordingly.
+// ProgramText's idx to the next character. Newlines need no special care:
+// tokens only record their offset, which LineIndex turns into a line and
+// column if an error is reported.
 void
 ProgramText::advance_char()
 {
-    char cur = cur_char();
-
     if (!done()) {
         idx++;
-        col_num++;
-
-        if (cur == '\n' || (cur == '\r' && peek() == '\n')) {
-            // If we went over to the next line, reset col_num to 1
-            // and increment line_num.
-            col_num = 1;
-            line_num++;
-        }
     }
 }
 
+// Advances idx to `end`, without looking at the characters in between.
+void
+ProgramText::advance_to(unsigned int end)
+{
+    idx = end;
+}
+
 char
 ProgramText::next()
 {
@@ -109,61 +107,99 @@ ProgramText::next()
 void
 ProgramText::skip_whitespace()
 {
-    while (is_whitespace(cur_char())) {
-        advance_char();
+    idx = scan.skip_space(stream, idx);
+}
+
+// Returns the type of the keyword or type name `s`, or Identifier if it is
+// neither. The length and first character of `s` leave at most one keyword it
+// can be (return and repeat are told apart by their third), so one comparison
+// settles it. `s` may not be empty.
+static TokenType
+keyword_type(std::string_view s)
+{
+    struct Keyword {
+        const char *text;
+        TokenType   type;
+    };
+
+    Keyword k;
+    switch (s.size() << 8 | (unsigned char)s[0]) {
+    case 2 << 8 | 'i': k = { "if", TokenType::KeywordIf }; break;
+    case 3 << 8 | 'f': k = { "fun", TokenType::KeywordFun }; break;
+    case 3 << 8 | 'i': k = { "int", TokenType::TypeName }; break;
+    case 3 << 8 | 'v': k = { "var", TokenType::KeywordVar }; break;
+    case 4 << 8 | 'c': k = { "char", TokenType::TypeName }; break;
+    case 4 << 8 | 'e': k = { "else", TokenType::KeywordElse }; break;
+    case 4 << 8 | 'v': k = { "void", TokenType::TypeName }; break;
+    case 5 << 8 | 'w': k = { "while", TokenType::KeywordWhile }; break;
+    case 6 << 8 | 'r':
+        k = s[2] == 't' ? Keyword{ "return", TokenType::KeywordReturn } :
+                          Keyword{ "repeat", TokenType::KeywordRepeat };
+        break;
+    case 6 << 8 | 's': k = { "string", TokenType::TypeName }; break;
+    case 9 << 8 | 'o': k = { "otherwise", TokenType::KeywordOtherwise }; break;
+    default: return TokenType::Identifier;
     }
+
+    return s == k.text ? k.type : TokenType::Identifier;
 }
 
 // Get an alphanumeric symbol, like "while", "variable_name", or "foo_3".
-std::unique_ptr<Token>
+Token
 get_symbol(ProgramText &t)
 {
-    static std::unordered_map<std::string, TokenType> keyword_map;
-    if (keyword_map.empty()) {
-        keyword_map["var"]       = TokenType::KeywordVar;
-        keyword_map["if"]        = TokenType::KeywordIf;
-        keyword_map["else"]      = TokenType::KeywordElse;
-        keyword_map["while"]     = TokenType::KeywordWhile;
-        keyword_map["return"]    = TokenType::KeywordReturn;
-        keyword_map["otherwise"] = TokenType::KeywordOtherwise;
-        keyword_map["repeat"]    = TokenType::KeywordRepeat;
-        keyword_map["fun"]       = TokenType::KeywordFun;
-        keyword_map["int"]       = TokenType::TypeName;
-        keyword_map["string"]    = TokenType::TypeName;
-        keyword_map["char"]      = TokenType::TypeName;
-        keyword_map["void"]      = TokenType::TypeName;
-    }
+    Token token;
+    token.pos = t.idx;
 
-    auto token      = std::make_unique<Token>();
-    token->col_num  = t.col_num;
-    token->line_num = t.line_num;
+    unsigned int start = t.idx;
+    t.advance_to(scan.skip_ident(t.stream, t.idx));
 
-    std::string str;
+    token.text = t.stream.substr(start, t.idx - start);
+    token.type = keyword_type(token.text);
+    return token;
+}
 
-    // Don't need to check for out of bounds since cur_char just returns -1
-    // once we've reached the end of the stream.
-    while (!is_whitespace(t.cur_char()) && !t.done()
-           && (is_alphanumeric(t.cur_char()) || t.cur_char() == '_')) {
-        str += t.next();
+// The value of the text of an int literal, or INT_MAX + 1 if it is any larger.
+static int64_t
+literal_value(std::string_view text)
+{
+    int          base = 10;
+    unsigned int i    = 0;
+    if (text.size() > 1 && text[0] == '0' && text[1] == 'x') {
+        base = 16;
+        i    = 2;
+    } else if (text[0] == '0') {
+        base = 8;
     }
 
-    token->string_value = str;
-    token->type         = keyword_map.find(str) != keyword_map.end() ?
-                              keyword_map[str] :
-                              TokenType::Identifier;
-    return token;
+    int64_t value = 0;
+    for (; i < text.size(); i++) {
+        char c = std::toupper(text[i]);
+        if (c == '_') {
+            continue;
+        }
+        int digit = c <= '9' ? c - '0' : c - 'A' + 10;
+        value     = std::min(value * base + digit, (int64_t)INT_MAX + 1);
+    }
+    return value;
+}
+
+int
+int_literal_value(std::string_view text)
+{
+    return literal_value(text);
 }
 
 // Returns a token for a numeric literal (like 123, 3.14, or their negative
 // counterparts).
-std::unique_ptr<Token>
+Token
 get_numeric_literal(ProgramText &t)
 {
-    auto token      = std::make_unique<Token>();
-    token->col_num  = t.col_num;
-    token->line_num = t.line_num;
-    token->type     = TokenType::IntLiteral;
-    std::string num_literal;
+    Token token;
+    token.pos  = t.idx;
+    token.type = TokenType::IntLiteral;
+
+    unsigned int start = t.idx;
 
     // Check the type of integer:
     // 0  -> octal
@@ -186,11 +222,10 @@ get_numeric_literal(ProgramText &t)
         base = 10;
     }
 
+    unsigned int digits_start = t.idx;
+
     if (t.cur_char() == '_') {
-        throw AlbatrossError("Illegal int literal " + num_literal,
-                             t.line_num,
-                             t.col_num,
-                             EXIT_LEXER_FAILURE);
+        throw AlbatrossError("Illegal int literal ", t.idx, EXIT_LEXER_FAILURE);
     }
 
     while (is_alphanumeric(t.cur_char())) {
@@ -202,12 +237,11 @@ get_numeric_literal(ProgramText &t)
                 && !(('0' <= c && c <= '9') || ('A' <= c && c <= 'F')))) {
             throw AlbatrossError("Illegal digit for int of base "
                                      + std::to_string(base),
-                                 t.line_num,
-                                 t.col_num,
+                                 t.idx,
                                  EXIT_LEXER_FAILURE);
         }
 
-        num_literal += t.next();
+        t.advance_char();
 
         // Skip underscores
         while (t.cur_char() == '_') {
@@ -215,50 +249,45 @@ get_numeric_literal(ProgramText &t)
         }
     }
 
-    try {
-        num_literal = std::to_string(std::stoi(num_literal, 0, base));
+    if (t.idx == digits_start) {
+        throw AlbatrossError("Illegal int literal ", t.idx, EXIT_LEXER_FAILURE);
     }
 
-    catch (std::invalid_argument &e) {
-        throw AlbatrossError("Illegal int literal " + num_literal,
-                             t.line_num,
-                             t.col_num,
-                             EXIT_LEXER_FAILURE);
-    } catch (std::out_of_range &e) {
-        throw AlbatrossError("Int " + num_literal + " is out of range",
-                             t.line_num,
-                             t.col_num,
+    token.text = t.stream.substr(start, t.idx - start);
+    if (literal_value(token.text) > INT_MAX) {
+        std::string digits(t.stream.substr(digits_start, t.idx - digits_start));
+        digits.erase(std::remove(digits.begin(), digits.end(), '_'),
+                     digits.end());
+        throw AlbatrossError("Int " + digits + " is out of range",
+                             t.idx,
                              EXIT_LEXER_FAILURE);
     }
-    token->string_value = num_literal;
 
     return token;
 }
 
 // Returns a token for "punctuation". This is a catch-all term for tokens that
 // are not symbols or literals.
-std::unique_ptr<Token>
+Token
 get_punctuation(ProgramText &t)
 {
-    auto token      = std::make_unique<Token>();
-    token->col_num  = t.col_num;
-    token->line_num = t.line_num;
-    token->string_value += t.cur_char();
+    Token token;
+    token.pos  = t.idx;
+    token.text = t.stream.substr(t.idx, 1);
 
     switch (t.cur_char()) {
     // All supported "punctuation" characters can be seen here:
-    case '(': token->type = TokenType::Lparen; break;
-    case ')': token->type = TokenType::Rparen; break;
-    case '{': token->type = TokenType::Lcurl; break;
-    case '}': token->type = TokenType::Rcurl; break;
-    case '[': token->type = TokenType::Lbracket; break;
-    case ']': token->type = TokenType::Rbracket; break;
-    case ';': token->type = TokenType::Semicolon; break;
-    case ',': token->type = TokenType::Comma; break;
+    case '(': token.type = TokenType::Lparen; break;
+    case ')': token.type = TokenType::Rparen; break;
+    case '{': token.type = TokenType::Lcurl; break;
+    case '}': token.type = TokenType::Rcurl; break;
+    case '[': token.type = TokenType::Lbracket; break;
+    case ']': token.type = TokenType::Rbracket; break;
+    case ';': token.type = TokenType::Semicolon; break;
+    case ',': token.type = TokenType::Comma; break;
     default:
         throw AlbatrossError("unrecognized character",
-                             t.line_num,
-                             t.col_num,
+                             t.idx,
                              EXIT_LEXER_FAILURE);
     }
 
@@ -266,61 +295,46 @@ get_punctuation(ProgramText &t)
     return token;
 }
 
-std::unique_ptr<Token>
+Token
 get_string_literal(ProgramText &t)
 {
-    auto token      = std::make_unique<Token>();
-    token->col_num  = t.col_num;
-    token->line_num = t.line_num;
-    std::string str_literal;
+    Token token;
+    token.pos = t.idx;
 
     // Skip opening quote
     t.advance_char();
 
+    unsigned int start = t.idx;
+
+    // Plain characters are skipped in bulk; only the ones that can end the
+    // literal or start an escape sequence are looked at.
+    t.advance_to(scan.skip_str(t.stream, t.idx));
     while (t.cur_char() != '"' && !t.done()) {
         if (t.cur_char() == '\\') {
-            if (t.peek() == 'n') {
-                str_literal += '\n';
-                t.advance_char();
-                t.advance_char();
-                continue;
-            }
-
-            else if (t.peek() == 't') {
-                str_literal += '\t';
-                t.advance_char();
-                t.advance_char();
-                continue;
-            }
-
-            else if (t.peek() == '\\') {
-                str_literal += '\\';
-                t.advance_char();
-                t.advance_char();
-                continue;
-            }
-
-            else if (t.peek() == '\"') {
-                str_literal += '\"';
+            char c = t.peek();
+            if (c == 'n' || c == 't' || c == '\\' || c == '\"') {
                 t.advance_char();
                 t.advance_char();
+                t.advance_to(scan.skip_str(t.stream, t.idx));
                 continue;
             }
 
             else {
                 throw AlbatrossError("Invalid escape sequence",
-                                     t.line_num,
-                                     t.col_num,
+                                     t.idx,
                                      EXIT_LEXER_FAILURE);
             }
         } else if (t.cur_char() == '\n') {
             throw AlbatrossError(
-                "no matching quote", t.line_num, t.col_num, EXIT_LEXER_FAILURE);
+                "no matching quote", t.idx, EXIT_LEXER_FAILURE);
         }
 
-        str_literal += t.next();
+        t.advance_char();
+        t.advance_to(scan.skip_str(t.stream, t.idx));
     }
 
+    token.text = t.stream.substr(start, t.idx - start);
+
     // Add in closing quote, if it exists:
     if (t.cur_char() == '"') {
         // str_literal += t.cur_char();
@@ -329,186 +343,194 @@ get_string_literal(ProgramText &t)
 
     else {
         // No matching quote
-        throw AlbatrossError(
-            "no matching quote", t.line_num, t.col_num, EXIT_LEXER_FAILURE);
+        throw AlbatrossError("no matching quote", t.idx, EXIT_LEXER_FAILURE);
     }
 
-    token->type         = TokenType::StrLiteral;
-    token->string_value = str_literal;
+    token.type = TokenType::StrLiteral;
 
     return token;
 }
 
-std::unique_ptr<Token>
+std::string
+str_literal_value(std::string_view text)
+{
+    std::string res;
+    res.reserve(text.size());
+    for (unsigned int i = 0; i < text.size(); i++) {
+        if (text[i] != '\\') {
+            res += text[i];
+            continue;
+        }
+        switch (text[++i]) {
+        case 'n': res += '\n'; break;
+        case 't': res += '\t'; break;
+        default: res += text[i]; break;
+        }
+    }
+    return res;
+}
+
+Token
 get_operator(ProgramText &t)
 {
-    auto token      = std::make_unique<Token>();
-    token->col_num  = t.col_num;
-    token->line_num = t.line_num;
+    Token token;
+    token.pos = t.idx;
 
-    char cur_char  = t.cur_char();
-    char next_char = t.peek();
+    unsigned int start     = t.idx;
+    char         cur_char  = t.cur_char();
+    char         next_char = t.peek();
     switch (cur_char) {
     case '+':
-        token->type = TokenType::OpPlus;
-        token->string_value += t.next();
+        token.type = TokenType::OpPlus;
+        t.advance_char();
         break;
     case '-':
-        token->type = TokenType::OpMinus;
-        token->string_value += t.next();
+        token.type = TokenType::OpMinus;
+        t.advance_char();
         break;
     case '*':
-        token->type = TokenType::OpTimes;
-        token->string_value += t.next();
+        token.type = TokenType::OpTimes;
+        t.advance_char();
         break;
     case '/':
-        token->type = TokenType::OpDiv;
-        token->string_value += t.next();
+        token.type = TokenType::OpDiv;
+        t.advance_char();
         break;
     case '%':
-        token->type = TokenType::OpRem;
-        token->string_value += t.next();
+        token.type = TokenType::OpRem;
+        t.advance_char();
         break;
     case '!': {
-        token->type = TokenType::OpNot;
-        token->string_value += t.next();
+        token.type = TokenType::OpNot;
+        t.advance_char();
         break;
     }
     case '&': {
         // Two cases here: & (binary AND), or && (logical AND).
-        token->string_value += t.next();
+        t.advance_char();
         if (next_char == '&') {
-            token->type = TokenType::OpAnd;
-            token->string_value += t.next();
+            token.type = TokenType::OpAnd;
+            t.advance_char();
         } else {
-            token->type = TokenType::OpBand;
+            token.type = TokenType::OpBand;
         }
         break;
     }
     case '|': {
         // Two cases here: | (binary OR), or || (logical OR).
-        token->string_value += t.next();
+        t.advance_char();
         if (next_char == '|') {
-            token->type = TokenType::OpOr;
-            token->string_value += t.next();
+            token.type = TokenType::OpOr;
+            t.advance_char();
         } else {
-            token->type = TokenType::OpBor;
+            token.type = TokenType::OpBor;
         }
         break;
     }
     case '^': {
-        token->type = TokenType::OpXor;
-        token->string_value += t.next();
+        token.type = TokenType::OpXor;
+        t.advance_char();
         break;
     }
     case '<': {
         // Three potential cases: < (less than), <= (less than or equal to), or <>
         // (not equals).
-        token->string_value += t.next();
+        t.advance_char();
         if (next_char == '=') {
-            token->type = TokenType::OpLe;
-            token->string_value += t.next();
+            token.type = TokenType::OpLe;
+            t.advance_char();
         } else if (next_char == '>') {
-            token->type = TokenType::OpNe;
-            token->string_value += t.next();
+            token.type = TokenType::OpNe;
+            t.advance_char();
         } else {
-            token->type = TokenType::OpLt;
+            token.type = TokenType::OpLt;
         }
         break;
     }
     case '>': {
         // Only two cases: > (greater than) or >= (greater than or equal to).
-        token->string_value += t.next();
+        t.advance_char();
         if (next_char == '=') {
-            token->type = TokenType::OpGe;
-            token->string_value += t.next();
+            token.type = TokenType::OpGe;
+            t.advance_char();
         } else {
-            token->type = TokenType::OpGt;
+            token.type = TokenType::OpGt;
         }
         break;
     }
     case '=': {
         if (t.peek() == '=') {
-            token->type = TokenType::OpEq;
-            token->string_value += t.next();
-            token->string_value += t.next();
+            token.type = TokenType::OpEq;
+            t.advance_char();
+            t.advance_char();
             break;
         } else {
             throw AlbatrossError("unrecognized character",
-                                 t.line_num,
-                                 t.col_num,
+                                 t.idx,
                                  EXIT_LEXER_FAILURE);
         }
     }
     case ':': {
         if (t.peek() == '=') {
-            token->type = TokenType::Assign;
-            token->string_value += t.next();
-            token->string_value += t.next();
+            token.type = TokenType::Assign;
+            t.advance_char();
+            t.advance_char();
             break;
         } else {
             throw AlbatrossError("unrecognized character",
-                                 t.line_num,
-                                 t.col_num,
+                                 t.idx,
                                  EXIT_LEXER_FAILURE);
         }
     }
     default: {
         throw AlbatrossError("unrecognized character",
-                             t.line_num,
-                             t.col_num,
+                             t.idx,
                              EXIT_LEXER_FAILURE);
     }
     }
 
+    token.text = t.stream.substr(start, t.idx - start);
     return token;
 }
 
 // Tokenizes the string in a ProgramText into a token list.
-std::deque<std::unique_ptr<Token>>
+TokenStream
 tokenize(ProgramText &t)
 {
-    std::deque<std::unique_ptr<Token>> tokens;
+    TokenStream tokens(t.stream);
+
+    // Tokens average a few characters each; pages reserved past the last
+    // token are never touched, so guessing high costs no memory.
+    tokens.reserve(t.stream.size() / 2 + 1);
 
     while (!t.done()) {
         if (is_numeric(t.cur_char())
             || (t.cur_char() == '.' && is_numeric(t.peek()))) {
-            tokens.push_back(get_numeric_literal(t));
+            tokens.push(get_numeric_literal(t));
         }
 
         // Beginning of a string literal
         else if (t.cur_char() == '"') {
-            tokens.push_back(get_string_literal(t));
+            tokens.push(get_string_literal(t));
         }
 
         // Comments. We'll just skip the rest of the line here.
         else if (t.cur_char() == '#') {
             t.advance_char(); // skip over ;
-            while (t.cur_char() != '\r' && t.cur_char() != '\n' && !t.done()) {
-                t.advance_char();
-            }
-
-            if (t.cur_char() == '\n') {
-                t.advance_char();
-            }
-
-            else if (t.cur_char() == '\r' && t.peek() == '\n') {
-                t.advance_char();
-                t.advance_char();
-            }
+            t.advance_to(scan.skip_line(t.stream, t.idx));
         }
 
         // Everything else is assumed to be punctuation
         else if (is_punctuation(t.cur_char())) {
-            tokens.push_back(get_punctuation(t));
+            tokens.push(get_punctuation(t));
         }
 
         else if (is_alpha(t.cur_char())) {
-            tokens.push_back(get_symbol(t));
+            tokens.push(get_symbol(t));
         }
 
         else {
-            tokens.push_back(get_operator(t));
+            tokens.push(get_operator(t));
         }
 
         // Skip whitespace characters
@@ -520,35 +542,38 @@ tokenize(ProgramText &t)
 #ifndef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifndef COMPILE_STAGE_TYPE_CHECKER
     std::string type_str = "";
+    LineIndex   line_index(t.stream);
 
-    for (auto &token : tokens) {
-        std::cout << token->col_num << " " << token->line_num << " ";
+    for (size_t i = 0; i < tokens.size(); i++) {
+        Token token              = tokens[i];
+        auto [line_num, col_num] = line_index.locate(token.pos);
+        std::cout << col_num << " " << line_num << " ";
 
-        switch (token->type) {
+        switch (token.type) {
         case TokenType::KeywordVar:
         case TokenType::Identifier: {
             if (type_str.size() > 0) {
-                std::cout << "NAME " << token->string_value << " TYPE "
+                std::cout << "NAME " << token.text << " TYPE "
                           << type_str;
             } else {
-                std::cout << "NAME " << token->string_value;
+                std::cout << "NAME " << token.text;
             }
             break;
         }
         case TokenType::IntLiteral:
-            std::cout << "INT " << token->string_value;
+            std::cout << "INT " << int_literal_value(token.text);
             break;
         case TokenType::Semicolon: std::cout << "SEMICOLON"; break;
         case TokenType::Comma: std::cout << "COMMA"; break;
         case TokenType::Assign: std::cout << "ASSIGN"; break;
         case TokenType::TypeName: {
-            type_str = token->string_value;
-            std::cout << "TYPE " << token->string_value;
+            type_str = token.text;
+            std::cout << "TYPE " << token.text;
             break;
         }
         case TokenType::StrLiteral: {
-            std::cout << "STRING " << token->string_value.size() << " "
-                      << token->string_value;
+            auto value = str_literal_value(token.text);
+            std::cout << "STRING " << value.size() << " " << value;
             break;
         }
 
@@ -584,16 +609,15 @@ tokenize(ProgramText &t)
         case TokenType::KeywordOtherwise:
         case TokenType::KeywordRepeat:
         case TokenType::KeywordFun: {
-            int len = token->string_value.size();
-            for (int i = 0; i < len; i++) {
-                std::cout << (char)std::toupper(token->string_value[i]);
+            for (char c : token.text) {
+                std::cout << (char)std::toupper(c);
             }
             break;
         }
         default:
-            throw AlbatrossError("Bad token: " + token->string_value + "\n",
-                                 token->line_num,
-                                 token->col_num,
+            throw AlbatrossError("Bad token: " + std::string(token.text)
+                                     + "\n",
+                                 token.pos,
                                  EXIT_FAILURE);
         }
         std::cout << "\n";
@@ -603,11 +627,11 @@ tokenize(ProgramText &t)
 #endif
 #endif
 
-    std::unique_ptr<Token> eof_token = std::make_unique<Token>();
-    eof_token->line_num              = t.line_num;
-    eof_token->col_num               = t.col_num;
-    eof_token->type                  = TokenType::Eof;
-    tokens.push_back(std::move(eof_token));
+    Token eof_token;
+    eof_token.pos  = t.idx;
+    eof_token.type = TokenType::Eof;
+    eof_token.text = t.stream.substr(t.idx, 0);
+    tokens.push(eof_token);
 
     return tokens;
 }
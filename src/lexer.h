@@ -1,23 +1,20 @@
 #pragma once
 
-#include <deque>
-#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "token.h"
 
-// A ProgramText bundles together a stream (a program represented as a string)
-// and a current position within that string.
+// A ProgramText bundles together a stream (a view of the program source) and a
+// current position within that stream. Tokens view the same source, so it has
+// to outlive them.
 struct ProgramText {
-    unsigned int idx      = 0;
-    unsigned int line_num = 1;
-    unsigned int col_num  = 1;
+    unsigned int idx = 0;
 
-    std::string stream;
+    std::string_view stream;
 
-    ProgramText(std::string &stream)
+    ProgramText(std::string_view stream)
         : stream(stream)
     {
     }
@@ -26,9 +23,18 @@ struct ProgramText {
     char cur_char();
     char peek();
     void advance_char();
+    void advance_to(unsigned int end);
     char next();
     void skip_whitespace();
 };
 
-std::deque<std::unique_ptr<Token>>
+TokenStream
 tokenize(ProgramText &t);
+
+// The value of an IntLiteral token, whose text the lexer has checked.
+int
+int_literal_value(std::string_view text);
+
+// The value of a StrLiteral token, with its escape sequences replaced.
+std::string
+str_literal_value(std::string_view text);
@@ -0,0 +1,352 @@
+#include "licm.h"
+
+#include <algorithm>
+
+#include "liveness.h"
+#include "ssa.h"
+
+class LoopHoister {
+private:
+    IRFunction                         &fun;
+    const std::vector<FunctionEffects> &effects;
+
+    std::vector<Loop> loops;
+
+    // The blocks of the loop being hoisted out of, marked with its index,
+    // and each block's place in reverse postorder. Places are spaced out to
+    // fit a new preheader right before its loop's header; unreachable
+    // blocks have none.
+    std::vector<int> in_loop;
+    std::vector<int> rpo_place;
+
+    // The block defining each register (-1 for parameters), whether it holds
+    // a nonzero constant, and for a register whose value was copied to one
+    // in a preheader, that register.
+    std::vector<int>  def_block;
+    std::vector<bool> nonzero;
+    std::vector<int>  hoisted;
+
+    // Definitions of each original register, counting parameters.
+    std::vector<int> n_defs;
+
+    int origin(int reg)
+    {
+        return reg < (int)fun.ssa_origin.size() ? fun.ssa_origin[reg] : reg;
+    }
+
+    int new_reg(Type type)
+    {
+        def_block.push_back(-1);
+        nonzero.push_back(false);
+        hoisted.push_back(-1);
+        n_defs.push_back(1);
+        return fun.new_reg(type);
+    }
+
+    void analyze()
+    {
+        int n_regs = fun.n_regs();
+        def_block.assign(n_regs, -1);
+        nonzero.assign(n_regs, false);
+        hoisted.assign(n_regs, -1);
+        n_defs.assign(n_regs, 0);
+
+        for (int p = 0; p < fun.n_params; p++) {
+            n_defs[p]++;
+        }
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    def_block[inst.dst] = block.id;
+                    nonzero[inst.dst] = inst.op == IROp::Const && inst.imm != 0;
+                    n_defs[origin(inst.dst)]++;
+                }
+            }
+        }
+    }
+
+    void number_blocks()
+    {
+        in_loop.assign(fun.blocks.size(), -1);
+        rpo_place.assign(fun.blocks.size(), -1);
+        auto rpo = reverse_postorder(fun);
+        for (unsigned int i = 0; i < rpo.size(); i++) {
+            rpo_place[rpo[i]] = 2 * i + 1;
+        }
+    }
+
+    // Returns loop `l`'s preheader, making one if there is none, or -1 if
+    // the loop is entered from several places with different values.
+    int preheader(int l)
+    {
+        auto            &loop = loops[l];
+        std::vector<int> outside;
+        for (int pred : fun.blocks[loop.header].preds) {
+            if (in_loop[pred] != l) {
+                outside.push_back(pred);
+            }
+        }
+        if (outside.empty()) {
+            return -1;
+        }
+        if (outside.size() == 1 && fun.blocks[outside[0]].succs.size() == 1) {
+            return outside[0];
+        }
+
+        auto &preds = fun.blocks[loop.header].preds;
+        for (auto &inst : fun.blocks[loop.header].insts) {
+            if (inst.op != IROp::Phi) {
+                break;
+            }
+            int value = -1;
+            for (unsigned int j = 0; j < preds.size(); j++) {
+                if (in_loop[preds[j]] == l) {
+                    continue;
+                }
+                if (value >= 0 && inst.args[j] != value) {
+                    return -1;
+                }
+                value = inst.args[j];
+            }
+        }
+
+        int    pre = fun.new_block();
+        IRInst jmp;
+        jmp.op                = IROp::Jmp;
+        jmp.target[0]         = loop.header;
+        fun.blocks[pre].insts = { jmp };
+        fun.blocks[pre].succs = { loop.header };
+        fun.blocks[pre].preds = outside;
+        in_loop.push_back(-1);
+        rpo_place.push_back(rpo_place[loop.header] - 1);
+        for (int pred : outside) {
+            for (int &target : fun.blocks[pred].terminator().target) {
+                if (target == loop.header) {
+                    target = pre;
+                }
+            }
+            for (int &succ : fun.blocks[pred].succs) {
+                if (succ == loop.header) {
+                    succ = pre;
+                }
+            }
+        }
+
+        // The header now has one predecessor outside the loop, in place of
+        // the first of the old ones.
+        auto &header = fun.blocks[loop.header];
+        auto  keep   = [&](unsigned int j) {
+            return in_loop[header.preds[j]] == l
+                   || header.preds[j] == outside[0];
+        };
+        for (auto &inst : header.insts) {
+            if (inst.op != IROp::Phi) {
+                break;
+            }
+            std::vector<int> args;
+            for (unsigned int j = 0; j < header.preds.size(); j++) {
+                if (keep(j)) {
+                    args.push_back(inst.args[j]);
+                }
+            }
+            inst.args = std::move(args);
+        }
+        std::vector<int> new_preds;
+        for (unsigned int j = 0; j < header.preds.size(); j++) {
+            if (keep(j)) {
+                new_preds.push_back(in_loop[header.preds[j]] == l
+                                        ? header.preds[j]
+                                        : pre);
+            }
+        }
+        header.preds = std::move(new_preds);
+
+        // The preheader belongs to the loops around this one.
+        for (int outer = loop.parent; outer >= 0; outer = loops[outer].parent) {
+            loops[outer].blocks.push_back(pre);
+        }
+        return pre;
+    }
+
+    bool invariant(int l, int reg)
+    {
+        return hoisted[reg] >= 0 || def_block[reg] < 0
+               || in_loop[def_block[reg]] != l;
+    }
+
+    // Whether `inst` may move out of a loop storing to the globals in
+    // `stored`. Sets `may_fail` if it could raise an error.
+    bool movable(IRInst &inst, std::vector<bool> &stored, bool &may_fail)
+    {
+        may_fail = false;
+        switch (inst.op) {
+        case IROp::Const:
+        case IROp::ConstStr:
+        case IROp::Mov:
+        case IROp::UnOp: return true;
+        case IROp::BinOp:
+            may_fail = (inst.binop == Operator::Div
+                        || inst.binop == Operator::Rem)
+                       && !nonzero[inst.b];
+            return true;
+        case IROp::LoadGlobal: return !stored[inst.imm];
+        case IROp::Call: {
+            auto &callee = effects[inst.imm];
+            may_fail     = true;
+            if (inst.dst < 0 || !callee.pure()) {
+                return false;
+            }
+            for (unsigned int g = 0; g < stored.size(); g++) {
+                if (stored[g] && callee.reads[g]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default: return false;
+        }
+    }
+
+    // Whether `inst` is no dearer than the copy it would leave behind if
+    // hoisted out of a register with several definitions.
+    static bool cheap(IRInst &inst)
+    {
+        return inst.op == IROp::Const || inst.op == IROp::ConstStr
+               || inst.op == IROp::Mov;
+    }
+
+    bool hoist(int l)
+    {
+        for (int b : loops[l].blocks) {
+            in_loop[b] = l;
+        }
+        int pre = preheader(l);
+        if (pre < 0) {
+            return false;
+        }
+        auto &loop = loops[l];
+
+        std::vector<bool> stored(effects[fun.fun_idx].writes.size(), false);
+        for (int b : loop.blocks) {
+            for (auto &inst : fun.blocks[b].insts) {
+                if (inst.op == IROp::StoreGlobal) {
+                    stored[inst.imm] = true;
+                } else if (inst.op == IROp::Call) {
+                    auto &writes = effects[inst.imm].writes;
+                    for (unsigned int g = 0; g < stored.size(); g++) {
+                        stored[g] = stored[g] || writes[g];
+                    }
+                }
+            }
+        }
+
+        // In reverse postorder, operands are seen moving before the
+        // instructions that read them.
+        std::vector<int> blocks;
+        for (int b : loop.blocks) {
+            if (rpo_place[b] >= 0) {
+                blocks.push_back(b);
+            }
+        }
+        std::sort(blocks.begin(), blocks.end(), [&](int a, int b) {
+            return rpo_place[a] < rpo_place[b];
+        });
+
+        std::vector<IRInst> moved;
+        for (int b : blocks) {
+            bool                before_effects = b == loop.header;
+            std::vector<IRInst> insts;
+            for (auto &inst : fun.blocks[b].insts) {
+                bool may_fail;
+                bool can_move = movable(inst, stored, may_fail);
+                for_each_use(inst, [&](int reg) {
+                    can_move = can_move && invariant(l, reg);
+                });
+                if (may_fail && !before_effects) {
+                    can_move = false;
+                }
+                if (can_move && n_defs[origin(inst.dst)] > 1 && cheap(inst)) {
+                    can_move = false;
+                }
+                if (!can_move) {
+                    before_effects = before_effects && !may_fail
+                                     && inst.op != IROp::StoreGlobal
+                                     && inst.op != IROp::Call;
+                    insts.push_back(std::move(inst));
+                    continue;
+                }
+
+                for_each_use(inst, [&](int &reg) {
+                    if (hoisted[reg] >= 0) {
+                        reg = hoisted[reg];
+                    }
+                });
+
+                // A register assigned elsewhere too keeps its definition in
+                // the loop, copying from a register of its own (see
+                // destruct_ssa()).
+                if (n_defs[origin(inst.dst)] == 1) {
+                    def_block[inst.dst] = pre;
+                    moved.push_back(std::move(inst));
+                    continue;
+                }
+                int copy        = new_reg(fun.reg_types[inst.dst]);
+                def_block[copy] = pre;
+                nonzero[copy]   = nonzero[inst.dst];
+                hoisted[inst.dst] = copy;
+
+                IRInst mov;
+                mov.op   = IROp::Mov;
+                mov.dst  = inst.dst;
+                mov.a    = copy;
+                mov.pos  = inst.pos;
+                inst.dst = copy;
+                moved.push_back(std::move(inst));
+                insts.push_back(std::move(mov));
+            }
+            fun.blocks[b].insts = std::move(insts);
+        }
+
+        auto &pre_insts = fun.blocks[pre].insts;
+        pre_insts.insert(pre_insts.end() - 1,
+                         std::make_move_iterator(moved.begin()),
+                         std::make_move_iterator(moved.end()));
+        return !moved.empty();
+    }
+
+public:
+    LoopHoister(IRFunction &fun, const std::vector<FunctionEffects> &effects)
+        : fun(fun)
+        , effects(effects)
+    {
+    }
+
+    bool run()
+    {
+        if (find_loops(fun, compute_dominators(fun)).empty()) {
+            return false;
+        }
+
+        construct_ssa(fun);
+        loops = find_loops(fun, compute_dominators(fun));
+        analyze();
+        number_blocks();
+
+        bool changed = false;
+        for (unsigned int l = 0; l < loops.size(); l++) {
+            changed = hoist(l) || changed;
+        }
+
+        destruct_ssa(fun);
+        simplify_cfg(fun);
+        return changed;
+    }
+};
+
+bool
+hoist_loop_invariants(IRFunction                         &fun,
+                      const std::vector<FunctionEffects> &effects)
+{
+    LoopHoister hoister(fun, effects);
+    return hoister.run();
+}
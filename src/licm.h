@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "effects.h"
+#include "ir.h"
+
+// Loop-invariant code motion. Instructions in a loop whose operands are all
+// computed outside it (or by other such instructions) move to the loop's
+// preheader, a block run once on the way into the loop. A while loop tests
+// its condition once before the loop proper, and its preheader goes on the
+// edge into the body, so nothing hoisted runs when the otherwise block does.
+//
+// Loads of globals move if nothing in the loop may store to them, and calls
+// if `effects` shows the callee pure and reading no global the loop may
+// store to. The preheader runs even when the loop's first iteration would
+// not reach an instruction, so instructions that may fail (calls, which can
+// run out of stack, and divisions by anything but a nonzero constant) only
+// move from the loop's header, and only from before anything with a side
+// effect. Loops are processed innermost first, so code can move out through
+// several of them. Returns whether anything moved.
+bool
+hoist_loop_invariants(IRFunction                         &fun,
+                      const std::vector<FunctionEffects> &effects);
@@ -0,0 +1,158 @@
+#include "liveness.h"
+
+#include <algorithm>
+#include <climits>
+#include <iterator>
+
+// Adds the sorted registers of `src` to the sorted set `dst`.
+static void
+merge_into(std::vector<int> &dst, const std::vector<int> &src)
+{
+    size_t mid = dst.size();
+    dst.insert(dst.end(), src.begin(), src.end());
+    std::inplace_merge(dst.begin(), dst.begin() + mid, dst.end());
+    dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+}
+
+Liveness
+compute_liveness(IRFunction &fun)
+{
+    int n_blocks = fun.blocks.size();
+    int n_regs   = fun.n_regs();
+
+    // Upward-exposed uses of every block. `def_in` and `use_in` hold the last
+    // block each register was defined and used in, so that no list gets a
+    // register twice.
+    std::vector<std::vector<int>> uses(n_blocks);
+    std::vector<int>              def_in(n_regs, -1);
+    std::vector<int>              use_in(n_regs, -1);
+    std::vector<bool>             crosses(n_regs, false);
+
+    for (auto &block : fun.blocks) {
+        for (auto &inst : block.insts) {
+            for_each_use(inst, [&](int reg) {
+                if (def_in[reg] != block.id && use_in[reg] != block.id) {
+                    use_in[reg] = block.id;
+                    uses[block.id].push_back(reg);
+                    crosses[reg] = true;
+                }
+            });
+            if (inst.dst >= 0) {
+                def_in[inst.dst] = block.id;
+            }
+        }
+        std::sort(uses[block.id].begin(), uses[block.id].end());
+    }
+
+    // Definitions only matter for the registers some block has an
+    // upward-exposed use of; anything else is dead outside its block.
+    std::vector<std::vector<int>> defs(n_blocks);
+    std::fill(def_in.begin(), def_in.end(), -1);
+    for (auto &block : fun.blocks) {
+        for (auto &inst : block.insts) {
+            if (inst.dst >= 0 && crosses[inst.dst]
+                && def_in[inst.dst] != block.id) {
+                def_in[inst.dst] = block.id;
+                defs[block.id].push_back(inst.dst);
+            }
+        }
+        std::sort(defs[block.id].begin(), defs[block.id].end());
+    }
+
+    Liveness res;
+    res.live_in.resize(n_blocks);
+    res.live_out.resize(n_blocks);
+
+    // Iterate to a fixed point over a worklist of the reachable blocks,
+    // visiting them in postorder first so most information flows backwards
+    // in one pass. A block is visited again when the live-in set of one of
+    // its successors grows.
+    auto              work = reverse_postorder(fun);
+    std::vector<bool> reachable(n_blocks, false);
+    std::vector<bool> queued(n_blocks, false);
+    for (int id : work) {
+        reachable[id] = true;
+        queued[id]    = true;
+    }
+
+    std::vector<int> out;
+    std::vector<int> in;
+    while (!work.empty()) {
+        int id = work.back();
+        work.pop_back();
+        queued[id] = false;
+
+        auto &block = fun.blocks[id];
+        out.clear();
+        for (int succ : block.succs) {
+            merge_into(out, res.live_in[succ]);
+        }
+
+        in.clear();
+        std::set_difference(out.begin(),
+                            out.end(),
+                            defs[id].begin(),
+                            defs[id].end(),
+                            std::back_inserter(in));
+        merge_into(in, uses[id]);
+        res.live_out[id] = out;
+
+        if (in != res.live_in[id]) {
+            res.live_in[id] = in;
+            for (int pred : block.preds) {
+                if (reachable[pred] && !queued[pred]) {
+                    queued[pred] = true;
+                    work.push_back(pred);
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+std::vector<LiveInterval>
+build_intervals(IRFunction             &fun,
+                Liveness               &liveness,
+                const std::vector<int> &order,
+                std::vector<int>       &block_start)
+{
+    int n_regs = fun.n_regs();
+
+    std::vector<LiveInterval> intervals(n_regs);
+    for (int r = 0; r < n_regs; r++) {
+        intervals[r] = LiveInterval{ r, INT_MAX, INT_MIN };
+    }
+
+    auto extend = [&](int reg, int pos) {
+        intervals[reg].start = std::min(intervals[reg].start, pos);
+        intervals[reg].end   = std::max(intervals[reg].end, pos);
+    };
+
+    block_start.assign(fun.blocks.size(), -1);
+
+    int pos = 0;
+    for (int id : order) {
+        auto &block     = fun.blocks[id];
+        int   start     = pos;
+        block_start[id] = start;
+
+        for (auto &inst : block.insts) {
+            for_each_use(inst, [&](int reg) { extend(reg, pos); });
+            if (inst.dst >= 0) {
+                extend(inst.dst, pos + 1);
+            }
+            pos += 2;
+        }
+
+        int end = pos - 1;
+        for (int r : liveness.live_in[id]) {
+            extend(r, start);
+        }
+        for (int r : liveness.live_out[id]) {
+            extend(r, end);
+        }
+    }
+
+    return intervals;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "ir.h"
+
+// Calls f(reg) for every register an instruction reads. `f` may take the
+// register by reference to rewrite it.
+template <typename F>
+static void
+for_each_use(IRInst &inst, F f)
+{
+    switch (inst.op) {
+    case IROp::Const:
+    case IROp::ConstStr:
+    case IROp::LoadGlobal:
+    case IROp::Jmp: break;
+    case IROp::Mov:
+    case IROp::UnOp:
+    case IROp::StoreGlobal:
+    case IROp::Br: f(inst.a); break;
+    case IROp::BinOp:
+        f(inst.a);
+        f(inst.b);
+        break;
+    case IROp::Call:
+    case IROp::Phi:
+        for (int &arg : inst.args) {
+            f(arg);
+        }
+        break;
+    case IROp::Ret:
+        if (inst.a >= 0) {
+            f(inst.a);
+        }
+        break;
+    }
+}
+
+// Per-block sets of registers live on entry to and exit from each block, as
+// sorted lists. Only registers read in some block before being written there
+// can be live across blocks, and most registers are temporaries that never
+// are, so the sets stay small however many blocks and registers there are.
+struct Liveness {
+    std::vector<std::vector<int>> live_in;
+    std::vector<std::vector<int>> live_out;
+
+    bool is_live_in(int block, int reg) const
+    {
+        auto &in = live_in[block];
+        return std::binary_search(in.begin(), in.end(), reg);
+    }
+};
+
+Liveness
+compute_liveness(IRFunction &fun);
+
+// A conservative live range for one register over a linear numbering of the
+// instructions: every instruction gets two positions, the first for reading
+// its operands and the second for writing its result. A register is live from
+// `start` to `end` inclusive; empty ranges have start > end.
+struct LiveInterval {
+    int reg;
+    int start;
+    int end;
+};
+
+// Numbers instructions in the order the blocks appear in `order` and builds
+// one interval per register. `block_start` receives the first position of
+// every block.
+std::vector<LiveInterval>
+build_intervals(IRFunction             &fun,
+                Liveness               &liveness,
+                const std::vector<int> &order,
+                std::vector<int>       &block_start);
@@ -0,0 +1,747 @@
+#include "lower_ir.h"
+
+#include <algorithm>
+#include <climits>
+
+// The most copies of a repeat statement's body one trip around an unrolled
+// loop runs.
+constexpr int MAX_UNROLL_FACTOR = 8;
+
+static int
+stmts_size(std::list<std::unique_ptr<StmtNode>> &stmts, int unroll_size);
+
+static int
+exp_size(ExpNode *exp)
+{
+    switch (exp->kind) {
+    case ExpNode::IntExp:
+    case ExpNode::StringExp:
+    case ExpNode::VarExp: return 1;
+    case ExpNode::BinopExp: {
+        auto node = static_cast<BinOpNode *>(exp);
+        return 1 + exp_size(node->lhs.get()) + exp_size(node->rhs.get());
+    }
+    case ExpNode::UnopExp:
+        return 1 + exp_size(static_cast<UnOpNode *>(exp)->e.get());
+    case ExpNode::CallExp: {
+        int size = 1;
+        for (auto &arg : static_cast<CallNode *>(exp)->args) {
+            size += exp_size(arg.get());
+        }
+        return size;
+    }
+    }
+    return 1;
+}
+
+// How a repeat statement is lowered: its count is put in a counter, which a
+// loop running `factor` copies of the body takes down by `factor` while it
+// is at least that. The `rest` iterations left over are then run by copies
+// of the body after the loop, or by a loop of their own if `rest` is -1.
+// A factor of 0 leaves out the loop, and a factor of 1 with no rest is the
+// plain loop.
+struct Unrolling {
+    int factor = 1;
+    int rest   = 0;
+};
+
+static Unrolling
+plan_unrolling(RepeatNode *node, int body_size, int unroll_size)
+{
+    if (unroll_size == 0) {
+        return {};
+    }
+
+    int factor = std::min(MAX_UNROLL_FACTOR, unroll_size / body_size);
+    if (node->cond->kind == ExpNode::IntExp) {
+        int count = std::max(0, static_cast<IntNode *>(node->cond.get())->ival);
+        if ((int64_t)count * body_size <= unroll_size) {
+            return { 0, count };
+        }
+        return factor < 2 ? Unrolling{} : Unrolling{ factor, count % factor };
+    }
+    return factor < 2 ? Unrolling{} : Unrolling{ factor, -1 };
+}
+
+static int
+stmt_size(StmtNode *stmt, int unroll_size)
+{
+    switch (stmt->kind) {
+    case StmtNode::VardeclStmt:
+        return 1 + exp_size(static_cast<VardeclNode *>(stmt)->rhs.get());
+    case StmtNode::AssignStmt:
+        return 1 + exp_size(static_cast<AssignNode *>(stmt)->rhs.get());
+    case StmtNode::IfStmt: {
+        auto node = static_cast<IfNode *>(stmt);
+        return 1 + exp_size(node->cond.get())
+               + stmts_size(node->then_stmts, unroll_size)
+               + stmts_size(node->else_stmts, unroll_size);
+    }
+    case StmtNode::WhileStmt: {
+        auto node = static_cast<WhileNode *>(stmt);
+        return 1 + 2 * exp_size(node->cond.get())
+               + stmts_size(node->body_stmts, unroll_size)
+               + stmts_size(node->otherwise_stmts, unroll_size);
+    }
+    case StmtNode::RepeatStmt: {
+        auto node   = static_cast<RepeatNode *>(stmt);
+        int  body   = stmts_size(node->body_stmts, unroll_size);
+        auto plan   = plan_unrolling(node, body, unroll_size);
+        int  copies = plan.factor + (plan.rest < 0 ? 1 : plan.rest);
+        return 1 + exp_size(node->cond.get()) + copies * body;
+    }
+    case StmtNode::CallStmt: {
+        int size = 1;
+        for (auto &arg : static_cast<CallStmtNode *>(stmt)->args) {
+            size += exp_size(arg.get());
+        }
+        return size;
+    }
+    case StmtNode::FundecStmt: return 0;
+    case StmtNode::RetStmt: {
+        auto node = static_cast<RetNode *>(stmt);
+        return 1 + (node->ret_exp.has_value()
+                        ? exp_size(node->ret_exp.value().get())
+                        : 0);
+    }
+    }
+    return 1;
+}
+
+// The size of `stmts` in AST nodes once the repeat statements in them are
+// unrolled, counting each copy of a body.
+static int
+stmts_size(std::list<std::unique_ptr<StmtNode>> &stmts, int unroll_size)
+{
+    int size = 0;
+    for (auto &stmt : stmts) {
+        size = std::min(INT_MAX / 2, size + stmt_size(stmt.get(), unroll_size));
+    }
+    return std::max(size, 1);
+}
+
+// Builds the IR for one function, appending instructions to the current block.
+class IRBuilder {
+private:
+    IRFunction &fun;
+    int         cur_block = 0;
+
+    // Registers below this are parameters and locals; anything above is a
+    // temporary.
+    int n_slots;
+
+    // For an on-stack replacement entry: the loop to enter, the repeat
+    // statements on the way to it, whose counters are the parameters right
+    // after the slots, and the block to enter at once it has been lowered.
+    StmtNode                 *osr_loop = nullptr;
+    std::vector<RepeatNode *> osr_repeats;
+    int                       osr_block = -1;
+
+    // Where the body starts, for self tail calls to jump back to.
+    int body_block = -1;
+
+    // How big a repeat statement may grow by unrolling (see
+    // plan_unrolling()), or 0 not to unroll.
+    int unroll_size;
+
+    IRInst &emit(IROp op, int dst = -1, int a = -1, int b = -1)
+    {
+        IRInst inst;
+        inst.op  = op;
+        inst.dst = dst;
+        inst.a   = a;
+        inst.b   = b;
+
+        auto &insts = fun.blocks[cur_block].insts;
+        insts.push_back(std::move(inst));
+        return insts.back();
+    }
+
+    int emit_const(int64_t value)
+    {
+        int reg = fun.new_reg(Type::Int);
+        emit(IROp::Const, reg).imm = value;
+        return reg;
+    }
+
+    void emit_jmp(int target)
+    {
+        emit(IROp::Jmp).target[0] = target;
+    }
+
+    void emit_br(int cond, int if_true, int if_false)
+    {
+        auto &inst     = emit(IROp::Br, -1, cond);
+        inst.target[0] = if_true;
+        inst.target[1] = if_false;
+    }
+
+    // Starts emitting into a block. The previous block must already be
+    // terminated.
+    void switch_to(int block)
+    {
+        cur_block = block;
+    }
+
+    bool is_local(VarInfo &info)
+    {
+        return info.fun_idx != 0 && info.fun_idx == fun.fun_idx;
+    }
+
+    void lower_store(VarInfo &info, int value)
+    {
+        if (!is_local(info)) {
+            emit(IROp::StoreGlobal, -1, value).imm = info.frame_idx;
+            return;
+        }
+
+        // If the value was just computed into a fresh temporary, compute it
+        // straight into the variable's register instead of copying it.
+        auto &insts = fun.blocks[cur_block].insts;
+        if (value >= n_slots && !insts.empty() && insts.back().dst == value) {
+            insts.back().dst = info.frame_idx;
+            return;
+        }
+
+        emit(IROp::Mov, info.frame_idx, value);
+    }
+
+    int lower_logical(BinOpNode *node)
+    {
+        // a && b  =>  t = 0; if (a) t = (b != 0)
+        // a || b  =>  t = 1; if (!a) t = (b != 0)
+        bool is_and = node->op == Operator::And;
+        int  lhs    = lower_exp(node->lhs.get());
+        int  res    = fun.new_reg(Type::Int);
+
+        emit(IROp::Const, res).imm = is_and ? 0 : 1;
+
+        int rhs_block  = fun.new_block();
+        int join_block = fun.new_block();
+        if (is_and) {
+            emit_br(lhs, rhs_block, join_block);
+        } else {
+            emit_br(lhs, join_block, rhs_block);
+        }
+
+        switch_to(rhs_block);
+        int rhs  = lower_exp(node->rhs.get());
+        int zero = emit_const(0);
+        auto &ne = emit(IROp::BinOp, res, rhs, zero);
+        ne.binop = Operator::Ne;
+        emit_jmp(join_block);
+
+        switch_to(join_block);
+        return res;
+    }
+
+    int lower_call(FunInfo                               &info,
+                   std::vector<std::unique_ptr<ExpNode>> &args,
+                   SourcePos                              pos)
+    {
+        std::vector<int> arg_regs;
+        for (auto &arg : args) {
+            arg_regs.push_back(lower_exp(arg.get()));
+        }
+
+        int   dst = info.ret_type == Type::Void ? -1 : fun.new_reg(info.ret_type);
+        auto &inst = emit(IROp::Call, dst);
+        inst.imm   = info.var_idx_db;
+        inst.args  = std::move(arg_regs);
+        inst.pos   = pos;
+        return dst;
+    }
+
+    // return f(...) inside f: the arguments replace the parameters and
+    // control goes back to the start of the body. All arguments are computed
+    // before any parameter is assigned; a parameter passed on in a different
+    // position is copied first.
+    void lower_tail_call(CallNode *node)
+    {
+        int              argc = node->args.size();
+        std::vector<int> args;
+        for (auto &arg : node->args) {
+            args.push_back(lower_exp(arg.get()));
+        }
+
+        for (int i = 0; i < argc; i++) {
+            if (args[i] < argc && args[i] != i) {
+                int copy = fun.new_reg(fun.reg_types[args[i]]);
+                emit(IROp::Mov, copy, args[i]);
+                args[i] = copy;
+            }
+        }
+        for (int i = 0; i < argc; i++) {
+            if (args[i] != i) {
+                emit(IROp::Mov, i, args[i]);
+            }
+        }
+        emit_jmp(body_block);
+    }
+
+    int lower_exp(ExpNode *exp)
+    {
+        int reg = -1;
+
+        switch (exp->kind) {
+        case ExpNode::IntExp: {
+            reg = emit_const(dynamic_cast<IntNode *>(exp)->ival);
+            break;
+        }
+        case ExpNode::StringExp: {
+            reg = fun.new_reg(Type::String);
+            emit(IROp::ConstStr, reg).imm =
+                static_cast<StrNode *>(exp)->str_idx;
+            break;
+        }
+        case ExpNode::VarExp: {
+            auto &info = dynamic_cast<VarNode *>(exp)->var_info.value();
+            if (is_local(info)) {
+                // Expressions cannot assign, so reading the variable's own
+                // register is safe for the lifetime of the expression.
+                reg = info.frame_idx;
+            } else {
+                reg = fun.new_reg(info.var_type);
+                emit(IROp::LoadGlobal, reg).imm = info.frame_idx;
+            }
+            break;
+        }
+        case ExpNode::BinopExp: {
+            auto node = dynamic_cast<BinOpNode *>(exp);
+            if (node->op == Operator::And || node->op == Operator::Or) {
+                reg = lower_logical(node);
+                break;
+            }
+
+            int lhs    = lower_exp(node->lhs.get());
+            int rhs    = lower_exp(node->rhs.get());
+            reg        = fun.new_reg(Type::Int);
+            auto &inst = emit(IROp::BinOp, reg, lhs, rhs);
+            inst.binop = node->op;
+            inst.pos   = node->pos;
+            break;
+        }
+        case ExpNode::UnopExp: {
+            auto node  = dynamic_cast<UnOpNode *>(exp);
+            int  e     = lower_exp(node->e.get());
+            reg        = fun.new_reg(Type::Int);
+            emit(IROp::UnOp, reg, e).binop = node->op;
+            break;
+        }
+        case ExpNode::CallExp: {
+            auto node = dynamic_cast<CallNode *>(exp);
+            reg       = lower_call(node->fun_info.value(),
+                             node->args,
+                             node->pos);
+            break;
+        }
+        }
+
+        exp->reg = reg;
+        return reg;
+    }
+
+    // Runs `factor` copies of `body` for as long as `counter` is at least
+    // `factor`, taking that much off it each time. Returns the block that
+    // tests it.
+    int lower_counted_loop(int                                   counter,
+                           int                                   factor,
+                           std::list<std::unique_ptr<StmtNode>> &body)
+    {
+        int header_block = fun.new_block();
+        int body_block   = fun.new_block();
+        int exit_block   = fun.new_block();
+        emit_jmp(header_block);
+
+        switch_to(header_block);
+        int below = emit_const(factor - 1);
+        int test  = fun.new_reg(Type::Int);
+        emit(IROp::BinOp, test, counter, below).binop = Operator::Gt;
+        emit_br(test, body_block, exit_block);
+
+        switch_to(body_block);
+        for (int i = 0; i < factor; i++) {
+            lower_stmts(body);
+        }
+        int step = emit_const(factor);
+        emit(IROp::BinOp, counter, counter, step).binop = Operator::Sub;
+        emit_jmp(header_block);
+
+        switch_to(exit_block);
+        return header_block;
+    }
+
+    void lower_stmt(StmtNode *stmt)
+    {
+        switch (stmt->kind) {
+        case StmtNode::VardeclStmt: {
+            auto node = dynamic_cast<VardeclNode *>(stmt);
+            lower_store(node->var_info.value(), lower_exp(node->rhs.get()));
+            break;
+        }
+        case StmtNode::AssignStmt: {
+            auto node = dynamic_cast<AssignNode *>(stmt);
+            auto lhs  = dynamic_cast<VarNode *>(node->lhs.get());
+            lower_store(lhs->var_info.value(), lower_exp(node->rhs.get()));
+            break;
+        }
+        case StmtNode::IfStmt: {
+            auto node       = dynamic_cast<IfNode *>(stmt);
+            int  cond       = lower_exp(node->cond.get());
+            int  then_block = fun.new_block();
+            int  else_block = fun.new_block();
+            int  join_block = fun.new_block();
+            emit_br(cond, then_block, else_block);
+
+            switch_to(then_block);
+            lower_stmts(node->then_stmts);
+            emit_jmp(join_block);
+
+            switch_to(else_block);
+            lower_stmts(node->else_stmts);
+            emit_jmp(join_block);
+
+            switch_to(join_block);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            // The condition is tested once on entry, deciding between the body
+            // and the otherwise block, and again at the bottom of every
+            // iteration.
+            auto node            = dynamic_cast<WhileNode *>(stmt);
+            int  body_block      = fun.new_block();
+            int  otherwise_block = fun.new_block();
+            int  exit_block      = fun.new_block();
+
+            int cond = lower_exp(node->cond.get());
+            emit_br(cond, body_block, otherwise_block);
+
+            // The test at the bottom gets a block of its own, which is where
+            // on-stack replacement enters. Otherwise it is merged right back.
+            switch_to(body_block);
+            lower_stmts(node->body_stmts);
+            int test_block = fun.new_block();
+            emit_jmp(test_block);
+
+            switch_to(test_block);
+            if (stmt == osr_loop) {
+                osr_block = test_block;
+            }
+            cond = lower_exp(node->cond.get());
+            emit_br(cond, body_block, exit_block);
+
+            switch_to(otherwise_block);
+            lower_stmts(node->otherwise_stmts);
+            emit_jmp(exit_block);
+
+            switch_to(exit_block);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            // repeat (n) { body }  =>  i = n; while (i > 0) { body; i = i - 1; }
+            // The repeat statements on the way to the on-stack replacement
+            // loop keep that shape, with their counters passed in.
+            auto node    = dynamic_cast<RepeatNode *>(stmt);
+            auto on_path = std::find(osr_repeats.begin(),
+                                     osr_repeats.end(),
+                                     node);
+            Unrolling plan;
+            if (on_path == osr_repeats.end()) {
+                int body_size = stmts_size(node->body_stmts, unroll_size);
+                plan          = plan_unrolling(node, body_size, unroll_size);
+            }
+
+            if (plan.factor == 0) {
+                for (int i = 0; i < plan.rest; i++) {
+                    lower_stmts(node->body_stmts);
+                }
+                break;
+            }
+
+            int counter = on_path != osr_repeats.end()
+                              ? n_slots + (on_path - osr_repeats.begin())
+                              : fun.new_reg(Type::Int);
+            emit(IROp::Mov, counter, lower_exp(node->cond.get()));
+            int header_block = lower_counted_loop(
+                counter, plan.factor, node->body_stmts);
+            if (stmt == osr_loop) {
+                osr_block = header_block;
+            }
+
+            if (plan.rest < 0) {
+                lower_counted_loop(counter, 1, node->body_stmts);
+            }
+            for (int i = 0; i < plan.rest; i++) {
+                lower_stmts(node->body_stmts);
+            }
+            break;
+        }
+        case StmtNode::CallStmt: {
+            auto node = dynamic_cast<CallStmtNode *>(stmt);
+            int  dst  = lower_call(node->fun_info.value(),
+                                 node->args,
+                                 node->pos);
+            (void)dst;
+            break;
+        }
+        case StmtNode::FundecStmt: break; // Lowered separately
+        case StmtNode::RetStmt: {
+            auto node = dynamic_cast<RetNode *>(stmt);
+            if (node->tail_call) {
+                lower_tail_call(
+                    dynamic_cast<CallNode *>(node->ret_exp.value().get()));
+            } else {
+                int ret = -1;
+                if (node->ret_exp.has_value()) {
+                    ret = lower_exp(node->ret_exp.value().get());
+                }
+                emit(IROp::Ret, -1, ret);
+            }
+
+            // Anything after a return is unreachable; give it a block of its
+            // own so the CFG cleanup can drop it.
+            switch_to(fun.new_block());
+            break;
+        }
+        }
+    }
+
+public:
+    IRBuilder(IRFunction                      &fun,
+              int                              n_slots,
+              StmtNode                        *osr_loop,
+              const std::vector<RepeatNode *> &osr_repeats,
+              int                              unroll_size)
+        : fun(fun)
+        , n_slots(n_slots)
+        , osr_loop(osr_loop)
+        , osr_repeats(osr_repeats)
+        , unroll_size(unroll_size)
+    {
+        for (int i = 0; i < n_slots; i++) {
+            fun.new_reg(Type::Int);
+        }
+
+        if (osr_loop) {
+            for (unsigned int i = 0; i < osr_repeats.size(); i++) {
+                fun.new_reg(Type::Int);
+            }
+            fun.n_params = n_slots + osr_repeats.size();
+            fun.osr      = true;
+        }
+
+        // Block 0, the entry, is filled in at the end with a jump to the
+        // body, or into the loop for on-stack replacement, in which case the
+        // body is only reachable through self tail calls.
+        fun.new_block();
+        body_block = fun.new_block();
+        cur_block  = body_block;
+    }
+
+    void lower_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
+    {
+        lower_stmts(stmts.begin(), stmts.end());
+    }
+
+    void lower_stmts(std::list<std::unique_ptr<StmtNode>>::iterator begin,
+                     std::list<std::unique_ptr<StmtNode>>::iterator end)
+    {
+        for (auto stmt = begin; stmt != end; stmt++) {
+            lower_stmt(stmt->get());
+        }
+    }
+
+    // Terminates the last block with an implicit return and cleans up the CFG.
+    void finish()
+    {
+        int ret = -1;
+        if (fun.ret_type != Type::Void) {
+            ret = emit_const(0);
+        }
+        emit(IROp::Ret, -1, ret);
+
+        switch_to(0);
+        emit_jmp(osr_loop ? osr_block : body_block);
+
+        simplify_cfg(fun);
+    }
+};
+
+static bool
+find_loop(std::list<std::unique_ptr<StmtNode>> &stmts,
+          StmtNode                             *target,
+          std::vector<RepeatNode *>            &repeats);
+
+// Finds the path from `stmt` to the loop `target`, collecting the repeat
+// statements on it (including the target itself).
+static bool
+find_loop(StmtNode *stmt, StmtNode *target, std::vector<RepeatNode *> &repeats)
+{
+    switch (stmt->kind) {
+    case StmtNode::IfStmt: {
+        auto node = dynamic_cast<IfNode *>(stmt);
+        return find_loop(node->then_stmts, target, repeats)
+               || find_loop(node->else_stmts, target, repeats);
+    }
+    case StmtNode::WhileStmt: {
+        auto node = dynamic_cast<WhileNode *>(stmt);
+        return node == target || find_loop(node->body_stmts, target, repeats)
+               || find_loop(node->otherwise_stmts, target, repeats);
+    }
+    case StmtNode::RepeatStmt: {
+        auto node = dynamic_cast<RepeatNode *>(stmt);
+        repeats.push_back(node);
+        if (node == target || find_loop(node->body_stmts, target, repeats)) {
+            return true;
+        }
+        repeats.pop_back();
+        return false;
+    }
+    default: return false;
+    }
+}
+
+static bool
+find_loop(std::list<std::unique_ptr<StmtNode>> &stmts,
+          StmtNode                             *target,
+          std::vector<RepeatNode *>            &repeats)
+{
+    for (auto &stmt : stmts) {
+        if (find_loop(stmt.get(), target, repeats)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::vector<RepeatNode *>
+osr_path(std::list<std::unique_ptr<StmtNode>> &stmts, StmtNode *osr_loop)
+{
+    std::vector<RepeatNode *> repeats;
+    if (osr_loop && !find_loop(stmts, osr_loop, repeats)) {
+        perror("OSR loop not found");
+        exit(EXIT_FAILURE);
+    }
+    return repeats;
+}
+
+// Sets the types of a function's slot registers from its declarations.
+static void
+type_slots(IRFunction &fun, std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    for (auto &stmt : stmts) {
+        switch (stmt->kind) {
+        case StmtNode::VardeclStmt: {
+            auto &info = dynamic_cast<VardeclNode *>(stmt.get())->var_info.value();
+            if (info.fun_idx == fun.fun_idx && info.fun_idx != 0) {
+                fun.reg_types[info.frame_idx] = info.var_type;
+            }
+            break;
+        }
+        case StmtNode::IfStmt: {
+            auto node = dynamic_cast<IfNode *>(stmt.get());
+            type_slots(fun, node->then_stmts);
+            type_slots(fun, node->else_stmts);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            auto node = dynamic_cast<WhileNode *>(stmt.get());
+            type_slots(fun, node->body_stmts);
+            type_slots(fun, node->otherwise_stmts);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            auto node = dynamic_cast<RepeatNode *>(stmt.get());
+            type_slots(fun, node->body_stmts);
+            break;
+        }
+        default: break;
+        }
+    }
+}
+
+static int
+unroll_budget(const OptOptions &options)
+{
+    switch (options.level) {
+    case OptLevel::O0:
+    case OptLevel::O1: return 0;
+    case OptLevel::O2: return options.unroll_size;
+    case OptLevel::O3:
+        return options.unroll_size > INT_MAX / 2 ? INT_MAX
+                                                 : 2 * options.unroll_size;
+    }
+    return 0;
+}
+
+std::unique_ptr<IRFunction>
+lower_function(FundecNode *node, StmtNode *osr_loop, const OptOptions &options)
+{
+    auto fun      = std::make_unique<IRFunction>();
+    fun->name     = node->name;
+    fun->fun_idx  = node->fun_info->var_idx_db;
+    fun->n_params = node->params.size();
+    fun->ret_type = node->ret_type;
+
+    IRBuilder builder(*fun,
+                      node->frame_size,
+                      osr_loop,
+                      osr_path(node->body, osr_loop),
+                      unroll_budget(options));
+    for (unsigned int i = 0; i < node->params.size(); i++) {
+        fun->reg_types[i] = node->params[i].type;
+    }
+    type_slots(*fun, node->body);
+
+    builder.lower_stmts(node->body);
+    builder.finish();
+    return fun;
+}
+
+std::unique_ptr<IRFunction>
+lower_top_level(Program          &program,
+                StmtNode         *osr_loop,
+                const OptOptions &options)
+{
+    auto fun      = std::make_unique<IRFunction>();
+    fun->name     = "main";
+    fun->fun_idx  = 0;
+    fun->ret_type = Type::Int;
+
+    IRBuilder builder(*fun,
+                      0,
+                      osr_loop,
+                      osr_path(program.stmts, osr_loop),
+                      unroll_budget(options));
+
+    // An on-stack replacement entry never reaches the statements before the
+    // one holding its loop: they have run already, and nothing at the top
+    // level can jump back to them. Only the rest is lowered.
+    auto                      stmt = program.stmts.begin();
+    std::vector<RepeatNode *> repeats;
+    while (osr_loop && !find_loop(stmt->get(), osr_loop, repeats)) {
+        stmt++;
+    }
+    builder.lower_stmts(stmt, program.stmts.end());
+    builder.finish();
+    return fun;
+}
+
+IRProgram
+lower_program(Program &program, const OptOptions &options)
+{
+    IRProgram ir;
+    ir.n_globals = program.n_globals;
+    ir.funs.resize(program.funs.size());
+
+    ir.funs[0] = lower_top_level(program, nullptr, options);
+    for (auto fun : program.funs) {
+        if (fun != nullptr) {
+            ir.funs[fun->fun_info->var_idx_db] = lower_function(
+                fun, nullptr, options);
+        }
+    }
+
+    optimize_program(ir, options);
+    return ir;
+}
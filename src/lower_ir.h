@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+#include "ir.h"
+#include "pass_manager.h"
+#include "program.h"
+
+// Lowers a function body to IR. Every expression's ExpNode::reg is set to the
+// virtual register holding its value.
+//
+// Given `osr_loop`, a while or repeat statement in the body, the function is
+// instead lowered as an on-stack replacement entry into that loop: the entry
+// block jumps straight to the point where the loop's condition is tested
+// again after an iteration, with the state the rest of the function needs
+// passed in as parameters. These are the values of all the locals, in frame
+// slot order, followed by the iterations left in each repeat statement
+// enclosing the loop (or the loop itself), outermost first. The count for
+// the innermost repeat excludes the iteration that just finished; the counts
+// for the others include the iteration in progress.
+//
+// From O2 on, repeat statements other than those are unrolled: all the way
+// if the count is a constant and the copies of the body fit in
+// `options.unroll_size` AST nodes, otherwise by as many copies per iteration
+// as fit, with the iterations left over run after the loop.
+std::unique_ptr<IRFunction>
+lower_function(FundecNode       *fun,
+               StmtNode         *osr_loop = nullptr,
+               const OptOptions &options  = {});
+
+// Lowers the top-level statements to IR, as a function with no parameters
+// whose return value is the program's exit code. `osr_loop` and `options`
+// are as for lower_function(); the top level has no locals to pass in.
+std::unique_ptr<IRFunction>
+lower_top_level(Program          &program,
+                StmtNode         *osr_loop = nullptr,
+                const OptOptions &options  = {});
+
+// Lowers the whole program and optimizes it as `options` say.
+IRProgram
+lower_program(Program &program, const OptOptions &options = {});
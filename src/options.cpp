@@ -0,0 +1,127 @@
+#include "options.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const struct {
+    const char *name;
+    ExecEngine  engine;
+} engines[] = {
+    { "interp", ExecEngine::Interp },
+    { "bytecode", ExecEngine::Bytecode },
+    { "baseline", ExecEngine::Baseline },
+    { "jit", ExecEngine::Jit },
+    { "tiered", ExecEngine::Tiered },
+};
+
+const char *
+engine_name(ExecEngine engine)
+{
+    for (auto &e : engines) {
+        if (e.engine == engine) {
+            return e.name;
+        }
+    }
+
+    return "unknown";
+}
+
+static ExecEngine
+parse_engine(const char *name)
+{
+    for (auto &e : engines) {
+        if (strcmp(e.name, name) == 0) {
+            return e.engine;
+        }
+    }
+
+    std::cerr << "Error: unknown execution engine '" << name << "'"
+              << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+static int
+parse_threshold(const char *option, const char *value)
+{
+    char *end;
+    long  n = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 1 || n > INT32_MAX) {
+        std::cerr << "Error: " << option << " needs a positive count"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return n;
+}
+
+static int
+parse_budget(const char *option, const char *value)
+{
+    char *end;
+    long  n = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || n < 0 || n > INT32_MAX) {
+        std::cerr << "Error: " << option << " needs a non-negative count"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return n;
+}
+
+static OptLevel
+parse_level(const char *value)
+{
+    if (value[0] < '0' || value[0] > '3' || value[1] != '\0') {
+        std::cerr << "Error: -O needs a level from 0 to 3" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return (OptLevel)(value[0] - '0');
+}
+
+Options
+parse_options(int argc, char *argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strncmp(arg, "--exec=", 7) == 0) {
+            options.engine = parse_engine(arg + 7);
+        } else if (strncmp(arg, "-O", 2) == 0) {
+            options.opt.level = parse_level(arg + 2);
+        } else if (strncmp(arg, "--tier-calls=", 13) == 0) {
+            options.tier_calls = parse_threshold("--tier-calls", arg + 13);
+        } else if (strncmp(arg, "--tier-loops=", 13) == 0) {
+            options.tier_loops = parse_threshold("--tier-loops", arg + 13);
+        } else if (strncmp(arg, "--inline-size=", 14) == 0) {
+            options.opt.inline_budget.callee_size = parse_budget("--inline-size",
+                                                             arg + 14);
+        } else if (strncmp(arg, "--inline-growth=", 16) == 0) {
+            options.opt.inline_budget.growth = parse_budget("--inline-growth",
+                                                        arg + 16);
+        } else if (strncmp(arg, "--unroll-size=", 14) == 0) {
+            options.opt.unroll_size = parse_budget("--unroll-size", arg + 14);
+        } else if (strcmp(arg, "--stats") == 0) {
+            options.stats = true;
+        } else if (strcmp(arg, "--dump-ir") == 0) {
+            options.dump_ir = true;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            std::cerr << "Error: unknown option '" << arg << "'" << std::endl;
+            exit(EXIT_FAILURE);
+        } else {
+            options.path = arg;
+        }
+    }
+
+    if (options.path.empty()) {
+        // This should just switch to interactive mode
+        std::cerr << "Error: no input file" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#include "pass_manager.h"
+
+enum class ExecEngine { Interp, Bytecode, Baseline, Jit, Tiered };
+
+// Command line options. Usage:
+//
+//     albatross [--exec=<engine>] [-O<level>] [--tier-calls=<n>]
+//               [--tier-loops=<n>] [--inline-size=<n>] [--inline-growth=<n>]
+//               [--unroll-size=<n>] [--stats] [--dump-ir] <file>
+//
+// --exec        selects the execution engine (default: interp): interp walks
+//               the AST, bytecode runs the register VM, baseline compiles the
+//               AST straight to x86-64, jit compiles the optimized IR and
+//               tiered starts with baseline code and recompiles hot functions
+//               from the IR.
+// -O<level>     sets the optimization level, 0 to 3 (default: 2; see
+//               OptLevel).
+// --tier-calls  sets how many calls make a function hot (default: 1000).
+// --tier-loops  sets how many loop iterations make a function hot (default:
+//               10000).
+// --inline-size sets the most IR instructions a function may have to be
+//               inlined where it is called (default: 20); calls in loops
+//               allow HOT_CALL_FACTOR times as many. 0 turns inlining off.
+// --inline-growth sets how many instructions inlining may add to any one
+//               function (default: 400).
+// --unroll-size sets how many AST nodes a repeat statement may grow to when
+//               it is unrolled (default: 128). 0 turns unrolling off.
+// --stats       prints execution statistics, including how fast the source was
+//               lexed, to stderr when the program exits.
+// --dump-ir     prints the program's IR to stdout instead of running it.
+struct Options {
+    std::string path;
+    ExecEngine  engine     = ExecEngine::Interp;
+    int         tier_calls = 1000;
+    int         tier_loops = 10000;
+    OptOptions  opt;
+    bool        stats   = false;
+    bool        dump_ir = false;
+};
+
+Options
+parse_options(int argc, char *argv[]);
+
+const char *
+engine_name(ExecEngine engine);
@@ -1,7 +1,6 @@
 #include "parser.h"
 
 #include <cassert>
-#include <deque>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -12,44 +11,39 @@
 #include "lexer.h"
 #include "token.h"
 
-std::unique_ptr<Token>
-expect_any_token(std::deque<std::unique_ptr<Token>> &tokens)
+Token
+expect_any_token(TokenCursor &tokens)
 {
-    auto front = std::move(tokens.front());
-    if (front->type == TokenType::Eof) {
+    Token front = tokens.current();
+    if (front.type == TokenType::Eof) {
         throw AlbatrossError("Unexpected EOF at end of file",
-                             front->line_num,
-                             front->col_num,
+                             front.pos,
                              EXIT_PARSER_FAILURE);
     }
-    tokens.pop_front();
-    return front;
+    return tokens.next();
 }
 
 // Expect the next token in the stream to have a particular type. If not, fail
 // with an error on the token.
-std::unique_ptr<Token>
-expect_token_type(TokenType type, std::deque<std::unique_ptr<Token>> &tokens)
+Token
+expect_token_type(TokenType type, TokenCursor &tokens)
 {
-    auto front = std::move(tokens.front());
+    Token front = tokens.current();
 
-    if (front->type == TokenType::Eof) {
+    if (front.type == TokenType::Eof) {
         throw AlbatrossError("Unexpected EOF at end of file",
-                             front->line_num,
-                             front->col_num,
+                             front.pos,
                              EXIT_PARSER_FAILURE);
     }
 
-    if (front->type != type) {
+    if (front.type != type) {
         throw AlbatrossError("syntax error: unexpected token '"
-                                 + front->string_value + "'",
-                             front->line_num,
-                             front->col_num,
+                                 + std::string(front.text) + "'",
+                             front.pos,
                              EXIT_PARSER_FAILURE);
     }
 
-    tokens.pop_front();
-    return front;
+    return tokens.next();
 }
 
 struct OpInfo {
@@ -85,7 +79,7 @@ op_binding_power(TokenType op, bool minus_prefix_flag = false)
         return OpInfo{ Operator::Add, 165, 170, OpInfo::Infix };
     case TokenType::OpMinus:
         return minus_prefix_flag ?
-                   OpInfo{ Operator::Sub, -1, 190, OpInfo::Prefix } :
+                   OpInfo{ Operator::Neg, -1, 190, OpInfo::Prefix } :
                    OpInfo{ Operator::Sub, 165, 170, OpInfo::Infix };
     case TokenType::OpLt:
         return OpInfo{ Operator::Lt, 145, 150, OpInfo::Infix };
@@ -113,54 +107,53 @@ op_binding_power(TokenType op, bool minus_prefix_flag = false)
 }
 
 std::unique_ptr<ExpNode>
-parse_var_exp(std::deque<std::unique_ptr<Token>> &tokens)
+parse_var_exp(TokenCursor &tokens)
 {
-    auto tok       = expect_token_type(TokenType::Identifier, tokens);
-    auto name      = tok->string_value;
-    auto node      = std::make_unique<VarNode>();
-    node->name     = name;
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    auto tok   = expect_token_type(TokenType::Identifier, tokens);
+    auto name  = std::string(tok.text);
+    auto node  = std::make_unique<VarNode>();
+    node->name = name;
+    node->pos  = tok.pos;
     return node;
 }
 
 std::unique_ptr<ExpNode>
-parse_str_exp(std::deque<std::unique_ptr<Token>> &tokens)
+parse_str_exp(TokenCursor &tokens)
 {
     auto tok       = expect_token_type(TokenType::StrLiteral, tokens);
-    auto str       = tok->string_value;
+    auto text      = tok.text;
     auto node      = std::make_unique<StrNode>();
-    node->sval     = str;
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->str_idx  = text.find('\\') == std::string_view::npos ?
+                         string_pool.intern(text) :
+                         string_pool.intern(str_literal_value(text));
+    node->pos = tok.pos;
     return node;
 }
 
 std::unique_ptr<ExpNode>
-parse_int_exp(std::deque<std::unique_ptr<Token>> &tokens)
+parse_int_exp(TokenCursor &tokens)
 {
-    auto tok       = expect_token_type(TokenType::IntLiteral, tokens);
-    int  val       = std::atoi(tok->string_value.c_str());
-    auto node      = std::make_unique<IntNode>();
-    node->ival     = val;
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    auto tok   = expect_token_type(TokenType::IntLiteral, tokens);
+    int  val   = int_literal_value(tok.text);
+    auto node  = std::make_unique<IntNode>();
+    node->ival = val;
+    node->pos  = tok.pos;
     return node;
 }
 
 std::unique_ptr<ExpNode>
-parse_call_exp(std::deque<std::unique_ptr<Token>> &tokens)
+parse_call_exp(TokenCursor &tokens)
 {
     auto tok  = expect_token_type(TokenType::Identifier, tokens);
     auto node = std::make_unique<CallNode>();
-    auto name = tok->string_value;
+    auto name = std::string(tok.text);
 
     expect_token_type(TokenType::Lparen, tokens);
-    if (tokens.front()->type != TokenType::Rparen) {
+    if (tokens.peek() != TokenType::Rparen) {
         while (1) {
             auto arg = parse_exp(tokens);
             node->args.push_back(std::move(arg));
-            if (tokens.front()->type == TokenType::Comma) {
+            if (tokens.peek() == TokenType::Comma) {
                 expect_token_type(TokenType::Comma, tokens);
                 continue;
             } else {
@@ -172,29 +165,28 @@ parse_call_exp(std::deque<std::unique_ptr<Token>> &tokens)
         expect_token_type(TokenType::Rparen, tokens);
     }
 
-    node->name     = name;
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->name = name;
+    node->pos  = tok.pos;
     return node;
 }
 
 // Pratt's parse() function. Recursively builds an expression AST from a token
 // stream.
 std::unique_ptr<ExpNode>
-exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
+exp_bp(TokenCursor &tokens, int min_bp)
 {
     std::unique_ptr<ExpNode> lhs;
 
-    auto &front = tokens.front();
+    Token front = tokens.current();
 
-    switch (front->type) {
+    switch (front.type) {
     case TokenType::IntLiteral: {
         lhs = parse_int_exp(tokens);
         break;
     };
     case TokenType::Identifier: {
         // Check if this is a function call or just an identifier:
-        if (tokens.at(1)->type == TokenType::Lparen) {
+        if (tokens.peek(1) == TokenType::Lparen) {
             lhs = parse_call_exp(tokens);
         } else {
             lhs = parse_var_exp(tokens);
@@ -217,7 +209,7 @@ exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
 
     case TokenType::OpMinus:
     case TokenType::OpNot: {
-        OpInfo info = op_binding_power(tokens.front()->type, true);
+        OpInfo info = op_binding_power(tokens.peek(), true);
         assert(info.kind == OpInfo::Prefix);
         auto r_bp = info.r_bp;
 
@@ -225,26 +217,24 @@ exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
         auto tok = expect_any_token(tokens);
         auto rhs = exp_bp(tokens, r_bp);
 
-        lhs           = std::make_unique<UnOpNode>(info.op, rhs);
-        lhs->line_num = tok->line_num;
-        lhs->col_num  = tok->col_num;
+        lhs      = std::make_unique<UnOpNode>(info.op, rhs);
+        lhs->pos = tok.pos;
         break;
     }
 
     default:
         throw AlbatrossError("Expected an expression",
-                             front->line_num,
-                             front->col_num,
+                             front.pos,
                              EXIT_PARSER_FAILURE);
     }
 
     while (1) {
         // Check for EOF:
-        if (tokens.front()->type == TokenType::Eof) {
+        if (tokens.peek() == TokenType::Eof) {
             break;
         }
 
-        OpInfo info = op_binding_power(tokens.front()->type);
+        OpInfo info = op_binding_power(tokens.peek());
         if (info.kind == OpInfo::Postfix) {
             int l_bp = info.l_bp;
             if (l_bp < min_bp) {
@@ -254,9 +244,8 @@ exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
             // Consume op token
             auto tok = expect_any_token(tokens);
 
-            lhs           = std::make_unique<UnOpNode>(info.op, lhs);
-            lhs->line_num = tok->line_num;
-            lhs->col_num  = tok->col_num;
+            lhs      = std::make_unique<UnOpNode>(info.op, lhs);
+            lhs->pos = tok.pos;
             continue;
         }
 
@@ -271,10 +260,9 @@ exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
             auto tok = expect_any_token(tokens);
 
             // Now parse rhs
-            auto rhs      = exp_bp(tokens, r_bp);
-            lhs           = std::make_unique<BinOpNode>(info.op, lhs, rhs);
-            lhs->line_num = tok->line_num;
-            lhs->col_num  = tok->col_num;
+            auto rhs = exp_bp(tokens, r_bp);
+            lhs      = std::make_unique<BinOpNode>(info.op, lhs, rhs);
+            lhs->pos = tok.pos;
             continue;
         }
 
@@ -287,30 +275,29 @@ exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int min_bp)
 
 // Parse an expression from the token stream.
 std::unique_ptr<ExpNode>
-parse_exp(std::deque<std::unique_ptr<Token>> &tokens)
+parse_exp(TokenCursor &tokens)
 {
     return exp_bp(tokens, 0);
 }
 
 std::unique_ptr<StmtNode>
-parse_vardecl_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_vardecl_stmt(TokenCursor &tokens)
 {
     expect_token_type(TokenType::KeywordVar, tokens);
 
     auto tok  = expect_token_type(TokenType::Identifier, tokens);
-    auto name = tok->string_value;
-    auto type = str_to_type(
-        expect_token_type(TokenType::TypeName, tokens)->string_value);
+    auto name = std::string(tok.text);
+    auto type =
+        str_to_type(expect_token_type(TokenType::TypeName, tokens).text);
     expect_token_type(TokenType::Assign, tokens);
     std::unique_ptr<ExpNode> rhs = parse_exp(tokens);
     expect_token_type(TokenType::Semicolon, tokens);
 
-    auto node      = std::make_unique<VardeclNode>();
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
-    node->type     = type;
-    node->lhs      = name;
-    node->rhs      = std::move(rhs);
+    auto node  = std::make_unique<VardeclNode>();
+    node->pos  = tok.pos;
+    node->type = type;
+    node->lhs  = name;
+    node->rhs  = std::move(rhs);
 
 #ifdef COMPILE_STAGE_LEXER
 #ifdef COMPILE_STAGE_PARSER
@@ -326,7 +313,7 @@ parse_vardecl_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 }
 
 std::unique_ptr<StmtNode>
-parse_assign_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_assign_stmt(TokenCursor &tokens)
 {
     auto lhs = parse_exp(tokens);
     auto tok = expect_token_type(TokenType::Assign, tokens);
@@ -334,11 +321,10 @@ parse_assign_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 
     expect_token_type(TokenType::Semicolon, tokens);
 
-    auto node      = std::make_unique<AssignNode>();
-    node->lhs      = std::move(lhs);
-    node->rhs      = std::move(rhs);
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    auto node = std::make_unique<AssignNode>();
+    node->lhs = std::move(lhs);
+    node->rhs = std::move(rhs);
+    node->pos = tok.pos;
 
 #ifdef COMPILE_STAGE_LEXER
 #ifdef COMPILE_STAGE_PARSER
@@ -354,12 +340,12 @@ parse_assign_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 }
 
 std::unique_ptr<StmtNode>
-parse_return_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_return_stmt(TokenCursor &tokens)
 {
     auto tok  = expect_token_type(TokenType::KeywordReturn, tokens);
     auto node = std::make_unique<RetNode>();
 
-    if (tokens.front()->type != TokenType::Semicolon) {
+    if (tokens.peek() != TokenType::Semicolon) {
         auto ret_exp = parse_exp(tokens);
 #ifdef COMPILE_STAGE_LEXER
 #ifdef COMPILE_STAGE_PARSER
@@ -376,14 +362,13 @@ parse_return_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 
     expect_token_type(TokenType::Semicolon, tokens);
 
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->pos = tok.pos;
 
     return node;
 }
 
 std::unique_ptr<StmtNode>
-parse_if_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_if_stmt(TokenCursor &tokens)
 {
     auto tok  = expect_token_type(TokenType::KeywordIf, tokens);
     auto node = std::make_unique<IfNode>();
@@ -402,31 +387,30 @@ parse_if_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 #endif
 
     expect_token_type(TokenType::Lcurl, tokens);
-    while (tokens.front()->type != TokenType::Rcurl) {
+    while (tokens.peek() != TokenType::Rcurl) {
         node->then_stmts.push_back(parse_stmt(tokens));
     }
     expect_token_type(TokenType::Rcurl, tokens);
 
     // TODO: Add an EOF token so we don't have to do this kind of dumb checking.
-    if (!tokens.empty() && tokens.front()->type == TokenType::KeywordElse) {
+    if (tokens.peek() == TokenType::KeywordElse) {
         expect_token_type(TokenType::KeywordElse, tokens);
         expect_token_type(TokenType::Lcurl, tokens);
 
-        while (tokens.front()->type != TokenType::Rcurl) {
+        while (tokens.peek() != TokenType::Rcurl) {
             node->else_stmts.push_back(parse_stmt(tokens));
         }
 
         expect_token_type(TokenType::Rcurl, tokens);
     }
 
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->pos = tok.pos;
 
     return node;
 }
 
 std::unique_ptr<StmtNode>
-parse_while_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_while_stmt(TokenCursor &tokens)
 {
     auto tok   = expect_token_type(TokenType::KeywordWhile, tokens);
     auto node  = std::make_unique<WhileNode>();
@@ -442,29 +426,27 @@ parse_while_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 #endif
 
     expect_token_type(TokenType::Lcurl, tokens);
-    while (tokens.front()->type != TokenType::Rcurl) {
+    while (tokens.peek() != TokenType::Rcurl) {
         node->body_stmts.push_back(parse_stmt(tokens));
     }
     expect_token_type(TokenType::Rcurl, tokens);
 
-    if (!tokens.empty()
-        && tokens.front()->type == TokenType::KeywordOtherwise) {
+    if (tokens.peek() == TokenType::KeywordOtherwise) {
         expect_token_type(TokenType::KeywordOtherwise, tokens);
         expect_token_type(TokenType::Lcurl, tokens);
-        while (tokens.front()->type != TokenType::Rcurl) {
+        while (tokens.peek() != TokenType::Rcurl) {
             node->otherwise_stmts.push_back(parse_stmt(tokens));
         }
         expect_token_type(TokenType::Rcurl, tokens);
     }
 
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->pos = tok.pos;
 
     return node;
 }
 
 std::unique_ptr<StmtNode>
-parse_repeat_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_repeat_stmt(TokenCursor &tokens)
 {
     auto tok   = expect_token_type(TokenType::KeywordRepeat, tokens);
     auto node  = std::make_unique<RepeatNode>();
@@ -482,41 +464,40 @@ parse_repeat_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 
     expect_token_type(TokenType::Lcurl, tokens);
 
-    while (tokens.front()->type != TokenType::Rcurl) {
+    while (tokens.peek() != TokenType::Rcurl) {
         node->body_stmts.push_back(parse_stmt(tokens));
     }
 
     expect_token_type(TokenType::Rcurl, tokens);
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->pos = tok.pos;
     return node;
 }
 
 std::unique_ptr<StmtNode>
-parse_fundecl_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_fundecl_stmt(TokenCursor &tokens)
 {
     auto tok  = expect_token_type(TokenType::KeywordFun, tokens);
     auto node = std::make_unique<FundecNode>();
     auto fun_name =
-        expect_token_type(TokenType::Identifier, tokens)->string_value;
+        std::string(expect_token_type(TokenType::Identifier, tokens).text);
 
     // TODO: We can (maybe) make type declarations optional for functions.
     // Instead, infer from the types of all return statements in the function.
-    auto type = str_to_type(
-        expect_token_type(TokenType::TypeName, tokens)->string_value);
+    auto type =
+        str_to_type(expect_token_type(TokenType::TypeName, tokens).text);
     expect_token_type(TokenType::Lparen, tokens);
 
     std::vector<ParamNode> params;
-    if (tokens.front()->type != TokenType::Rparen) {
+    if (tokens.peek() != TokenType::Rparen) {
         while (1) {
-            auto param_name =
-                expect_token_type(TokenType::Identifier, tokens)->string_value;
+            auto param_name = std::string(
+                expect_token_type(TokenType::Identifier, tokens).text);
             auto param_type =
-                expect_token_type(TokenType::TypeName, tokens)->string_value;
+                expect_token_type(TokenType::TypeName, tokens).text;
 
             params.push_back(ParamNode{ param_name, str_to_type(param_type) });
 
-            if (tokens.front()->type == TokenType::Comma) {
+            if (tokens.peek() == TokenType::Comma) {
                 expect_token_type(TokenType::Comma, tokens);
                 continue;
             } else {
@@ -528,7 +509,7 @@ parse_fundecl_stmt(std::deque<std::unique_ptr<Token>> &tokens)
         expect_token_type(TokenType::Rparen, tokens);
     }
     expect_token_type(TokenType::Lcurl, tokens);
-    while (tokens.front()->type != TokenType::Rcurl) {
+    while (tokens.peek() != TokenType::Rcurl) {
         auto stmt = parse_stmt(tokens);
         node->body.push_back(std::move(stmt));
     }
@@ -537,26 +518,24 @@ parse_fundecl_stmt(std::deque<std::unique_ptr<Token>> &tokens)
     node->name     = fun_name;
     node->ret_type = type;
     node->params   = params;
-    node->line_num = tok->line_num;
-    node->col_num  = tok->col_num;
+    node->pos      = tok.pos;
     return node;
 }
 
 std::unique_ptr<StmtNode>
-parse_call_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_call_stmt(TokenCursor &tokens)
 {
-    auto token    = expect_token_type(TokenType::Identifier, tokens);
-    auto name     = token->string_value;
-    auto line_num = token->line_num;
-    auto col_num  = token->col_num;
-    auto node     = std::make_unique<CallStmtNode>();
+    auto token = expect_token_type(TokenType::Identifier, tokens);
+    auto name  = std::string(token.text);
+    auto pos   = token.pos;
+    auto node  = std::make_unique<CallStmtNode>();
 
     expect_token_type(TokenType::Lparen, tokens);
 
-    if (tokens.front()->type != TokenType::Rparen) {
+    if (tokens.peek() != TokenType::Rparen) {
         while (1) {
             node->args.push_back(parse_exp(tokens));
-            if (tokens.front()->type == TokenType::Comma) {
+            if (tokens.peek() == TokenType::Comma) {
                 expect_token_type(TokenType::Comma, tokens);
                 continue;
             } else {
@@ -571,9 +550,8 @@ parse_call_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 
     expect_token_type(TokenType::Semicolon, tokens);
 
-    node->name     = name;
-    node->line_num = line_num;
-    node->col_num  = col_num;
+    node->name = name;
+    node->pos  = pos;
 
 #ifdef COMPILE_STAGE_LEXER
 #ifdef COMPILE_STAGE_PARSER
@@ -603,14 +581,14 @@ parse_call_stmt(std::deque<std::unique_ptr<Token>> &tokens)
 }
 
 std::unique_ptr<StmtNode>
-parse_stmt(std::deque<std::unique_ptr<Token>> &tokens)
+parse_stmt(TokenCursor &tokens)
 {
     // Parse a top-level statement and return its AST.
-    const auto &front = tokens.front();
+    Token front = tokens.current();
 
-    switch (front->type) {
+    switch (front.type) {
     case TokenType::Identifier: {
-        if (tokens.at(1)->type != TokenType::Lparen) {
+        if (tokens.peek(1) != TokenType::Lparen) {
             return parse_assign_stmt(tokens);
         } else {
             return parse_call_stmt(tokens);
@@ -624,17 +602,16 @@ parse_stmt(std::deque<std::unique_ptr<Token>> &tokens)
     case TokenType::KeywordFun: return parse_fundecl_stmt(tokens);
     default:
         throw AlbatrossError("expected a statement",
-                             front->line_num,
-                             front->col_num,
+                             front.pos,
                              EXIT_PARSER_FAILURE);
     }
 }
 
 std::list<std::unique_ptr<StmtNode>>
-parse_stmts(std::deque<std::unique_ptr<Token>> &tokens)
+parse_stmts(TokenCursor &tokens)
 {
     std::list<std::unique_ptr<StmtNode>> stmts;
-    while (tokens.front()->type != TokenType::Eof) {
+    while (tokens.peek() != TokenType::Eof) {
         stmts.push_back(parse_stmt(tokens));
     }
     return stmts;
@@ -1,26 +1,58 @@
 #pragma once
 
-#include <deque>
-#include <unordered_map>
-#include <vector>
+#include <list>
+#include <memory>
 
 #include "ast.h"
 #include "token.h"
 
-std::unique_ptr<Token>
-expect_any_token(std::deque<std::unique_ptr<Token>> &tokens);
-std::unique_ptr<Token>
-expect_token_type(TokenType type, std::deque<std::unique_ptr<Token>> &tokens);
+// The parser's position in a TokenStream. Reading a token only moves the
+// cursor, so the stream itself is never modified.
+class TokenCursor {
+private:
+    const TokenStream &tokens;
+    size_t             pos = 0;
+
+public:
+    TokenCursor(const TokenStream &tokens)
+        : tokens(tokens)
+    {
+    }
+
+    // The type of the token `ahead` places after the current one. Reading
+    // past the end gives the closing Eof.
+    TokenType peek(size_t ahead = 0) const
+    {
+        size_t i = pos + ahead;
+        return i < tokens.size() ? tokens.types[i] : TokenType::Eof;
+    }
+
+    Token current() const
+    {
+        return tokens[pos];
+    }
+
+    // Returns the current token and moves past it.
+    Token next()
+    {
+        return tokens[pos++];
+    }
+};
+
+Token
+expect_any_token(TokenCursor &tokens);
+Token
+expect_token_type(TokenType type, TokenCursor &tokens);
 std::unique_ptr<ExpNode>
-parse_int_exp(std::deque<std::unique_ptr<Token>> &tokens);
+parse_int_exp(TokenCursor &tokens);
 
 std::unique_ptr<ExpNode>
-exp_bp(std::deque<std::unique_ptr<Token>> &tokens, int bp);
+exp_bp(TokenCursor &tokens, int bp);
 std::unique_ptr<ExpNode>
-parse_exp(std::deque<std::unique_ptr<Token>> &tokens);
+parse_exp(TokenCursor &tokens);
 
 std::unique_ptr<StmtNode>
-parse_stmt(std::deque<std::unique_ptr<Token>> &tokens);
+parse_stmt(TokenCursor &tokens);
 
 std::list<std::unique_ptr<StmtNode>>
-parse_stmts(std::deque<std::unique_ptr<Token>> &tokens);
+parse_stmts(TokenCursor &tokens);
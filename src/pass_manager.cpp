@@ -0,0 +1,226 @@
+#include "pass_manager.h"
+
+#include <cstdint>
+#include <iterator>
+
+#include "call_folding.h"
+#include "dead_stores.h"
+#include "gvn.h"
+#include "licm.h"
+#include "ranges.h"
+#include "sccp.h"
+#include "ssa.h"
+#include "transform_ast.h"
+
+// How many times one pass may run on a function. Passes report a change only
+// when they make one, so this only guards against two of them undoing each
+// other's work forever.
+constexpr int MAX_PASS_RUNS = 8;
+
+static void
+optimize_block(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    for (auto &stmt : stmts) {
+        switch (stmt->kind) {
+        case StmtNode::IfStmt: {
+            auto node = dynamic_cast<IfNode *>(stmt.get());
+            optimize_block(node->then_stmts);
+            optimize_block(node->else_stmts);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            auto node = dynamic_cast<WhileNode *>(stmt.get());
+            optimize_block(node->body_stmts);
+            optimize_block(node->otherwise_stmts);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            auto node = dynamic_cast<RepeatNode *>(stmt.get());
+            optimize_block(node->body_stmts);
+            break;
+        }
+        case StmtNode::FundecStmt: {
+            auto node = dynamic_cast<FundecNode *>(stmt.get());
+            optimize_block(node->body);
+            break;
+        }
+        default: break;
+        }
+    }
+
+    // Pruning lifts statements out of nested lists that are already done,
+    // but a condition only becomes constant once it is folded here.
+    bool dirty = true;
+    while (dirty) {
+        dirty = false;
+        for (auto &stmt : stmts) {
+            dirty |= fold_stmt(stmt.get());
+        }
+        dirty |= dce_stmts(stmts);
+    }
+}
+
+void
+optimize_ast(std::list<std::unique_ptr<StmtNode>> &stmts, OptLevel level)
+{
+    if (level >= OptLevel::O1) {
+        optimize_block(stmts);
+        if (fold_constant_calls(stmts)) {
+            optimize_block(stmts);
+        }
+        eliminate_dead_stores(stmts);
+    }
+}
+
+struct PassContext {
+    IRProgram                          &library;
+    const std::vector<FunctionEffects> &effects;
+    InlineBudget                        inline_budget;
+};
+
+static bool
+propagate(IRFunction &fun, PassContext &)
+{
+    construct_ssa(fun);
+    bool changed = propagate_constants(fun);
+    destruct_ssa(fun);
+    simplify_cfg(fun);
+    return changed;
+}
+
+static bool
+inline_into(IRFunction &fun, PassContext &ctx)
+{
+    return inline_calls(fun, ctx.library, ctx.inline_budget);
+}
+
+static bool
+number(IRFunction &fun, PassContext &ctx)
+{
+    return number_values(fun, ctx.effects);
+}
+
+static bool
+narrow(IRFunction &fun, PassContext &)
+{
+    return narrow_ranges(fun);
+}
+
+static bool
+hoist(IRFunction &fun, PassContext &ctx)
+{
+    return hoist_loop_invariants(fun, ctx.effects);
+}
+
+struct FunctionPass {
+    OptLevel level; // the lowest level it runs at
+    bool     once;  // whether it runs only once per function
+    bool (*run)(IRFunction &fun, PassContext &ctx);
+};
+
+// Each pass returns whether it changed the function.
+static const FunctionPass pipeline[] = {
+    { OptLevel::O1, false, propagate },
+    { OptLevel::O2, true, inline_into },
+    { OptLevel::O2, false, number },
+    { OptLevel::O2, false, hoist },
+    { OptLevel::O2, false, narrow },
+};
+
+constexpr int N_PASSES = std::size(pipeline);
+
+static void
+run_passes(IRFunction &fun, PassContext &ctx, OptLevel level)
+{
+    int  runs[N_PASSES] = {};
+    bool pending[N_PASSES];
+    for (int i = 0; i < N_PASSES; i++) {
+        pending[i] = pipeline[i].level <= level;
+    }
+
+    for (int i = 0; i < N_PASSES;) {
+        if (!pending[i]) {
+            i++;
+            continue;
+        }
+        pending[i] = false;
+        runs[i]++;
+        if (!pipeline[i].run(fun, ctx)) {
+            i++;
+            continue;
+        }
+
+        // Everything else has a changed function to look at again, starting
+        // from the first pass.
+        for (int j = 0; j < N_PASSES; j++) {
+            pending[j] = j != i && pipeline[j].level <= level
+                         && !(pipeline[j].once && runs[j] > 0)
+                         && runs[j] < MAX_PASS_RUNS;
+        }
+        i = 0;
+    }
+}
+
+static void
+add_callees_first(IRProgram        &program,
+                  int               fun_idx,
+                  std::vector<bool> &seen,
+                  std::vector<int>  &order)
+{
+    seen[fun_idx] = true;
+    for (auto &block : program.funs[fun_idx]->blocks) {
+        for (auto &inst : block.insts) {
+            if (inst.op == IROp::Call && program.funs[inst.imm]
+                && !seen[inst.imm]) {
+                add_callees_first(program, inst.imm, seen, order);
+            }
+        }
+    }
+    order.push_back(fun_idx);
+}
+
+static InlineBudget
+inline_budget(const OptOptions &options)
+{
+    auto doubled = [](int n) { return n > INT32_MAX / 2 ? INT32_MAX : 2 * n; };
+
+    InlineBudget budget = options.inline_budget;
+    if (options.level >= OptLevel::O3) {
+        budget.callee_size = doubled(budget.callee_size);
+        budget.growth      = doubled(budget.growth);
+    }
+    return budget;
+}
+
+void
+optimize_program(IRProgram &program, const OptOptions &options)
+{
+    // Passes only ever take effects away, so a summary of the unoptimized
+    // program stays safe to use while it changes.
+    std::vector<FunctionEffects> effects;
+    if (options.level >= OptLevel::O2) {
+        effects = compute_effects(program);
+    }
+    PassContext ctx = { program, effects, inline_budget(options) };
+
+    std::vector<bool> seen(program.funs.size(), false);
+    std::vector<int>  order;
+    for (unsigned int f = 0; f < program.funs.size(); f++) {
+        if (program.funs[f] && !seen[f]) {
+            add_callees_first(program, f, seen, order);
+        }
+    }
+    for (int f : order) {
+        run_passes(*program.funs[f], ctx, options.level);
+    }
+}
+
+void
+optimize_function(IRFunction                         &fun,
+                  IRProgram                          &library,
+                  const std::vector<FunctionEffects> &effects,
+                  const OptOptions                   &options)
+{
+    PassContext ctx = { library, effects, inline_budget(options) };
+    run_passes(fun, ctx, options.level);
+}
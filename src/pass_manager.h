@@ -0,0 +1,57 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+#include "effects.h"
+#include "inline.h"
+#include "ir.h"
+
+// How hard the compiler works on the program, chosen with -O<n>:
+//
+// O0  only cleans up the CFG lowering leaves behind.
+// O1  folds, simplifies and prunes the AST, evaluating calls on constants,
+//     and propagates constants through the IR.
+// O2  also inlines calls, numbers values to share common subexpressions,
+//     hoists loop-invariant code, unrolls repeat statements and bounds
+//     values to drop division checks and decided comparisons (the default).
+// O3  also doubles the inlining and unrolling budgets.
+//
+// Self tail calls are turned into jumps at every level.
+enum class OptLevel { O0, O1, O2, O3 };
+
+// `unroll_size` is how many AST nodes one repeat statement may grow to when
+// its body is copied by unrolling (see lower_program()).
+struct OptOptions {
+    OptLevel     level = OptLevel::O2;
+    InlineBudget inline_budget;
+    int          unroll_size = 128;
+};
+
+// Folds and prunes the AST: every statement list, nested lists before the
+// list around them. No rewrite looks outside the list it is in, so a list is
+// only gone over again while its own statements keep changing, and never
+// because of one elsewhere; each function is done once. Calls left with
+// constant arguments are then evaluated (see fold_constant_calls()), and the
+// whole program folded once more if any was.
+void
+optimize_ast(std::list<std::unique_ptr<StmtNode>> &stmts, OptLevel level);
+
+// Runs the IR passes for `options.level` over every function of `program`,
+// callees before their callers so that what gets inlined is already
+// optimized. Within a function the passes run in a fixed order, and a pass
+// runs again only if another one changed the function after it last ran;
+// inlining runs once.
+void
+optimize_program(IRProgram &program, const OptOptions &options);
+
+// Optimizes `fun`, which is not part of `library` (an on-stack replacement
+// entry) but calls into it, as optimize_program() would. `effects`
+// summarizes `library`.
+void
+optimize_function(IRFunction                         &fun,
+                  IRProgram                          &library,
+                  const std::vector<FunctionEffects> &effects,
+                  const OptOptions                   &options);
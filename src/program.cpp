@@ -0,0 +1,71 @@
+#include "program.h"
+
+#include <algorithm>
+
+#include "builtins.h"
+
+static void
+collect_stmts(Program &program, std::list<std::unique_ptr<StmtNode>> &stmts);
+
+static void
+collect_stmt(Program &program, StmtNode *stmt)
+{
+    switch (stmt->kind) {
+    case StmtNode::VardeclStmt: {
+        // Function bodies are sized by the symbol resolver, so only the
+        // top-level frame has to be measured here.
+        auto &info = dynamic_cast<VardeclNode *>(stmt)->var_info.value();
+        if (info.fun_idx == 0) {
+            program.n_globals = std::max(program.n_globals, info.frame_idx + 1);
+        }
+        break;
+    }
+    case StmtNode::IfStmt: {
+        auto node = dynamic_cast<IfNode *>(stmt);
+        collect_stmts(program, node->then_stmts);
+        collect_stmts(program, node->else_stmts);
+        break;
+    }
+    case StmtNode::WhileStmt: {
+        auto node = dynamic_cast<WhileNode *>(stmt);
+        collect_stmts(program, node->body_stmts);
+        collect_stmts(program, node->otherwise_stmts);
+        break;
+    }
+    case StmtNode::RepeatStmt: {
+        auto node = dynamic_cast<RepeatNode *>(stmt);
+        collect_stmts(program, node->body_stmts);
+        break;
+    }
+    case StmtNode::FundecStmt: {
+        auto node = dynamic_cast<FundecNode *>(stmt);
+        int  idx  = node->fun_info->var_idx_db;
+        if ((int)program.funs.size() <= idx) {
+            program.funs.resize(idx + 1, nullptr);
+        }
+        program.funs[idx] = node;
+        collect_stmts(program, node->body);
+        break;
+    }
+    case StmtNode::AssignStmt:
+    case StmtNode::CallStmt:
+    case StmtNode::RetStmt: break;
+    }
+}
+
+static void
+collect_stmts(Program &program, std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    for (auto &stmt : stmts) {
+        collect_stmt(program, stmt.get());
+    }
+}
+
+Program
+collect_program(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    Program program(stmts);
+    program.funs.resize(FIRST_USER_FUN_IDX, nullptr);
+    collect_stmts(program, stmts);
+    return program;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+
+// A resolved, typechecked program as the execution engines see it: the
+// top-level statement list plus a table of every function declaration.
+struct Program {
+    std::list<std::unique_ptr<StmtNode>> &stmts;
+
+    // Indexed by FunInfo::var_idx_db. Builtins have no declaration and map to
+    // nullptr.
+    std::vector<FundecNode *> funs;
+
+    // Number of slots in the top-level frame, i.e. the global variables.
+    int n_globals = 0;
+
+    Program(std::list<std::unique_ptr<StmtNode>> &stmts)
+        : stmts(stmts)
+    {
+    }
+};
+
+// Builds the function table and sizes the global frame. This has to run after
+// the AST optimizations, since they may delete or move declarations.
+Program
+collect_program(std::list<std::unique_ptr<StmtNode>> &stmts);
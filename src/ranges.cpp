@@ -0,0 +1,647 @@
+#include "ranges.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "liveness.h"
+#include "runtime.h"
+#include "ssa.h"
+
+// How many times a register's interval may grow before its moving bounds
+// are pushed to the int limits.
+constexpr int WIDEN_AFTER = 2;
+
+// How many times the widened ranges are gone over again to narrow them.
+constexpr int NARROW_ROUNDS = 2;
+
+// How many of the conditions holding in the blocks a read is dominated by
+// narrow it, nearest first. A register tested over and over, like a loop
+// bound, would otherwise cost each read every test before it.
+constexpr int MAX_DOMINATING_CONDITIONS = 8;
+
+// The values a register may hold: the ints from `lo` to `hi`, leaving out 0
+// if `nonzero` is set. An empty interval (lo > hi) means no value reaches
+// the register yet.
+struct Range {
+    int64_t lo      = 1;
+    int64_t hi      = 0;
+    bool    nonzero = false;
+
+    bool empty() const
+    {
+        return lo > hi;
+    }
+
+    bool contains(int64_t value) const
+    {
+        return lo <= value && value <= hi && !(value == 0 && nonzero);
+    }
+
+    bool is_const() const
+    {
+        return lo == hi;
+    }
+
+    // Moves a bound off 0 if 0 is left out, and drops `nonzero` where it
+    // says nothing the bounds do not.
+    Range normalized() const
+    {
+        Range r = *this;
+        if (r.nonzero && r.lo == 0) {
+            r.lo = 1;
+        }
+        if (r.nonzero && r.hi == 0) {
+            r.hi = -1;
+        }
+        r.nonzero = r.nonzero && r.lo < 0 && r.hi > 0;
+        return r;
+    }
+
+    bool operator==(const Range &) const = default;
+};
+
+static Range
+full()
+{
+    return Range{ INT_MIN, INT_MAX };
+}
+
+static Range
+between(int64_t lo, int64_t hi)
+{
+    // Arithmetic that can leave the int range wraps, and then the result
+    // could be anything.
+    if (lo < INT_MIN || hi > INT_MAX) {
+        return full();
+    }
+    return Range{ lo, hi };
+}
+
+static Range
+join(Range a, Range b)
+{
+    if (a.empty()) {
+        return b;
+    }
+    if (b.empty()) {
+        return a;
+    }
+    return Range{ std::min(a.lo, b.lo),
+                  std::max(a.hi, b.hi),
+                  !a.contains(0) && !b.contains(0) }
+        .normalized();
+}
+
+// The range of `a op b` for a comparison: [1, 1] if it always holds, [0, 0]
+// if it never does.
+static Range
+compare(Operator op, Range a, Range b)
+{
+    bool always = false;
+    bool never  = false;
+    switch (op) {
+    case Operator::Lt:
+        always = a.hi < b.lo;
+        never  = a.lo >= b.hi;
+        break;
+    case Operator::Le:
+        always = a.hi <= b.lo;
+        never  = a.lo > b.hi;
+        break;
+    case Operator::Gt:
+        always = a.lo > b.hi;
+        never  = a.hi <= b.lo;
+        break;
+    case Operator::Ge:
+        always = a.lo >= b.hi;
+        never  = a.hi < b.lo;
+        break;
+    case Operator::Eq:
+    case Operator::Ne: {
+        bool same     = a.is_const() && b.is_const() && a.lo == b.lo;
+        bool disjoint = a.hi < b.lo || b.hi < a.lo
+                        || (a.is_const() && !b.contains(a.lo))
+                        || (b.is_const() && !a.contains(b.lo));
+        always        = op == Operator::Eq ? same : disjoint;
+        never         = op == Operator::Eq ? disjoint : same;
+        break;
+    }
+    default: break;
+    }
+    return always ? Range{ 1, 1 } : never ? Range{ 0, 0 } : Range{ 0, 1 };
+}
+
+static int64_t
+magnitude(Range r)
+{
+    return std::max(r.lo < 0 ? -r.lo : r.lo, r.hi < 0 ? -r.hi : r.hi);
+}
+
+static Range
+binop_range(Operator op, Range a, Range b)
+{
+    switch (op) {
+    case Operator::Add: return between(a.lo + b.lo, a.hi + b.hi);
+    case Operator::Sub: return between(a.lo - b.hi, a.hi - b.lo);
+    case Operator::Mul: {
+        int64_t p[] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+        auto [lo, hi] = std::minmax_element(p, p + 4);
+        return between(*lo, *hi);
+    }
+    case Operator::Div: {
+        // Only divisions that do not fail get a result.
+        if (a.lo >= 0 && b.lo > 0) {
+            return Range{ a.lo / b.hi, a.hi / b.lo };
+        }
+        int64_t m = magnitude(a);
+        return between(-m, m);
+    }
+    case Operator::Rem: {
+        // The remainder has the sign of the dividend and is smaller than
+        // the divisor.
+        int64_t m = std::min(magnitude(a), magnitude(b) - 1);
+        if (a.lo >= 0) {
+            return Range{ 0, m };
+        }
+        if (a.hi <= 0) {
+            return Range{ -m, 0 };
+        }
+        return Range{ -m, m };
+    }
+    case Operator::Band:
+        if (a.lo >= 0 || b.lo >= 0) {
+            return Range{ 0, a.lo >= 0 && b.lo >= 0 ? std::min(a.hi, b.hi)
+                             : a.lo >= 0            ? a.hi
+                                                    : b.hi };
+        }
+        return full();
+    case Operator::Bor:
+    case Operator::Xor:
+        if (a.lo >= 0 && b.lo >= 0) {
+            int64_t bits = 1;
+            while (bits <= std::max(a.hi, b.hi)) {
+                bits *= 2;
+            }
+            return Range{ 0, bits - 1 };
+        }
+        return full();
+    case Operator::And:
+        if (a == Range{ 0, 0 } || b == Range{ 0, 0 }) {
+            return Range{ 0, 0 };
+        }
+        return !a.contains(0) && !b.contains(0) ? Range{ 1, 1 }
+                                                : Range{ 0, 1 };
+    case Operator::Or:
+        if (!a.contains(0) || !b.contains(0)) {
+            return Range{ 1, 1 };
+        }
+        return a == Range{ 0, 0 } && b == Range{ 0, 0 } ? Range{ 0, 0 }
+                                                        : Range{ 0, 1 };
+    default: return compare(op, a, b);
+    }
+}
+
+static Range
+unop_range(Operator op, Range a)
+{
+    if (op == Operator::Neg) {
+        // -INT_MIN wraps to INT_MIN, which is not 0 either.
+        Range r   = between(-a.hi, -a.lo);
+        r.nonzero = !a.contains(0);
+        return r.normalized();
+    }
+    return a == Range{ 0, 0 } ? Range{ 1, 1 }
+           : a.contains(0)    ? Range{ 0, 1 }
+                              : Range{ 0, 0 };
+}
+
+// The comparison that holds when `a op b` does not.
+static Operator
+negate(Operator op)
+{
+    switch (op) {
+    case Operator::Lt: return Operator::Ge;
+    case Operator::Le: return Operator::Gt;
+    case Operator::Gt: return Operator::Le;
+    case Operator::Ge: return Operator::Lt;
+    case Operator::Eq: return Operator::Ne;
+    case Operator::Ne: return Operator::Eq;
+    default: return Operator::Invalid;
+    }
+}
+
+// The comparison that holds for `b op' a` when `a op b` does.
+static Operator
+swap(Operator op)
+{
+    switch (op) {
+    case Operator::Lt: return Operator::Gt;
+    case Operator::Le: return Operator::Ge;
+    case Operator::Gt: return Operator::Lt;
+    case Operator::Ge: return Operator::Le;
+    default: return op;
+    }
+}
+
+// Narrows `r` to the values for which `r op other` holds.
+static Range
+restrict(Range r, Operator op, Range other)
+{
+    if (r.empty() || other.empty()) {
+        return r;
+    }
+    switch (op) {
+    case Operator::Lt: r.hi = std::min(r.hi, other.hi - 1); break;
+    case Operator::Le: r.hi = std::min(r.hi, other.hi); break;
+    case Operator::Gt: r.lo = std::max(r.lo, other.lo + 1); break;
+    case Operator::Ge: r.lo = std::max(r.lo, other.lo); break;
+    case Operator::Eq:
+        r.lo = std::max(r.lo, other.lo);
+        r.hi = std::min(r.hi, other.hi);
+        break;
+    case Operator::Ne:
+        if (other.is_const() && r.lo == other.lo) {
+            r.lo++;
+        }
+        if (other.is_const() && r.hi == other.lo) {
+            r.hi--;
+        }
+        if (other == Range{ 0, 0 }) {
+            r.nonzero = true;
+        }
+        break;
+    default: break;
+    }
+    return r.normalized();
+}
+
+class RangeAnalyzer {
+private:
+    // A condition known to hold on the edge from block `from` to block `to`:
+    // the register it is attached to compared with `other`, or with 0 if
+    // `other` is -1. If `to` is entered from nowhere else, it holds in the
+    // blocks `to` dominates as well.
+    struct Condition {
+        int      from;
+        int      to;
+        Operator op;
+        int      other;
+    };
+
+    IRFunction &fun;
+    Dominators  dom;
+
+    std::vector<Range>                  ranges;
+    std::vector<int>                    n_grown;
+    std::vector<std::vector<Condition>> conditions;
+
+    // Per register, its conditions in the order the dominator tree is
+    // walked into their `to` blocks. Of those whose `to` is entered from
+    // nowhere else, each one's nearest such condition before it whose `to`
+    // dominates its own, or -1, and the innermost one whose `to` the walk is
+    // in from each point it enters or leaves one of them on. A read then
+    // finds the conditions holding in its block without trying them all.
+    std::vector<std::vector<int>>                 by_block;
+    std::vector<std::vector<int>>                 up;
+    std::vector<std::vector<std::pair<int, int>>> innermost;
+    std::vector<int>                              holding;
+
+    std::pair<int, int> place(int block)
+    {
+        return { dom.enter[block], block };
+    }
+
+    bool dominating(const Condition &cond)
+    {
+        return fun.blocks[cond.to].preds.size() == 1;
+    }
+
+    void order_conditions()
+    {
+        int n_regs = fun.n_regs();
+        by_block.assign(n_regs, {});
+        up.assign(n_regs, {});
+        innermost.assign(n_regs, {});
+        for (int reg = 0; reg < n_regs; reg++) {
+            auto &conds = conditions[reg];
+            auto &order = by_block[reg];
+            for (unsigned int c = 0; c < conds.size(); c++) {
+                order.push_back(c);
+            }
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return place(conds[a].to) < place(conds[b].to);
+            });
+
+            up[reg].assign(conds.size(), -1);
+            std::vector<int> open;
+            int              first = -1;
+            for (unsigned int i = 0; i < order.size(); i++) {
+                int   c    = order[i];
+                auto &cond = conds[c];
+                if (!dominating(cond)) {
+                    continue;
+                }
+                while (!open.empty()
+                       && !dom.dominates(conds[open.back()].to, cond.to)) {
+                    open.pop_back();
+                }
+                if (!open.empty()) {
+                    up[reg][c] = open.back();
+                }
+                open.push_back(c);
+
+                // Conditions on the same block come one after another.
+                if (first < 0 || conds[first].to != cond.to) {
+                    first = c;
+                }
+                bool last = i + 1 == order.size()
+                            || conds[order[i + 1]].to != cond.to;
+                if (last && dom.enter[cond.to] >= 0) {
+                    innermost[reg].push_back({ dom.enter[cond.to], c });
+                    innermost[reg].push_back(
+                        { dom.leave[cond.to], up[reg][first] });
+                }
+            }
+            std::sort(innermost[reg].begin(), innermost[reg].end());
+        }
+    }
+
+    // The range of `reg` where block `at` reads it, or where a phi in `at`
+    // reads it coming from block `from`.
+    Range read(int reg, int at, int from = -1)
+    {
+        auto &conds = conditions[reg];
+        auto &order = by_block[reg];
+        auto  on    = [&](int block) {
+            auto p = place(block);
+            return std::pair{
+                std::partition_point(order.begin(),
+                                     order.end(),
+                                     [&](int c) {
+                                         return place(conds[c].to) < p;
+                                     }),
+                std::partition_point(order.begin(), order.end(), [&](int c) {
+                    return place(conds[c].to) <= p;
+                })
+            };
+        };
+
+        // A condition holds on its own edge, and in the blocks its `to`
+        // dominates if that is entered from nowhere else.
+        holding.clear();
+        if (from >= 0) {
+            auto [begin, end] = on(at);
+            for (auto c = begin; c != end; c++) {
+                if (conds[*c].from == from) {
+                    holding.push_back(*c);
+                }
+            }
+        }
+
+        int x = from >= 0 ? from : at;
+        int c = -1;
+        if (dom.enter[x] >= 0) {
+            auto &points = innermost[reg];
+            auto  point  = std::upper_bound(points.begin(),
+                                          points.end(),
+                                          std::pair{ dom.enter[x], INT_MAX });
+            c            = point == points.begin() ? -1 : (point - 1)->second;
+        } else {
+            // Only a block's own conditions hold in it if it is unreachable.
+            auto [begin, end] = on(x);
+            for (auto cond = begin; cond != end; cond++) {
+                if (dominating(conds[*cond])) {
+                    c = *cond;
+                }
+            }
+        }
+        for (int n = 0; c >= 0 && n < MAX_DOMINATING_CONDITIONS;
+             c = up[reg][c], n++) {
+            holding.push_back(c);
+        }
+
+        // In the order they were found, which makes a difference where
+        // a bound is moved off a constant one condition at a time.
+        std::sort(holding.begin(), holding.end());
+        holding.erase(std::unique(holding.begin(), holding.end()),
+                      holding.end());
+
+        Range r = ranges[reg];
+        for (int c : holding) {
+            auto &cond  = conds[c];
+            Range other = cond.other < 0 ? Range{ 0, 0 } : ranges[cond.other];
+            r           = restrict(r, cond.op, other);
+        }
+        return r;
+    }
+
+    // Records what each branch tells about its condition and the operands
+    // of the comparison computing it, on each of its edges.
+    void find_conditions()
+    {
+        std::vector<IRInst *> def(fun.n_regs(), nullptr);
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    def[inst.dst] = &inst;
+                }
+            }
+        }
+
+        for (auto &block : fun.blocks) {
+            auto &term = block.terminator();
+            if (term.op != IROp::Br || term.target[0] == term.target[1]) {
+                continue;
+            }
+
+            IRInst *test = def[term.a];
+            for (int k = 0; k < 2; k++) {
+                int from = block.id;
+                int to   = term.target[k];
+                conditions[term.a].push_back(
+                    { from, to, k == 0 ? Operator::Ne : Operator::Eq, -1 });
+                if (test == nullptr || test->op != IROp::BinOp
+                    || negate(test->binop) == Operator::Invalid) {
+                    continue;
+                }
+                Operator op = k == 0 ? test->binop : negate(test->binop);
+                conditions[test->a].push_back({ from, to, op, test->b });
+                conditions[test->b].push_back({ from, to, swap(op), test->a });
+            }
+        }
+    }
+
+    Range eval(IRInst &inst, int block)
+    {
+        switch (inst.op) {
+        case IROp::Const: return Range{ inst.imm, inst.imm };
+        case IROp::Mov: return read(inst.a, block);
+        case IROp::BinOp: {
+            Range a = read(inst.a, block);
+            Range b = read(inst.b, block);
+            if (a.empty() || b.empty()) {
+                return Range{};
+            }
+            return binop_range(inst.binop, a, b);
+        }
+        case IROp::UnOp: {
+            Range a = read(inst.a, block);
+            return a.empty() ? Range{} : unop_range(inst.binop, a);
+        }
+        case IROp::Phi: {
+            Range r;
+            auto &preds = fun.blocks[block].preds;
+            for (unsigned int j = 0; j < inst.args.size(); j++) {
+                r = join(r, read(inst.args[j], block, preds[j]));
+            }
+            return r;
+        }
+        default: return full();
+        }
+    }
+
+    // Widens the range of the register `inst` defines to take in `r`.
+    // Returns whether it grew.
+    //
+    // Phis are never pushed to the limits: every loop goes through some
+    // other instruction, and a phi after a loop test is held below what the
+    // test allows, where pushing it would make the increment that follows
+    // wrap.
+    bool update(IRInst &inst, Range r)
+    {
+        int   reg = inst.dst;
+        Range old = ranges[reg];
+        r         = join(old, r);
+        if (r == old) {
+            return false;
+        }
+        if (inst.op != IROp::Phi && !old.empty()
+            && ++n_grown[reg] > WIDEN_AFTER) {
+            r.nonzero = !r.contains(0);
+            r.lo      = r.lo < old.lo ? INT_MIN : r.lo;
+            r.hi      = r.hi > old.hi ? INT_MAX : r.hi;
+            r         = r.normalized();
+        }
+        ranges[reg] = r;
+        return true;
+    }
+
+    void analyze()
+    {
+        int n_regs = fun.n_regs();
+        ranges.assign(n_regs, Range{});
+        n_grown.assign(n_regs, 0);
+        conditions.assign(n_regs, {});
+
+        // Registers that are never assigned are parameters or undefined.
+        std::vector<bool> defined(n_regs, false);
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    defined[inst.dst] = true;
+                }
+            }
+        }
+        for (int r = 0; r < n_regs; r++) {
+            if (!defined[r] || fun.reg_types[r] != Type::Int) {
+                ranges[r] = full();
+            }
+        }
+        find_conditions();
+        order_conditions();
+
+        auto order   = reverse_postorder(fun);
+        auto is_int  = [&](IRInst &inst) {
+            return inst.dst >= 0 && fun.reg_types[inst.dst] == Type::Int;
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b : order) {
+                for (auto &inst : fun.blocks[b].insts) {
+                    if (is_int(inst)) {
+                        changed |= update(inst, eval(inst, b));
+                    }
+                }
+            }
+        }
+
+        // Widening overshoots. Going around again without it takes back
+        // some of what the conditions rule out; every round's ranges still
+        // hold, since they only shrink.
+        for (int round = 0; round < NARROW_ROUNDS; round++) {
+            for (int b : order) {
+                for (auto &inst : fun.blocks[b].insts) {
+                    if (is_int(inst)) {
+                        ranges[inst.dst] = eval(inst, b);
+                    }
+                }
+            }
+        }
+    }
+
+    bool rewrite()
+    {
+        bool changed = false;
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.op != IROp::BinOp && inst.op != IROp::UnOp) {
+                    continue;
+                }
+
+                bool may_fail = false;
+                if (inst.binop == Operator::Div
+                    || inst.binop == Operator::Rem) {
+                    Range a = read(inst.a, block.id);
+                    Range b = read(inst.b, block.id);
+                    if (inst.check_zero && !b.contains(0)) {
+                        inst.check_zero = false;
+                        changed         = true;
+                    }
+                    if (inst.check_overflow
+                        && (!b.contains(-1) || !a.contains(INT_MIN))) {
+                        inst.check_overflow = false;
+                        changed             = true;
+                    }
+                    may_fail = inst.check_zero;
+                }
+
+                Range r = ranges[inst.dst];
+                if (may_fail || r.empty() || !r.is_const()) {
+                    continue;
+                }
+                IRInst load;
+                load.op  = IROp::Const;
+                load.dst = inst.dst;
+                load.imm = r.lo;
+                load.pos = inst.pos;
+                inst     = std::move(load);
+                changed  = true;
+            }
+        }
+        return changed;
+    }
+
+public:
+    RangeAnalyzer(IRFunction &fun)
+        : fun(fun)
+    {
+    }
+
+    bool run()
+    {
+        construct_ssa(fun);
+        dom = compute_dominators(fun);
+        analyze();
+        bool changed = rewrite();
+        destruct_ssa(fun);
+        return changed;
+    }
+};
+
+bool
+narrow_ranges(IRFunction &fun)
+{
+    RangeAnalyzer analyzer(fun);
+    return analyzer.run();
+}
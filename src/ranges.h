@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ir.h"
+
+// Integer range analysis over a function in SSA form. Every register gets an
+// interval its value always lies in, from constants, the operators computing
+// it and, at each read, the conditions of the branches taken to get there:
+// past `if (i < n)`, i is below the most n can be. Intervals growing around
+// a loop are widened to the int limits after a few rounds, so the analysis
+// ends.
+//
+// Comparisons and other operators whose result is then known become constant
+// loads. A division or remainder whose divisor cannot be 0 has its
+// IRInst::check_zero cleared, and one that cannot be INT_MIN / -1 its
+// IRInst::check_overflow, so that code generation leaves those checks out.
+// Returns whether anything changed.
+bool
+narrow_ranges(IRFunction &fun);
@@ -0,0 +1,221 @@
+#include "regalloc.h"
+
+#include <algorithm>
+
+// Loop nesting depth of every block, counting the natural loops of the back
+// edges (edges to a block no later in reverse postorder) that contain it.
+static std::vector<int>
+loop_depths(IRFunction &fun)
+{
+    int              n_blocks = fun.blocks.size();
+    std::vector<int> rpo_idx(n_blocks, -1);
+    std::vector<int> depth(n_blocks, 0);
+
+    // The blocks of each loop are marked with the number of its back edge,
+    // so only they get visited.
+    std::vector<int> in_loop(n_blocks, -1);
+    int              n_back_edges = 0;
+
+    auto rpo = reverse_postorder(fun);
+    for (unsigned int i = 0; i < rpo.size(); i++) {
+        rpo_idx[rpo[i]] = i;
+    }
+
+    for (auto &block : fun.blocks) {
+        for (int header : block.succs) {
+            if (rpo_idx[header] > rpo_idx[block.id]) {
+                continue;
+            }
+
+            // The loop is the header plus everything that reaches the back
+            // edge without going through the header.
+            int              edge = n_back_edges++;
+            std::vector<int> work = { block.id };
+            in_loop[header]       = edge;
+            depth[header]++;
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                if (in_loop[b] == edge) {
+                    continue;
+                }
+                in_loop[b] = edge;
+                depth[b]++;
+                for (int pred : fun.blocks[b].preds) {
+                    work.push_back(pred);
+                }
+            }
+        }
+    }
+
+    return depth;
+}
+
+static bool
+is_callee_saved(int reg)
+{
+    for (Reg r : ALLOC_CALLEE_SAVED) {
+        if (r == reg) {
+            return true;
+        }
+    }
+    return false;
+}
+
+RegAllocation
+allocate_registers(IRFunction &fun, const std::vector<bool> &skip)
+{
+    int n_regs = fun.n_regs();
+
+    RegAllocation res;
+    res.regs.resize(n_regs);
+    res.liveness = compute_liveness(fun);
+
+    std::vector<int> order(fun.blocks.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    auto intervals = build_intervals(fun, res.liveness, order, res.block_start);
+
+    // Spill costs: every use and definition, weighted by 8 per loop level.
+    // Call positions, for finding the calls an interval survives.
+    std::vector<double> cost(n_regs, 0);
+    std::vector<int>    calls;
+    auto                depth = loop_depths(fun);
+    for (auto &block : fun.blocks) {
+        double weight = 1;
+        for (int i = 0; i < std::min(depth[block.id], 6); i++) {
+            weight *= 8;
+        }
+
+        int pos = res.block_start[block.id];
+        for (auto &inst : block.insts) {
+            for_each_use(inst, [&](int reg) { cost[reg] += weight; });
+            if (inst.dst >= 0) {
+                cost[inst.dst] += weight;
+            }
+            if (inst.op == IROp::Call) {
+                calls.push_back(pos);
+            }
+            pos += 2;
+        }
+    }
+
+    std::vector<LiveInterval> todo;
+    for (auto &interval : intervals) {
+        if (interval.start <= interval.end && !skip[interval.reg]) {
+            todo.push_back(interval);
+        }
+    }
+    std::sort(todo.begin(), todo.end(), [](auto &a, auto &b) {
+        return a.start < b.start;
+    });
+
+    auto spill_weight = [&](LiveInterval &interval) {
+        return cost[interval.reg] / (interval.end - interval.start + 1);
+    };
+
+    // The first call that `interval` is live across, or -1.
+    auto first_call = [&](LiveInterval &interval) {
+        auto it = std::lower_bound(calls.begin(), calls.end(), interval.start);
+        if (it != calls.end() && *it + 2 <= interval.end) {
+            return *it;
+        }
+        return -1;
+    };
+
+    // Gives `reg` to `interval`, splitting it at its first call if the call
+    // would clobber the register.
+    auto assign = [&](LiveInterval &interval, int reg) {
+        auto &a   = res.regs[interval.reg];
+        int  call = first_call(interval);
+        a.reg     = reg;
+        a.reg_end = interval.end;
+        if (call >= 0 && !is_callee_saved(reg)) {
+            a.reg_end = call;
+            a.in_slot = true;
+        }
+    };
+
+    bool                      used[16] = {};
+    std::vector<LiveInterval> active;
+
+    for (auto &cur : todo) {
+        // Expire the intervals whose register part ended before this one.
+        for (unsigned int i = 0; i < active.size();) {
+            if (res.regs[active[i].reg].reg_end < cur.start) {
+                used[res.regs[active[i].reg].reg] = false;
+                active.erase(active.begin() + i);
+            } else {
+                i++;
+            }
+        }
+
+        // Prefer the kind of register that survives the calls ahead.
+        int reg = -1;
+        for (int pass = 0; pass < 2 && reg < 0; pass++) {
+            bool callee = (first_call(cur) >= 0) == (pass == 0);
+            if (callee) {
+                for (Reg r : ALLOC_CALLEE_SAVED) {
+                    if (!used[r]) {
+                        reg = r;
+                        break;
+                    }
+                }
+            } else {
+                for (Reg r : ALLOC_CALLER_SAVED) {
+                    if (!used[r]) {
+                        reg = r;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (reg >= 0) {
+            assign(cur, reg);
+            used[reg] = true;
+            active.push_back(cur);
+            continue;
+        }
+
+        // Out of registers: keep the interval with the lowest spill weight in
+        // memory from here on, possibly this one.
+        int    victim = -1;
+        double lowest = spill_weight(cur);
+        for (unsigned int i = 0; i < active.size(); i++) {
+            double w = spill_weight(active[i]);
+            if (w < lowest) {
+                victim = i;
+                lowest = w;
+            }
+        }
+
+        if (victim < 0) {
+            res.regs[cur.reg].in_slot = true;
+            continue;
+        }
+
+        auto &split   = res.regs[active[victim].reg];
+        reg           = split.reg;
+        split.reg_end = cur.start - 1;
+        split.in_slot = true;
+        if (split.reg_end < active[victim].start) {
+            split.reg = -1;
+        }
+
+        assign(cur, reg);
+        active[victim] = cur;
+    }
+
+    for (Reg r : ALLOC_CALLEE_SAVED) {
+        for (auto &a : res.regs) {
+            if (a.reg == r) {
+                res.callee_saved.push_back(r);
+                break;
+            }
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "ir.h"
+#include "liveness.h"
+#include "x86.h"
+
+// Linear-scan register allocation of a function's virtual registers onto
+// x86-64 registers, over the instruction positions of build_intervals() with
+// the blocks in layout order.
+//
+// Every virtual register is either kept in one physical register from the
+// start of its live interval up to `reg_end`, or in a stack slot, or split
+// between the two: in the register up to `reg_end` and in the slot after
+// that. A split register is stored to its slot at every definition, so code
+// after the split point (or reached from before it) always finds it there;
+// only control flow back from after the split into the register part needs a
+// reload.
+//
+// Values live across a call prefer callee-saved registers, which the call
+// leaves alone. One that has to make do with a caller-saved register is split
+// at the first call it survives instead of being saved and restored around
+// every call. When registers run out, whichever of the competing intervals is
+// cheapest to keep in memory (fewest uses per position, with uses in loops
+// weighted up) is split at the current position.
+
+// Registers the allocator hands out. RAX, RDX and R11 are left to the code
+// generator as scratch; RSP, RBP, R14 and R15 are reserved.
+const Reg ALLOC_CALLER_SAVED[] = { RCX, RSI, RDI, R8, R9, R10 };
+const Reg ALLOC_CALLEE_SAVED[] = { RBX, R12, R13 };
+
+struct RegAssignment {
+    int  reg     = -1;    // a Reg, or -1 if the value only lives in memory
+    int  reg_end = -1;    // last position at which `reg` holds the value
+    bool in_slot = false; // whether the value (also) has a stack slot
+};
+
+struct RegAllocation {
+    std::vector<RegAssignment> regs;
+
+    Liveness         liveness;
+    std::vector<int> block_start;
+
+    // Callee-saved registers the function uses, to save and restore.
+    std::vector<Reg> callee_saved;
+
+    bool in_reg(int vreg, int pos) const
+    {
+        return regs[vreg].reg >= 0 && pos <= regs[vreg].reg_end;
+    }
+};
+
+// Allocates every register of `fun` except those flagged in `skip`, which the
+// caller materializes some other way (as immediates, say).
+RegAllocation
+allocate_registers(IRFunction &fun, const std::vector<bool> &skip);
@@ -0,0 +1,142 @@
+#include "runtime.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <pthread.h>
+
+#include "error.h"
+#include "scan.h"
+
+RuntimeStats     rt_stats;
+std::string_view rt_source;
+
+void
+rt_start_stats(const char *engine)
+{
+    rt_stats.engine          = engine;
+    rt_stats.instructions    = 0;
+    rt_stats.counted         = true;
+    rt_stats.compiled        = 0;
+    rt_stats.compile_seconds = 0;
+    rt_stats.tier_ups        = 0;
+    rt_stats.osr_entries     = 0;
+    rt_stats.start           = std::chrono::steady_clock::now();
+}
+
+void
+rt_printint(Value v)
+{
+    printf("%d", (int)v);
+}
+
+void
+rt_printstring(Value v)
+{
+    auto s = value_str(v);
+    fwrite(s->chars(), 1, s->len, stdout);
+}
+
+static void
+report_stats()
+{
+    auto   end     = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - rt_stats.start).count();
+
+    if (!rt_stats.counted) {
+        fprintf(stderr, "[%s] native code in %.6f s", rt_stats.engine, seconds);
+    } else {
+        fprintf(stderr,
+                "[%s] %" PRIu64 " instructions in %.6f s (%.0f instructions/s)",
+                rt_stats.engine,
+                rt_stats.instructions,
+                seconds,
+                seconds > 0 ? rt_stats.instructions / seconds : 0.0);
+    }
+
+    if (rt_stats.compiled > 0) {
+        fprintf(stderr,
+                ", %d functions compiled in %.1f us (%.1f us each)",
+                rt_stats.compiled,
+                rt_stats.compile_seconds * 1e6,
+                rt_stats.compile_seconds * 1e6 / rt_stats.compiled);
+    }
+    if (rt_stats.tier_ups > 0) {
+        fprintf(stderr, ", %d tiered up", rt_stats.tier_ups);
+    }
+    if (rt_stats.osr_entries > 0) {
+        fprintf(stderr, ", %d OSR entries", rt_stats.osr_entries);
+    }
+    if (rt_stats.lex_seconds > 0) {
+        fprintf(stderr,
+                ", lexed %zu bytes in %.1f us (%.1f MB/s, %s)",
+                rt_stats.lex_bytes,
+                rt_stats.lex_seconds * 1e6,
+                rt_stats.lex_bytes / rt_stats.lex_seconds / 1e6,
+                scan.name);
+    }
+    fprintf(stderr, "\n");
+}
+
+void
+rt_exit(Value code)
+{
+    fflush(stdout);
+
+    if (rt_stats.enabled) {
+        report_stats();
+    }
+
+    exit((int)code);
+}
+
+void
+rt_error(const char *msg, SourcePos pos)
+{
+    fflush(stdout);
+    print_err(rt_source, pos, msg);
+    exit(EXIT_RUNTIME_FAILURE);
+}
+
+namespace {
+struct StackThread {
+    const std::function<int()> &fn;
+    int                         res = 0;
+    std::exception_ptr          error;
+};
+}
+
+static void *
+run_stack_thread(void *arg)
+{
+    auto thread = (StackThread *)arg;
+    try {
+        thread->res = thread->fn();
+    } catch (...) {
+        thread->error = std::current_exception();
+    }
+    return nullptr;
+}
+
+int
+rt_run_with_stack(size_t stack_size, const std::function<int()> &fn)
+{
+    StackThread    thread{ fn, 0, {} };
+    pthread_attr_t attr;
+    pthread_t      tid;
+
+    pthread_attr_init(&attr);
+    if (pthread_attr_setstacksize(&attr, stack_size) != 0
+        || pthread_create(&tid, &attr, run_stack_thread, &thread) != 0) {
+        perror("pthread_create()");
+        exit(EXIT_FAILURE);
+    }
+    pthread_attr_destroy(&attr);
+    pthread_join(tid, nullptr);
+
+    if (thread.error) {
+        std::rethrow_exception(thread.error);
+    }
+    return thread.res;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "ast.h"
+#include "string_pool.h"
+
+// Every execution engine agrees on one 64-bit representation for Albatross
+// values: ints are stored sign-extended, strings as a pointer to their entry
+// in string_pool.
+// Keeping a single representation lets frames, globals and arguments be passed
+// between engines without conversion.
+typedef int64_t Value;
+
+static inline Value
+str_value(const PoolString *s)
+{
+    return (Value)(intptr_t)s;
+}
+
+static inline const PoolString *
+value_str(Value v)
+{
+    return (const PoolString *)(intptr_t)v;
+}
+
+// Integer semantics shared by constant folding and every engine: 32-bit two's
+// complement arithmetic that wraps on overflow. Division by zero has to be
+// caught by the caller; INT_MIN / -1 wraps instead of trapping.
+static inline int
+eval_binop(Operator op, int lhs, int rhs)
+{
+    unsigned int ulhs = lhs;
+    unsigned int urhs = rhs;
+
+    switch (op) {
+    case Operator::Or: return lhs || rhs;
+    case Operator::And: return lhs && rhs;
+    case Operator::Bor: return lhs | rhs;
+    case Operator::Xor: return lhs ^ rhs;
+    case Operator::Band: return lhs & rhs;
+    case Operator::Ne: return lhs != rhs;
+    case Operator::Eq: return lhs == rhs;
+    case Operator::Gt: return lhs > rhs;
+    case Operator::Ge: return lhs >= rhs;
+    case Operator::Lt: return lhs < rhs;
+    case Operator::Le: return lhs <= rhs;
+    case Operator::Add: return (int)(ulhs + urhs);
+    case Operator::Sub: return (int)(ulhs - urhs);
+    case Operator::Mul: return (int)(ulhs * urhs);
+    case Operator::Div: return rhs == -1 ? (int)(0u - ulhs) : lhs / rhs;
+    case Operator::Rem: return rhs == -1 ? 0 : lhs % rhs;
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+static inline int
+eval_unop(Operator op, int v)
+{
+    switch (op) {
+    case Operator::Not: return !v;
+    case Operator::Neg: return (int)(0u - (unsigned int)v);
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+// Calls nest at most this deep in every engine; one more is a stack overflow.
+const int MAX_CALL_DEPTH = 10000;
+
+// Execution statistics reported by --stats. "Instructions" is whatever unit
+// of work the running engine dispatches on (AST nodes for the interpreter).
+// Native code does not count them and clears `counted`. Compilers to native
+// code add up the functions they compile and the time spent doing so, and the
+// tiering JIT how many functions it recompiled while running and how many
+// loops it entered through on-stack replacement. The driver records how much
+// source the lexer read and how long it took, before execution starts.
+struct RuntimeStats {
+    bool                                  enabled         = false;
+    const char                           *engine          = "";
+    uint64_t                              instructions    = 0;
+    bool                                  counted         = true;
+    int                                   compiled        = 0;
+    double                                compile_seconds = 0;
+    int                                   tier_ups        = 0;
+    int                                   osr_entries     = 0;
+    size_t                                lex_bytes       = 0;
+    double                                lex_seconds     = 0;
+    std::chrono::steady_clock::time_point start;
+};
+
+extern RuntimeStats rt_stats;
+
+void
+rt_start_stats(const char *engine);
+
+void
+rt_printint(Value v);
+
+void
+rt_printstring(Value v);
+
+// Flushes output, reports statistics if requested and terminates the process.
+// Both the builtin exit() and falling off (or returning from) the top level end
+// up here, so every engine shuts down the same way.
+[[noreturn]] void
+rt_exit(Value code);
+
+// The program text, for reporting runtime errors.
+extern std::string_view rt_source;
+
+// Reports a runtime error at a source position and terminates. This is for
+// native code, whose frames a C++ exception cannot unwind; everything else
+// throws AlbatrossError instead.
+[[noreturn]] void
+rt_error(const char *msg, SourcePos pos);
+
+// Runs `fn` on a thread with at least `stack_size` bytes of stack and returns
+// its result. Exceptions propagate to the caller. Engines that recurse on the
+// native stack use this to reach MAX_CALL_DEPTH whatever their frame size.
+int
+rt_run_with_stack(size_t stack_size, const std::function<int()> &fn);
@@ -0,0 +1,254 @@
+#include "scan.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static inline bool
+is_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool
+is_ident(unsigned char c)
+{
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a'
+           || (unsigned char)(c - '0') <= 9 || c == '_';
+}
+
+static inline bool
+is_line(unsigned char c)
+{
+    return c != '\n' && c != '\r';
+}
+
+static inline bool
+is_str(unsigned char c)
+{
+    return c != '"' && c != '\\' && c != '\n' && c != '\r';
+}
+
+template <bool (*in_class)(unsigned char)>
+static size_t
+skip_scalar(std::string_view s, size_t i)
+{
+    while (i < s.size() && in_class(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+#if defined(__x86_64__)
+
+// Tests WIDTH characters at a time with `vector_mask`, which sets bit k of
+// its result if character k of the block at p is in the class, then finishes
+// the last partial block with `in_class`. This is always inlined, so that it
+// is compiled for the same instruction set as the kernel it is part of.
+template <size_t WIDTH,
+          uint32_t (*vector_mask)(const char *p),
+          bool (*in_class)(unsigned char)>
+static inline __attribute__((always_inline)) size_t
+skip_vector(std::string_view s, size_t i)
+{
+    const uint64_t all = (1ull << WIDTH) - 1;
+
+    for (; i + WIDTH <= s.size(); i += WIDTH) {
+        uint64_t outside = ~(uint64_t)vector_mask(s.data() + i) & all;
+        if (outside != 0) {
+            return i + __builtin_ctzll(outside);
+        }
+    }
+    return skip_scalar<in_class>(s, i);
+}
+
+// Unsigned v <= k, bytewise.
+static inline __m128i
+sse2_le(__m128i v, char k)
+{
+    __m128i kk = _mm_set1_epi8(k);
+    return _mm_cmpeq_epi8(_mm_max_epu8(v, kk), kk);
+}
+
+static inline __m128i
+sse2_eq(__m128i v, char c)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+static inline uint32_t
+sse2_space(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(sse2_eq(v, ' '), sse2_eq(v, '\t')),
+                     _mm_or_si128(sse2_eq(v, '\n'), sse2_eq(v, '\r'))));
+}
+
+static inline uint32_t
+sse2_ident(const char *p)
+{
+    __m128i v     = _mm_loadu_si128((const __m128i *)p);
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter =
+        sse2_le(_mm_sub_epi8(lower, _mm_set1_epi8('a')), 'z' - 'a');
+    __m128i digit = sse2_le(_mm_sub_epi8(v, _mm_set1_epi8('0')), 9);
+    return _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(letter, digit), sse2_eq(v, '_')));
+}
+
+static inline uint32_t
+sse2_line(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return ~_mm_movemask_epi8(_mm_or_si128(sse2_eq(v, '\n'), sse2_eq(v, '\r')));
+}
+
+static inline uint32_t
+sse2_str(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return ~_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(sse2_eq(v, '"'), sse2_eq(v, '\\')),
+                     _mm_or_si128(sse2_eq(v, '\n'), sse2_eq(v, '\r'))));
+}
+
+static size_t
+sse2_skip_space(std::string_view s, size_t i)
+{
+    return skip_vector<16, sse2_space, is_space>(s, i);
+}
+
+static size_t
+sse2_skip_ident(std::string_view s, size_t i)
+{
+    return skip_vector<16, sse2_ident, is_ident>(s, i);
+}
+
+static size_t
+sse2_skip_line(std::string_view s, size_t i)
+{
+    return skip_vector<16, sse2_line, is_line>(s, i);
+}
+
+static size_t
+sse2_skip_str(std::string_view s, size_t i)
+{
+    return skip_vector<16, sse2_str, is_str>(s, i);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i
+avx2_le(__m256i v, char k)
+{
+    __m256i kk = _mm256_set1_epi8(k);
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(v, kk), kk);
+}
+
+AVX2 static inline __m256i
+avx2_eq(__m256i v, char c)
+{
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+AVX2 static inline uint32_t
+avx2_space(const char *p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, '\t')),
+                        _mm256_or_si256(avx2_eq(v, '\n'), avx2_eq(v, '\r'))));
+}
+
+AVX2 static inline uint32_t
+avx2_ident(const char *p)
+{
+    __m256i v     = _mm256_loadu_si256((const __m256i *)p);
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter =
+        avx2_le(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), 'z' - 'a');
+    __m256i digit = avx2_le(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), 9);
+    return _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(letter, digit), avx2_eq(v, '_')));
+}
+
+AVX2 static inline uint32_t
+avx2_line(const char *p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return ~_mm256_movemask_epi8(
+        _mm256_or_si256(avx2_eq(v, '\n'), avx2_eq(v, '\r')));
+}
+
+AVX2 static inline uint32_t
+avx2_str(const char *p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return ~_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(avx2_eq(v, '"'), avx2_eq(v, '\\')),
+                        _mm256_or_si256(avx2_eq(v, '\n'), avx2_eq(v, '\r'))));
+}
+
+AVX2 static size_t
+avx2_skip_space(std::string_view s, size_t i)
+{
+    return skip_vector<32, avx2_space, is_space>(s, i);
+}
+
+AVX2 static size_t
+avx2_skip_ident(std::string_view s, size_t i)
+{
+    return skip_vector<32, avx2_ident, is_ident>(s, i);
+}
+
+AVX2 static size_t
+avx2_skip_line(std::string_view s, size_t i)
+{
+    return skip_vector<32, avx2_line, is_line>(s, i);
+}
+
+AVX2 static size_t
+avx2_skip_str(std::string_view s, size_t i)
+{
+    return skip_vector<32, avx2_str, is_str>(s, i);
+}
+
+#undef AVX2
+
+static const ScanKernels sse2_kernels = {
+    "sse2", sse2_skip_space, sse2_skip_ident, sse2_skip_line, sse2_skip_str
+};
+
+static const ScanKernels avx2_kernels = {
+    "avx2", avx2_skip_space, avx2_skip_ident, avx2_skip_line, avx2_skip_str
+};
+
+#else
+
+static const ScanKernels scalar_kernels = { "scalar",
+                                            skip_scalar<is_space>,
+                                            skip_scalar<is_ident>,
+                                            skip_scalar<is_line>,
+                                            skip_scalar<is_str> };
+
+#endif
+
+static const ScanKernels &
+pick_kernels()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2_kernels;
+    }
+    // Every x86-64 processor has SSE2.
+    return sse2_kernels;
+#else
+    return scalar_kernels;
+#endif
+}
+
+const ScanKernels &scan = pick_kernels();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Kernels that find where a run of characters of one class ends, for the
+// lexer. Each returns the index of the first character at or after `i` in `s`
+// that is outside its class, or s.size() if there is none. They test 16 or 32
+// characters at a time with SSE2 or AVX2, whichever the processor supports,
+// and fall back to one at a time elsewhere.
+struct ScanKernels {
+    const char *name;
+
+    // ' ', '\t', '\n' and '\r'.
+    size_t (*skip_space)(std::string_view s, size_t i);
+
+    // Letters, digits and '_'.
+    size_t (*skip_ident)(std::string_view s, size_t i);
+
+    // Anything but '\n' and '\r': the rest of a comment.
+    size_t (*skip_line)(std::string_view s, size_t i);
+
+    // Anything but '"', '\\', '\n' and '\r': plain characters in a string
+    // literal.
+    size_t (*skip_str)(std::string_view s, size_t i);
+};
+
+// The kernels for this processor, picked when the program starts.
+extern const ScanKernels &scan;
@@ -0,0 +1,340 @@
+#include "sccp.h"
+
+#include <algorithm>
+
+#include "liveness.h"
+#include "runtime.h"
+#include "ssa.h"
+
+// What the propagation knows about a register: nothing yet (it has not been
+// seen to be assigned), that it always holds one constant, or that it can
+// hold anything.
+struct LatticeValue {
+    enum { Top, Const, Bottom } kind = Top;
+    int value                        = 0;
+};
+
+static LatticeValue
+meet(LatticeValue a, LatticeValue b)
+{
+    if (a.kind == LatticeValue::Top) {
+        return b;
+    }
+    if (b.kind == LatticeValue::Top) {
+        return a;
+    }
+    if (a.kind == LatticeValue::Const && b.kind == LatticeValue::Const
+        && a.value == b.value) {
+        return a;
+    }
+    return LatticeValue{ LatticeValue::Bottom, 0 };
+}
+
+static LatticeValue
+constant(int value)
+{
+    return LatticeValue{ LatticeValue::Const, value };
+}
+
+class ConstantPropagator {
+private:
+    IRFunction &fun;
+
+    std::vector<LatticeValue> values;
+
+    // Blocks that can run, and for every block, which of its incoming edges
+    // can be taken (in the order of BasicBlock::preds).
+    std::vector<bool>              executable;
+    std::vector<std::vector<bool>> edge_executable;
+
+    // Every instruction reading each register, as (block, index) pairs.
+    std::vector<std::vector<std::pair<int, int>>> uses;
+
+    std::vector<std::pair<int, int>> edge_work;
+    std::vector<int>                 reg_work;
+
+    void set(int reg, LatticeValue value)
+    {
+        auto &cur = values[reg];
+        value     = meet(cur, value);
+        if (value.kind != cur.kind || value.value != cur.value) {
+            cur = value;
+            reg_work.push_back(reg);
+        }
+    }
+
+    LatticeValue eval(IRInst &inst)
+    {
+        LatticeValue a = values[inst.a];
+        LatticeValue b = inst.op == IROp::BinOp ? values[inst.b] : a;
+        if (a.kind == LatticeValue::Bottom || b.kind == LatticeValue::Bottom) {
+            return LatticeValue{ LatticeValue::Bottom, 0 };
+        }
+        if (a.kind == LatticeValue::Top || b.kind == LatticeValue::Top) {
+            return LatticeValue{};
+        }
+
+        if (inst.op == IROp::UnOp) {
+            return constant(eval_unop(inst.binop, a.value));
+        }
+
+        // Division by zero is left for the runtime to report.
+        if ((inst.binop == Operator::Div || inst.binop == Operator::Rem)
+            && b.value == 0) {
+            return LatticeValue{ LatticeValue::Bottom, 0 };
+        }
+        return constant(eval_binop(inst.binop, a.value, b.value));
+    }
+
+    void visit(int block, IRInst &inst)
+    {
+        switch (inst.op) {
+        case IROp::Const: set(inst.dst, constant(inst.imm)); break;
+        case IROp::Mov: set(inst.dst, values[inst.a]); break;
+        case IROp::BinOp:
+        case IROp::UnOp: set(inst.dst, eval(inst)); break;
+        case IROp::ConstStr:
+        case IROp::LoadGlobal:
+        case IROp::Call:
+            if (inst.dst >= 0) {
+                set(inst.dst, LatticeValue{ LatticeValue::Bottom, 0 });
+            }
+            break;
+        case IROp::Phi: {
+            LatticeValue value;
+            for (unsigned int j = 0; j < inst.args.size(); j++) {
+                if (edge_executable[block][j]) {
+                    value = meet(value, values[inst.args[j]]);
+                }
+            }
+            set(inst.dst, value);
+            break;
+        }
+        case IROp::StoreGlobal:
+        case IROp::Ret: break;
+        case IROp::Jmp: edge_work.push_back({ block, inst.target[0] }); break;
+        case IROp::Br: {
+            auto &cond = values[inst.a];
+            if (cond.kind != LatticeValue::Bottom) {
+                if (cond.kind == LatticeValue::Const) {
+                    int target = inst.target[cond.value != 0 ? 0 : 1];
+                    edge_work.push_back({ block, target });
+                }
+            } else {
+                edge_work.push_back({ block, inst.target[0] });
+                edge_work.push_back({ block, inst.target[1] });
+            }
+            break;
+        }
+        }
+    }
+
+    void propagate()
+    {
+        int n_regs = fun.n_regs();
+        values.assign(n_regs, LatticeValue{});
+        uses.assign(n_regs, {});
+        executable.assign(fun.blocks.size(), false);
+        edge_executable.clear();
+
+        // Registers that are never assigned are parameters or undefined.
+        std::vector<bool> defined(n_regs, false);
+        for (auto &block : fun.blocks) {
+            edge_executable.emplace_back(block.preds.size(), false);
+            for (unsigned int i = 0; i < block.insts.size(); i++) {
+                auto &inst = block.insts[i];
+                for_each_use(inst, [&](int reg) {
+                    uses[reg].push_back({ block.id, i });
+                });
+                if (inst.dst >= 0) {
+                    defined[inst.dst] = true;
+                }
+            }
+        }
+        for (int r = 0; r < n_regs; r++) {
+            if (!defined[r]) {
+                values[r].kind = LatticeValue::Bottom;
+            }
+        }
+
+        executable[0] = true;
+        for (auto &inst : fun.blocks[0].insts) {
+            visit(0, inst);
+        }
+
+        while (!edge_work.empty() || !reg_work.empty()) {
+            while (!edge_work.empty()) {
+                auto [pred, succ] = edge_work.back();
+                edge_work.pop_back();
+
+                auto &block = fun.blocks[succ];
+                auto &preds = block.preds;
+                int   j     = std::find(preds.begin(), preds.end(), pred)
+                      - preds.begin();
+                if (edge_executable[succ][j]) {
+                    continue;
+                }
+                edge_executable[succ][j] = true;
+
+                // A block runs its phis again for every new incoming edge,
+                // and everything else once.
+                bool first = !executable[succ];
+                executable[succ] = true;
+                for (auto &inst : block.insts) {
+                    if (first || inst.op == IROp::Phi) {
+                        visit(succ, inst);
+                    }
+                }
+            }
+
+            while (!reg_work.empty()) {
+                int reg = reg_work.back();
+                reg_work.pop_back();
+                for (auto [b, i] : uses[reg]) {
+                    if (executable[b]) {
+                        visit(b, fun.blocks[b].insts[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    bool rewrite()
+    {
+        bool changed = false;
+
+        for (auto &block : fun.blocks) {
+            if (!executable[block.id]) {
+                continue;
+            }
+
+            for (auto &inst : block.insts) {
+                if (inst.dst < 0 || inst.op == IROp::Const
+                    || inst.op == IROp::Call
+                    || values[inst.dst].kind != LatticeValue::Const) {
+                    continue;
+                }
+                IRInst load;
+                load.op  = IROp::Const;
+                load.dst = inst.dst;
+                load.imm = values[inst.dst].value;
+                load.pos = inst.pos;
+                inst     = std::move(load);
+                changed  = true;
+            }
+
+            auto &term = block.terminator();
+            if (term.op == IROp::Br
+                && values[term.a].kind == LatticeValue::Const) {
+                int taken   = term.target[values[term.a].value != 0 ? 0 : 1];
+                int dropped = term.target[values[term.a].value != 0 ? 1 : 0];
+                term.op        = IROp::Jmp;
+                term.a         = -1;
+                term.target[0] = taken;
+                term.target[1] = -1;
+                if (dropped != taken) {
+                    remove_edge(fun, block.id, dropped);
+                }
+                changed = true;
+            }
+        }
+
+        return changed;
+    }
+
+    // Once out of SSA form, a constant that is a version of a register with
+    // several definitions would be read back from that register. Uses of it
+    // get a register of their own instead, which holds nothing else and so
+    // can become an immediate operand.
+    bool split_constants()
+    {
+        std::vector<int> n_defs(fun.n_regs(), 0);
+        for (int p = 0; p < fun.n_params; p++) {
+            n_defs[p]++;
+        }
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.dst >= 0) {
+                    n_defs[fun.ssa_origin[inst.dst]]++;
+                }
+            }
+        }
+
+        // Registers already split (or only read by phis) have nothing to
+        // copy, so running again changes nothing.
+        std::vector<bool> used(fun.n_regs(), false);
+        for (auto &block : fun.blocks) {
+            for (auto &inst : block.insts) {
+                if (inst.op != IROp::Phi) {
+                    for_each_use(inst, [&](int reg) { used[reg] = true; });
+                }
+            }
+        }
+
+        bool             changed = false;
+        std::vector<int> copy(fun.n_regs(), -1);
+        for (int r = 0; r < (int)copy.size(); r++) {
+            if (values[r].kind == LatticeValue::Const && used[r]
+                && n_defs[fun.ssa_origin[r]] > 1) {
+                copy[r] = fun.new_reg(Type::Int);
+                changed = true;
+            }
+        }
+
+        auto make_copy = [&](int reg) {
+            IRInst load;
+            load.op  = IROp::Const;
+            load.dst = copy[reg];
+            load.imm = values[reg].value;
+            return load;
+        };
+
+        for (auto &block : fun.blocks) {
+            // Phis that became constants move after the remaining phis, so
+            // that the copies can follow them.
+            std::stable_partition(
+                block.insts.begin(), block.insts.end(), [](IRInst &inst) {
+                    return inst.op == IROp::Phi;
+                });
+
+            std::vector<IRInst> insts;
+            for (auto &inst : block.insts) {
+                if (inst.op != IROp::Phi) {
+                    for_each_use(inst, [&](int &reg) {
+                        if (copy[reg] >= 0) {
+                            reg = copy[reg];
+                        }
+                    });
+                }
+
+                int dst = inst.dst;
+                insts.push_back(std::move(inst));
+                if (dst >= 0 && dst < (int)copy.size() && copy[dst] >= 0) {
+                    insts.push_back(make_copy(dst));
+                }
+            }
+            block.insts = std::move(insts);
+        }
+        return changed;
+    }
+
+public:
+    ConstantPropagator(IRFunction &fun)
+        : fun(fun)
+    {
+    }
+
+    bool run()
+    {
+        propagate();
+        bool changed = rewrite();
+        return split_constants() || changed;
+    }
+};
+
+bool
+propagate_constants(IRFunction &fun)
+{
+    ConstantPropagator propagator(fun);
+    return propagator.run();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ir.h"
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over a function
+// in SSA form. Finds the registers that hold the same constant whenever they
+// are assigned, following only the branches that can be taken given those
+// constants, so that constants flow through variables, across branches and
+// around loops.
+//
+// Instructions computing a constant become constant loads and branches on a
+// constant become jumps; the blocks that can then never run are left
+// unreachable, for simplify_cfg() to delete. Returns whether anything
+// changed.
+bool
+propagate_constants(IRFunction &fun);
@@ -0,0 +1,353 @@
+#include "simplify.h"
+
+#include "runtime.h"
+
+// What an operand has to be for a rule to apply.
+enum class Match {
+    Any,
+    Pure,      // no calls, and nothing that can fail
+    Bool,      // always 0 or 1
+    Zero,      // the literal 0
+    One,       // the literal 1
+    MinusOne,  // the literal -1
+    Const,     // any literal
+    SameAsLhs, // the same expression as the left operand
+    Negation,  // -y
+    BoolNot,   // !y where y is 0 or 1
+    Compare,   // y <op> z for a comparison <op>
+};
+
+// What an expression matching a rule becomes.
+enum class Result {
+    Lhs,
+    Rhs,
+    Zero,
+    One,
+    MinusOne,
+    NegLhs,
+    NegRhs,
+    Inner,           // y, out of the operand matched by Negation or BoolNot
+    InvertedCompare, // the operand matched by Compare, with <op> negated
+    AddNegatedRhs,   // lhs + -rhs
+};
+
+// A rewrite of `lhs <op> rhs`, or of `<op> lhs` for a prefix operator
+// (whose rules leave `rhs` as Any).
+struct Rule {
+    Operator op;
+    Match    lhs;
+    Match    rhs;
+    Result   result;
+};
+
+// The first rule that matches applies.
+static const Rule rules[] = {
+    // Subtracting a constant adds its negation, so that only additions need
+    // reassociating.
+    { Operator::Add, Match::Any, Match::Zero, Result::Lhs },
+    { Operator::Add, Match::Zero, Match::Any, Result::Rhs },
+    { Operator::Sub, Match::Any, Match::Zero, Result::Lhs },
+    { Operator::Sub, Match::Zero, Match::Any, Result::NegRhs },
+    { Operator::Sub, Match::Pure, Match::SameAsLhs, Result::Zero },
+    { Operator::Sub, Match::Any, Match::Const, Result::AddNegatedRhs },
+
+    { Operator::Mul, Match::Any, Match::One, Result::Lhs },
+    { Operator::Mul, Match::One, Match::Any, Result::Rhs },
+    { Operator::Mul, Match::Any, Match::MinusOne, Result::NegLhs },
+    { Operator::Mul, Match::MinusOne, Match::Any, Result::NegRhs },
+    { Operator::Mul, Match::Pure, Match::Zero, Result::Zero },
+    { Operator::Mul, Match::Zero, Match::Pure, Result::Zero },
+    { Operator::Div, Match::Any, Match::One, Result::Lhs },
+    { Operator::Div, Match::Any, Match::MinusOne, Result::NegLhs },
+    { Operator::Rem, Match::Pure, Match::One, Result::Zero },
+    { Operator::Rem, Match::Pure, Match::MinusOne, Result::Zero },
+
+    { Operator::Band, Match::Any, Match::MinusOne, Result::Lhs },
+    { Operator::Band, Match::MinusOne, Match::Any, Result::Rhs },
+    { Operator::Band, Match::Pure, Match::Zero, Result::Zero },
+    { Operator::Band, Match::Zero, Match::Pure, Result::Zero },
+    { Operator::Band, Match::Pure, Match::SameAsLhs, Result::Lhs },
+    { Operator::Bor, Match::Any, Match::Zero, Result::Lhs },
+    { Operator::Bor, Match::Zero, Match::Any, Result::Rhs },
+    { Operator::Bor, Match::Pure, Match::MinusOne, Result::MinusOne },
+    { Operator::Bor, Match::MinusOne, Match::Pure, Result::MinusOne },
+    { Operator::Bor, Match::Pure, Match::SameAsLhs, Result::Lhs },
+    { Operator::Xor, Match::Any, Match::Zero, Result::Lhs },
+    { Operator::Xor, Match::Zero, Match::Any, Result::Rhs },
+    { Operator::Xor, Match::Pure, Match::SameAsLhs, Result::Zero },
+
+    { Operator::Eq, Match::Pure, Match::SameAsLhs, Result::One },
+    { Operator::Ne, Match::Pure, Match::SameAsLhs, Result::Zero },
+    { Operator::Lt, Match::Pure, Match::SameAsLhs, Result::Zero },
+    { Operator::Gt, Match::Pure, Match::SameAsLhs, Result::Zero },
+    { Operator::Le, Match::Pure, Match::SameAsLhs, Result::One },
+    { Operator::Ge, Match::Pure, Match::SameAsLhs, Result::One },
+    { Operator::Ne, Match::Bool, Match::Zero, Result::Lhs },
+    { Operator::Eq, Match::Bool, Match::One, Result::Lhs },
+
+    // The right operand of && and || is not evaluated at all if the left
+    // one decides the result.
+    { Operator::And, Match::Zero, Match::Any, Result::Zero },
+    { Operator::And, Match::Pure, Match::Zero, Result::Zero },
+    { Operator::And, Match::Bool, Match::One, Result::Lhs },
+    { Operator::And, Match::One, Match::Bool, Result::Rhs },
+    { Operator::Or, Match::One, Match::Any, Result::One },
+    { Operator::Or, Match::Pure, Match::One, Result::One },
+    { Operator::Or, Match::Bool, Match::Zero, Result::Lhs },
+    { Operator::Or, Match::Zero, Match::Bool, Result::Rhs },
+
+    { Operator::Neg, Match::Negation, Match::Any, Result::Inner },
+    { Operator::Not, Match::BoolNot, Match::Any, Result::Inner },
+    { Operator::Not, Match::Compare, Match::Any, Result::InvertedCompare },
+};
+
+static bool
+is_compare(Operator op)
+{
+    return op == Operator::Eq || op == Operator::Ne || op == Operator::Lt
+           || op == Operator::Le || op == Operator::Gt || op == Operator::Ge;
+}
+
+static Operator
+inverse_compare(Operator op)
+{
+    switch (op) {
+    case Operator::Eq: return Operator::Ne;
+    case Operator::Ne: return Operator::Eq;
+    case Operator::Lt: return Operator::Ge;
+    case Operator::Ge: return Operator::Lt;
+    case Operator::Gt: return Operator::Le;
+    case Operator::Le: return Operator::Gt;
+    default: perror("Invalid operator"); exit(EXIT_FAILURE);
+    }
+}
+
+static bool
+is_int(ExpNode *exp, int value)
+{
+    return exp->kind == ExpNode::IntExp
+           && static_cast<IntNode *>(exp)->ival == value;
+}
+
+static bool
+is_pure(ExpNode *exp)
+{
+    switch (exp->kind) {
+    case ExpNode::IntExp:
+    case ExpNode::StringExp:
+    case ExpNode::VarExp: return true;
+    case ExpNode::UnopExp:
+        return is_pure(static_cast<UnOpNode *>(exp)->e.get());
+    case ExpNode::BinopExp: {
+        auto node     = static_cast<BinOpNode *>(exp);
+        bool may_fail = (node->op == Operator::Div
+                         || node->op == Operator::Rem)
+                        && (node->rhs->kind != ExpNode::IntExp
+                            || is_int(node->rhs.get(), 0));
+        return !may_fail && is_pure(node->lhs.get())
+               && is_pure(node->rhs.get());
+    }
+    case ExpNode::CallExp: return false;
+    }
+    return false;
+}
+
+static bool
+is_bool(ExpNode *exp)
+{
+    switch (exp->kind) {
+    case ExpNode::IntExp: return is_int(exp, 0) || is_int(exp, 1);
+    case ExpNode::UnopExp:
+        return static_cast<UnOpNode *>(exp)->op == Operator::Not;
+    case ExpNode::BinopExp: {
+        auto op = static_cast<BinOpNode *>(exp)->op;
+        return is_compare(op) || op == Operator::And || op == Operator::Or;
+    }
+    default: return false;
+    }
+}
+
+static bool
+same_exp(ExpNode *a, ExpNode *b)
+{
+    if (a->kind != b->kind) {
+        return false;
+    }
+
+    switch (a->kind) {
+    case ExpNode::IntExp:
+        return static_cast<IntNode *>(a)->ival
+               == static_cast<IntNode *>(b)->ival;
+    case ExpNode::VarExp: {
+        auto &x = static_cast<VarNode *>(a)->var_info.value();
+        auto &y = static_cast<VarNode *>(b)->var_info.value();
+        return x.var_idx == y.var_idx && x.fun_idx == y.fun_idx
+               && x.frame_idx == y.frame_idx;
+    }
+    case ExpNode::UnopExp: {
+        auto x = static_cast<UnOpNode *>(a);
+        auto y = static_cast<UnOpNode *>(b);
+        return x->op == y->op && same_exp(x->e.get(), y->e.get());
+    }
+    case ExpNode::BinopExp: {
+        auto x = static_cast<BinOpNode *>(a);
+        auto y = static_cast<BinOpNode *>(b);
+        return x->op == y->op && same_exp(x->lhs.get(), y->lhs.get())
+               && same_exp(x->rhs.get(), y->rhs.get());
+    }
+    default: return false;
+    }
+}
+
+static bool
+matches(Match match, ExpNode *exp, ExpNode *lhs)
+{
+    switch (match) {
+    case Match::Any: return true;
+    case Match::Pure: return is_pure(exp);
+    case Match::Bool: return is_bool(exp);
+    case Match::Zero: return is_int(exp, 0);
+    case Match::One: return is_int(exp, 1);
+    case Match::MinusOne: return is_int(exp, -1);
+    case Match::Const: return exp->kind == ExpNode::IntExp;
+    case Match::SameAsLhs: return same_exp(exp, lhs);
+    case Match::Negation:
+        return exp->kind == ExpNode::UnopExp
+               && static_cast<UnOpNode *>(exp)->op == Operator::Neg;
+    case Match::BoolNot:
+        return exp->kind == ExpNode::UnopExp
+               && static_cast<UnOpNode *>(exp)->op == Operator::Not
+               && is_bool(static_cast<UnOpNode *>(exp)->e.get());
+    case Match::Compare:
+        return exp->kind == ExpNode::BinopExp
+               && is_compare(static_cast<BinOpNode *>(exp)->op);
+    }
+    return false;
+}
+
+static std::unique_ptr<ExpNode>
+make_int(ExpNode *at, int value)
+{
+    auto res        = std::make_unique<IntNode>();
+    res->ival       = value;
+    res->pos        = at->pos;
+    res->value_type = Type::Int;
+    return res;
+}
+
+static std::unique_ptr<ExpNode>
+make_neg(ExpNode *at, std::unique_ptr<ExpNode> &exp)
+{
+    auto res        = std::make_unique<UnOpNode>(Operator::Neg, exp);
+    res->pos        = at->pos;
+    res->value_type = Type::Int;
+    return res;
+}
+
+static std::unique_ptr<ExpNode>
+rewrite(Result result,
+        ExpNode                  *at,
+        std::unique_ptr<ExpNode> &lhs,
+        std::unique_ptr<ExpNode> *rhs)
+{
+    switch (result) {
+    case Result::Lhs: return std::move(lhs);
+    case Result::Rhs: return std::move(*rhs);
+    case Result::Zero: return make_int(at, 0);
+    case Result::One: return make_int(at, 1);
+    case Result::MinusOne: return make_int(at, -1);
+    case Result::NegLhs: return make_neg(at, lhs);
+    case Result::NegRhs: return make_neg(at, *rhs);
+    case Result::Inner: return std::move(static_cast<UnOpNode *>(lhs.get())->e);
+    case Result::InvertedCompare: {
+        auto node = static_cast<BinOpNode *>(lhs.get());
+        node->op  = inverse_compare(node->op);
+        return std::move(lhs);
+    }
+    case Result::AddNegatedRhs: {
+        int  value      = static_cast<IntNode *>(rhs->get())->ival;
+        auto neg        = make_int(rhs->get(), eval_unop(Operator::Neg, value));
+        auto res        = std::make_unique<BinOpNode>(Operator::Add, lhs, neg);
+        res->pos        = at->pos;
+        res->value_type = Type::Int;
+        return res;
+    }
+    }
+    return nullptr;
+}
+
+static bool
+apply_rules(std::unique_ptr<ExpNode> &exp)
+{
+    Operator                  op;
+    std::unique_ptr<ExpNode> *lhs;
+    std::unique_ptr<ExpNode> *rhs = nullptr;
+    if (exp->kind == ExpNode::BinopExp) {
+        auto node = static_cast<BinOpNode *>(exp.get());
+        op        = node->op;
+        lhs       = &node->lhs;
+        rhs       = &node->rhs;
+    } else if (exp->kind == ExpNode::UnopExp) {
+        auto node = static_cast<UnOpNode *>(exp.get());
+        op        = node->op;
+        lhs       = &node->e;
+    } else {
+        return false;
+    }
+
+    for (auto &rule : rules) {
+        if (rule.op != op || !matches(rule.lhs, lhs->get(), nullptr)
+            || (rhs && !matches(rule.rhs, rhs->get(), lhs->get()))) {
+            continue;
+        }
+        exp = rewrite(rule.result, exp.get(), *lhs, rhs);
+        return true;
+    }
+    return false;
+}
+
+// Moves a constant operand of a commutative operator to the right, and
+// combines it with a constant the left operand applies the same associative
+// operator to.
+static bool
+reassociate(std::unique_ptr<ExpNode> &exp)
+{
+    if (exp->kind != ExpNode::BinopExp) {
+        return false;
+    }
+    auto node = static_cast<BinOpNode *>(exp.get());
+    if (node->op != Operator::Add && node->op != Operator::Mul
+        && node->op != Operator::Band && node->op != Operator::Bor
+        && node->op != Operator::Xor) {
+        return false;
+    }
+
+    if (node->lhs->kind == ExpNode::IntExp
+        && node->rhs->kind != ExpNode::IntExp) {
+        std::swap(node->lhs, node->rhs);
+        return true;
+    }
+
+    auto inner = static_cast<BinOpNode *>(node->lhs.get());
+    if (node->rhs->kind != ExpNode::IntExp
+        || node->lhs->kind != ExpNode::BinopExp || inner->op != node->op
+        || inner->rhs->kind != ExpNode::IntExp) {
+        return false;
+    }
+    auto c1 = static_cast<IntNode *>(inner->rhs.get());
+    auto c2 = static_cast<IntNode *>(node->rhs.get());
+
+    c2->ival  = eval_binop(node->op, c1->ival, c2->ival);
+    node->lhs = std::move(inner->lhs);
+    return true;
+}
+
+bool
+simplify_exp(std::unique_ptr<ExpNode> &exp)
+{
+    bool changed = false;
+    while (apply_rules(exp) || reassociate(exp)) {
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <memory>
+
+#include "ast.h"
+
+// Algebraic simplification of int expressions, run by fold_exp() once an
+// expression's operands are folded. The rules (identities such as x * 1 and
+// x - x, double negations and negated comparisons) are all in one table in
+// simplify.cpp; after them, constants move to the right of commutative
+// operators and chains of constants combine: (x + 1) + 2 becomes x + 3.
+//
+// Every rewrite is exact under the language's wrapping 32-bit arithmetic. An
+// operand is only dropped or compared with another if it is pure: it makes
+// no calls and cannot fail. Rewrites `exp` in place; returns whether it
+// changed.
+bool
+simplify_exp(std::unique_ptr<ExpNode> &exp);
@@ -0,0 +1,47 @@
+#include "source_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::~SourceFile()
+{
+    if (mapped) {
+        munmap((void *)data, size);
+    }
+}
+
+bool
+SourceFile::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            close(fd);
+            data   = (const char *)p;
+            size   = st.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+
+    char    chunk[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, n);
+    }
+    close(fd);
+    if (n < 0) {
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
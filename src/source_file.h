@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// The text of a program, mapped read-only into memory where possible. Tokens,
+// error reports and the runtime all view this one copy rather than copying it;
+// files that cannot be mapped, like pipes, are read into a buffer instead.
+class SourceFile {
+private:
+    const char *data   = nullptr;
+    size_t      size   = 0;
+    bool        mapped = false;
+    std::string buffer;
+
+public:
+    SourceFile() = default;
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+    ~SourceFile();
+
+    // Loads the file at `path`. Returns false, with errno set, if it cannot be
+    // opened or read.
+    bool open(const std::string &path);
+
+    std::string_view text() const
+    {
+        return { data, size };
+    }
+};
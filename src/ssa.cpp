@@ -0,0 +1,240 @@
+#include "ssa.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "liveness.h"
+
+// Parameters are defined on entry to the entry block, so nothing may jump back
+// to it; if anything does, its code moves to a new block it jumps to.
+static void
+split_entry(IRFunction &fun)
+{
+    if (fun.blocks[0].preds.empty()) {
+        return;
+    }
+
+    int    body            = fun.new_block();
+    IRInst jmp;
+    jmp.op                 = IROp::Jmp;
+    jmp.target[0]          = body;
+    fun.blocks[body].insts = std::move(fun.blocks[0].insts);
+    fun.blocks[0].insts    = { jmp };
+
+    for (auto &block : fun.blocks) {
+        for (int &target : block.terminator().target) {
+            if (target == 0 && block.id != 0) {
+                target = body;
+            }
+        }
+    }
+    compute_cfg(fun);
+}
+
+static std::vector<std::vector<int>>
+dominance_frontiers(IRFunction &fun, Dominators &dom)
+{
+    std::vector<std::vector<int>> res(fun.blocks.size());
+    for (auto &block : fun.blocks) {
+        if (block.preds.size() < 2 || dom.idom[block.id] < 0) {
+            continue;
+        }
+        for (int pred : block.preds) {
+            for (int b = pred; b != dom.idom[block.id] && dom.idom[b] >= 0;
+                 b = dom.idom[b]) {
+                if (res[b].empty() || res[b].back() != block.id) {
+                    res[b].push_back(block.id);
+                }
+            }
+        }
+    }
+    return res;
+}
+
+void
+construct_ssa(IRFunction &fun)
+{
+    split_entry(fun);
+
+    int  n_blocks  = fun.blocks.size();
+    int  n_regs    = fun.n_regs();
+    auto dom       = compute_dominators(fun);
+    auto frontiers = dominance_frontiers(fun, dom);
+    auto liveness  = compute_liveness(fun);
+
+    fun.ssa_origin.resize(n_regs);
+    std::iota(fun.ssa_origin.begin(), fun.ssa_origin.end(), 0);
+
+    std::vector<std::vector<int>> def_blocks(n_regs);
+    for (int p = 0; p < fun.n_params; p++) {
+        def_blocks[p].push_back(0);
+    }
+    for (auto &block : fun.blocks) {
+        for (auto &inst : block.insts) {
+            if (inst.dst < 0) {
+                continue;
+            }
+            auto &defs = def_blocks[inst.dst];
+            if (defs.empty() || defs.back() != block.id) {
+                defs.push_back(block.id);
+            }
+        }
+    }
+
+    // A register gets a phi wherever the definitions reaching a block can
+    // differ and it is live on entry. `placed` and `queued` hold the last
+    // register each block got a phi for and was queued for.
+    std::vector<std::vector<int>> phis(n_blocks);
+    std::vector<int>              placed(n_blocks, -1);
+    std::vector<int>              queued(n_blocks, -1);
+    for (int r = 0; r < n_regs; r++) {
+        std::vector<int> work = def_blocks[r];
+        for (int b : work) {
+            queued[b] = r;
+        }
+
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int f : frontiers[b]) {
+                if (placed[f] == r || !liveness.is_live_in(f, r)) {
+                    continue;
+                }
+                phis[f].push_back(r);
+                placed[f] = r;
+                if (queued[f] != r) {
+                    queued[f] = r;
+                    work.push_back(f);
+                }
+            }
+        }
+    }
+
+    for (auto &block : fun.blocks) {
+        std::vector<IRInst> insts;
+        for (int r : phis[block.id]) {
+            IRInst phi;
+            phi.op   = IROp::Phi;
+            phi.dst  = r;
+            phi.args = std::vector<int>(block.preds.size(), r);
+            insts.push_back(std::move(phi));
+        }
+        for (auto &inst : block.insts) {
+            insts.push_back(std::move(inst));
+        }
+        block.insts = std::move(insts);
+    }
+
+    // Rename in a preorder walk of the dominator tree, keeping the current
+    // version of every register on a stack. The walk is iterative for the
+    // same reason as postorder().
+    std::vector<std::vector<int>> names(n_regs);
+    std::vector<std::vector<int>> pushed(n_blocks);
+    for (int r = 0; r < n_regs; r++) {
+        names[r] = { r };
+    }
+
+    std::vector<std::pair<int, bool>> stack = { { 0, false } };
+    while (!stack.empty()) {
+        auto [id, done] = stack.back();
+        stack.pop_back();
+        if (done) {
+            for (int r : pushed[id]) {
+                names[r].pop_back();
+            }
+            continue;
+        }
+        stack.push_back({ id, true });
+
+        auto &block = fun.blocks[id];
+        for (auto &inst : block.insts) {
+            if (inst.op != IROp::Phi) {
+                for_each_use(inst, [&](int &reg) { reg = names[reg].back(); });
+            }
+            if (inst.dst >= 0) {
+                int origin = inst.dst;
+                inst.dst   = fun.new_reg(fun.reg_types[origin]);
+                fun.ssa_origin.push_back(origin);
+                names[origin].push_back(inst.dst);
+                pushed[id].push_back(origin);
+            }
+        }
+
+        for (int succ : block.succs) {
+            auto &preds = fun.blocks[succ].preds;
+            int   j = std::find(preds.begin(), preds.end(), id) - preds.begin();
+            for (auto &inst : fun.blocks[succ].insts) {
+                if (inst.op != IROp::Phi) {
+                    break;
+                }
+                inst.args[j] = names[fun.ssa_origin[inst.dst]].back();
+            }
+        }
+
+        for (int child : dom.children[id]) {
+            stack.push_back({ child, false });
+        }
+    }
+}
+
+void
+destruct_ssa(IRFunction &fun)
+{
+    // The original registers are the ones that are their own origin, and keep
+    // their numbers. Registers created since construct_ssa() follow them.
+    int n_orig = 0;
+    for (int origin : fun.ssa_origin) {
+        n_orig = std::max(n_orig, origin + 1);
+    }
+
+    std::vector<int>  new_reg(fun.n_regs());
+    std::vector<Type> reg_types(fun.reg_types.begin(),
+                                fun.reg_types.begin() + n_orig);
+    for (int r = 0; r < fun.n_regs(); r++) {
+        if (r < (int)fun.ssa_origin.size()) {
+            new_reg[r] = fun.ssa_origin[r];
+        } else {
+            new_reg[r] = reg_types.size();
+            reg_types.push_back(fun.reg_types[r]);
+        }
+    }
+
+    for (auto &block : fun.blocks) {
+        std::vector<IRInst> insts;
+        for (auto &inst : block.insts) {
+            if (inst.op == IROp::Phi) {
+                continue;
+            }
+            for_each_use(inst, [&](int &reg) { reg = new_reg[reg]; });
+            if (inst.dst >= 0) {
+                inst.dst = new_reg[inst.dst];
+            }
+            if (inst.op == IROp::Mov && inst.dst == inst.a) {
+                continue;
+            }
+            insts.push_back(std::move(inst));
+        }
+        block.insts = std::move(insts);
+    }
+
+    fun.reg_types = std::move(reg_types);
+    fun.ssa_origin.clear();
+}
+
+void
+remove_edge(IRFunction &fun, int pred, int succ)
+{
+    auto &preds = fun.blocks[succ].preds;
+    auto  it    = std::find(preds.begin(), preds.end(), pred);
+    int   j     = it - preds.begin();
+    preds.erase(it);
+
+    for (auto &inst : fun.blocks[succ].insts) {
+        if (inst.op == IROp::Phi) {
+            inst.args.erase(inst.args.begin() + j);
+        }
+    }
+
+    auto &succs = fun.blocks[pred].succs;
+    succs.erase(std::find(succs.begin(), succs.end(), succ));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ir.h"
+
+// Static single assignment form, for the optimization passes that need it.
+//
+// construct_ssa() renames registers so that every register has exactly one
+// definition, placing phi instructions at the (pruned) iterated dominance
+// frontiers of the original definitions. Parameters keep their numbers and
+// count as defined on entry; a read that no definition reaches keeps the
+// original register, whose value is undefined there.
+//
+// destruct_ssa() does not insert copies for phis: it maps every version back
+// to the register it was made from (IRFunction::ssa_origin) and drops the
+// phis. That is correct as long as no two versions of the same register are
+// ever live at the same time, which holds for the IR as lowered and is kept
+// by passes that only replace values with constants or delete code. A pass
+// that makes a use read a different value must copy that value to a
+// register of its own first.
+void
+construct_ssa(IRFunction &fun);
+
+void
+destruct_ssa(IRFunction &fun);
+
+// Removes the CFG edge from `pred` to `succ`, along with the phi operands for
+// it. The caller takes care of `pred`'s terminator.
+void
+remove_edge(IRFunction &fun, int pred, int succ);
@@ -0,0 +1,52 @@
+#include "string_pool.h"
+
+#include <cstring>
+#include <new>
+
+StringPool string_pool;
+
+StringPool::StringPool()
+{
+    intern("");
+}
+
+char *
+StringPool::allocate(size_t size)
+{
+    // Keep every entry aligned for its length field.
+    size = (size + alignof(PoolString) - 1) & ~(alignof(PoolString) - 1);
+
+    if (size > CHUNK_SIZE) {
+        chunks.push_back(std::make_unique<char[]>(size));
+        return chunks.back().get();
+    }
+    if (size > free_size) {
+        chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+        free      = chunks.back().get();
+        free_size = CHUNK_SIZE;
+    }
+
+    char *res = free;
+    free += size;
+    free_size -= size;
+    return res;
+}
+
+int
+StringPool::intern(std::string_view s)
+{
+    auto it = index.find(s);
+    if (it != index.end()) {
+        return it->second;
+    }
+
+    char *mem   = allocate(sizeof(PoolString) + s.size() + 1);
+    auto  entry = new (mem) PoolString{ (uint32_t)s.size() };
+    memcpy(mem + sizeof(PoolString), s.data(), s.size());
+    mem[sizeof(PoolString) + s.size()] = '\0';
+
+    int idx = entries.size();
+    entries.push_back(entry);
+    index.emplace(entry->view(), idx);
+    return idx;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A string constant as the pool stores it: a 32-bit length, directly followed
+// by the bytes and a terminating NUL.
+struct PoolString {
+    uint32_t len;
+
+    const char *chars() const
+    {
+        return reinterpret_cast<const char *>(this + 1);
+    }
+
+    std::string_view view() const
+    {
+        return { chars(), len };
+    }
+};
+
+// The string literals of a program, each distinct string stored once. Entries
+// are numbered in the order they are first interned, starting with the empty
+// string at index 0, and never move or change, so engines can embed their
+// addresses in code and compare constants by address.
+class StringPool {
+private:
+    // Entries are packed into chunks of this many bytes; longer strings get a
+    // chunk of their own.
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>>       chunks;
+    char                                      *free      = nullptr;
+    size_t                                     free_size = 0;
+    std::vector<const PoolString *>            entries;
+    std::unordered_map<std::string_view, int> index;
+
+    char *allocate(size_t size);
+
+public:
+    StringPool();
+
+    // Returns the index of `s`, adding it if it is not in the pool yet.
+    int intern(std::string_view s);
+
+    const PoolString *get(int idx) const
+    {
+        return entries[idx];
+    }
+
+    int size() const
+    {
+        return entries.size();
+    }
+};
+
+// The pool of the program being compiled.
+extern StringPool string_pool;
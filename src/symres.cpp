@@ -24,8 +24,16 @@ SymbolResolverVisitor::visit_var_node(VarNode *node)
     // this variable. Error out:
     if (!res.has_value()) {
         throw AlbatrossError("Could not find symbol " + node->name,
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
+                             EXIT_SYMRES_FAILURE);
+    }
+
+    // Functions are not closures; a nested function may only see globals and
+    // its own locals.
+    if (res->fun_idx != 0 && res->fun_idx != cur_fun) {
+        throw AlbatrossError("Cannot access local variable " + node->name
+                                 + " of an enclosing function",
+                             node->pos,
                              EXIT_SYMRES_FAILURE);
     }
 
@@ -53,8 +61,7 @@ SymbolResolverVisitor::visit_call_node(CallNode *node)
 
     if (!res.has_value()) {
         throw AlbatrossError("Undefined function " + node->name,
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_SYMRES_FAILURE);
     }
 
@@ -82,15 +89,15 @@ SymbolResolverVisitor::visit_vardecl_node(VardeclNode *node)
     // Check that we are not redeclaring the variable.
     if (vars.cur_scope()->find_symbol(name)) {
         throw AlbatrossError("Redefinition of variable " + name,
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_SYMRES_FAILURE);
     }
 
     node->rhs->accept(*this);
 
     // Construct a VarInfo struct for this variable.
-    vars.add_symbol(name, VarInfo{ type, vars.sym_idx });
+    node->var_info = VarInfo{ type, vars.sym_idx, cur_fun, frame_size++ };
+    vars.add_symbol(name, node->var_info.value());
 }
 
 void
@@ -135,8 +142,7 @@ SymbolResolverVisitor::visit_call_stmt_node(CallStmtNode *node)
 
     if (!res.has_value()) {
         throw AlbatrossError("Undefined function " + node->name,
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_SYMRES_FAILURE);
     }
 
@@ -152,23 +158,34 @@ SymbolResolverVisitor::visit_fundec_node(FundecNode *node)
     // Make sure we're not redeclaring a function.
     if (functions.cur_scope()->find_symbol(node->name).has_value()) {
         throw AlbatrossError("Redefinition of function " + node->name,
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_SYMRES_FAILURE);
     }
 
     // TODO: Constructing FunInfo this way is bad. Make an actual constructor.
-    functions.add_symbol(
-        node->name, FunInfo{ node->ret_type, functions.sym_idx, node->params });
+    node->fun_info =
+        FunInfo{ node->ret_type, functions.sym_idx, node->params };
+    functions.add_symbol(node->name, node->fun_info.value());
     vars.enter_scope();
 
-    // Add parameters into the scope of the function body.
+    int saved_fun        = cur_fun;
+    int saved_frame_size = frame_size;
+    cur_fun              = node->fun_info->var_idx_db;
+    frame_size           = 0;
+
+    // Add parameters into the scope of the function body. They occupy the
+    // first slots of the frame, in declaration order.
     for (auto &p : node->params) {
-        vars.add_symbol(p.name, VarInfo{ p.type, vars.sym_idx });
+        vars.add_symbol(p.name,
+                        VarInfo{ p.type, vars.sym_idx, cur_fun, frame_size++ });
     }
 
     visit_stmts(node->body);
     vars.exit_scope();
+
+    node->frame_size = frame_size;
+    cur_fun          = saved_fun;
+    frame_size       = saved_frame_size;
 }
 
 void
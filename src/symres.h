@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ast.h"
+#include "builtins.h"
 #include "symtab.h"
 #include "types.h"
 
@@ -9,6 +10,11 @@ private:
     SymbolTable<VarInfo> vars;
     SymbolTable<FunInfo> functions;
 
+    // var_idx_db of the function whose body is being resolved (0 for the top
+    // level), and the number of frame slots handed out in it so far.
+    int cur_fun    = 0;
+    int frame_size = 0;
+
 public:
     void visit_int_node(IntNode *node) override;
     void visit_string_node(StrNode *node) override;
@@ -32,6 +38,12 @@ public:
     {
         vars.enter_scope();
         functions.enter_scope();
+
+        for (auto &decl : builtin_decls) {
+            std::string name = decl.name;
+            functions.add_symbol(
+                name, FunInfo{ decl.ret_type, functions.sym_idx, decl.params });
+        }
     }
 
     ~SymbolResolverVisitor()
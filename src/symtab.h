@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ast.h"
+#include <cassert>
 #include <memory>
 #include <optional>
 #include <unordered_map>
@@ -1,7 +1,10 @@
 #pragma once
 
-#include <memory>
-#include <string>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
 
 enum class TokenType : unsigned char {
     Eof,
@@ -55,9 +58,55 @@ enum class TokenType : unsigned char {
 };
 
 struct Token {
-    int line_num, col_num;
+    // Where the token starts; for a string literal, its opening quote.
+    SourcePos pos;
 
     TokenType type;
 
-    std::string string_value;
+    // The token's text, viewed in the program source. A string literal's is
+    // what lies between the quotes, escape sequences and all.
+    std::string_view text;
+};
+
+// The tokens of a program, flattened into one array per field so that a
+// token costs no allocation of its own and the parser reads them in order
+// from contiguous memory. Token i starts at offsets[i], and its text is the
+// lengths[i] bytes from there, or from just past the quote of a string
+// literal. The lexer always ends the stream with an Eof token.
+struct TokenStream {
+    std::string_view       source;
+    std::vector<TokenType> types;
+    std::vector<SourcePos> offsets;
+    std::vector<uint32_t>  lengths;
+
+    TokenStream(std::string_view source)
+        : source(source)
+    {
+    }
+
+    size_t size() const
+    {
+        return types.size();
+    }
+
+    void reserve(size_t n)
+    {
+        types.reserve(n);
+        offsets.reserve(n);
+        lengths.reserve(n);
+    }
+
+    // Appends `token`, whose text has to be a view of `source`.
+    void push(const Token &token)
+    {
+        types.push_back(token.type);
+        offsets.push_back(token.pos);
+        lengths.push_back(token.text.size());
+    }
+
+    Token operator[](size_t i) const
+    {
+        SourcePos text = offsets[i] + (types[i] == TokenType::StrLiteral);
+        return { offsets[i], types[i], source.substr(text, lengths[i]) };
+    }
 };
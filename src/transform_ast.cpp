@@ -1,5 +1,8 @@
 #include "transform_ast.h"
 #include "ast.h"
+#include "error.h"
+#include "runtime.h"
+#include "simplify.h"
 #include <vector>
 
 // Try to fold an expression. Returns true if folding was performed, false if
@@ -22,6 +25,16 @@ fold_exp(std::unique_ptr<ExpNode> &exp)
         folded_something |= fold_exp(node->lhs);
         folded_something |= fold_exp(node->rhs);
 
+        // A division by a constant 0 is an error if it ever runs, but it
+        // may sit in code that never does, so it is only warned about.
+        if ((node->op == Operator::Div || node->op == Operator::Rem)
+            && node->rhs->kind == ExpNode::IntExp
+            && dynamic_cast<IntNode *>(node->rhs.get())->ival == 0) {
+            add_warning("Division by zero, which fails whenever it runs",
+                        node->pos);
+            break;
+        }
+
         // After folding the children, it may be the case that both children
         // are now integer constants. In that case, apply the operation
         // contained in this BinOpNode and allocate a new IntNode with the
@@ -31,50 +44,36 @@ fold_exp(std::unique_ptr<ExpNode> &exp)
             int vlhs = dynamic_cast<IntNode *>(node->lhs.get())->ival;
             int vrhs = dynamic_cast<IntNode *>(node->rhs.get())->ival;
 
-            auto res = new IntNode();
-            switch (node->op) {
-            case Operator::Or: res->ival = vlhs || vrhs; break;
-            case Operator::And: res->ival = vlhs && vrhs; break;
-            case Operator::Bor: res->ival = vlhs | vrhs; break;
-            case Operator::Xor: res->ival = vlhs ^ vrhs; break;
-            case Operator::Band: res->ival = vlhs & vrhs; break;
-            case Operator::Ne: res->ival = vlhs != vrhs; break;
-            case Operator::Eq: res->ival = vlhs == vrhs; break;
-            case Operator::Gt: res->ival = vlhs > vrhs; break;
-            case Operator::Ge: res->ival = vlhs >= vrhs; break;
-            case Operator::Lt: res->ival = vlhs < vrhs; break;
-            case Operator::Le: res->ival = vlhs <= vrhs; break;
-            case Operator::Add: res->ival = vlhs + vrhs; break;
-            case Operator::Sub: res->ival = vlhs - vrhs; break;
-            case Operator::Mul: res->ival = vlhs * vrhs; break;
-            case Operator::Div: res->ival = vlhs / vrhs; break;
-            case Operator::Rem: res->ival = vlhs % vrhs; break;
-            default: perror("Invalid operator"); exit(EXIT_FAILURE);
-            }
+            auto res  = new IntNode();
+            res->ival = eval_binop(node->op, vlhs, vrhs);
 
             exp.reset(res);
             folded_something = true;
         }
+        folded_something |= simplify_exp(exp);
         break;
     }
     case ExpNode::UnopExp: {
         auto node = dynamic_cast<UnOpNode *>(exp.get());
         folded_something |= fold_exp(node->e);
         if (node->e->kind == ExpNode::IntExp) {
-            auto res = new IntNode();
-            int  v   = dynamic_cast<IntNode *>(node->e.get())->ival;
-            switch (node->op) {
-            case Operator::Not: res->ival = !v; break;
-            case Operator::Neg: res->ival = -v; break;
-            default: perror("Invalid operator"); exit(EXIT_FAILURE);
-            }
+            auto res  = new IntNode();
+            int  v    = dynamic_cast<IntNode *>(node->e.get())->ival;
+            res->ival = eval_unop(node->op, v);
 
             exp.reset(res);
             folded_something = true;
         }
+        folded_something |= simplify_exp(exp);
+        break;
+    }
+    case ExpNode::CallExp: {
+        auto node = dynamic_cast<CallNode *>(exp.get());
+        for (auto &arg : node->args) {
+            folded_something |= fold_exp(arg);
+        }
         break;
     }
-    case ExpNode::CallExp: break;
     }
 
     return folded_something;
@@ -98,21 +97,16 @@ fold_stmt(StmtNode *stmt)
     case StmtNode::IfStmt: {
         auto node = dynamic_cast<IfNode *>(stmt);
         folded_something |= fold_exp(node->cond);
-        folded_something |= fold_stmts(node->then_stmts);
-        folded_something |= fold_stmts(node->else_stmts);
         break;
     }
     case StmtNode::WhileStmt: {
         auto node = dynamic_cast<WhileNode *>(stmt);
         folded_something |= fold_exp(node->cond);
-        folded_something |= fold_stmts(node->body_stmts);
-        folded_something |= fold_stmts(node->otherwise_stmts);
         break;
     }
     case StmtNode::RepeatStmt: {
         auto node = dynamic_cast<RepeatNode *>(stmt);
         folded_something |= fold_exp(node->cond);
-        folded_something |= fold_stmts(node->body_stmts);
         break;
     }
     case StmtNode::CallStmt: {
@@ -122,11 +116,7 @@ fold_stmt(StmtNode *stmt)
         }
         break;
     }
-    case StmtNode::FundecStmt: {
-        auto node = dynamic_cast<FundecNode *>(stmt);
-        folded_something |= fold_stmts(node->body);
-        break;
-    }
+    case StmtNode::FundecStmt: break;
     case StmtNode::RetStmt: {
         auto node = dynamic_cast<RetNode *>(stmt);
         if (node->ret_exp.has_value()) {
@@ -139,18 +129,26 @@ fold_stmt(StmtNode *stmt)
     return folded_something;
 }
 
-bool
-fold_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
+// Replace the statement at `it` with the statements in `body`. Returns an
+// iterator to the first lifted statement (or to the statement after `it` if
+// `body` is empty), so that the lifted statements are visited next.
+static std::list<std::unique_ptr<StmtNode>>::iterator
+lift_stmts(std::list<std::unique_ptr<StmtNode>>          &stmts,
+           std::list<std::unique_ptr<StmtNode>>::iterator it,
+           std::list<std::unique_ptr<StmtNode>>          &body)
 {
-    bool folded_something = false;
-    for (auto &stmt : stmts) {
-        folded_something |= fold_stmt(stmt.get());
-    }
-    return folded_something;
+    auto first = body.begin();
+    bool empty = body.empty();
+
+    stmts.splice(it, body);
+    it = stmts.erase(it);
+
+    return empty ? it : first;
 }
 
 // Perform DCE (dead code elimination) on a list of statements. This will, among
 // other things, remove unreachable branches, sequential return statements, etc.
+// The lists nested in the statements are left alone.
 bool
 dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
 {
@@ -176,12 +174,7 @@ dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
                 // Lift statements out of the branch to be
                 // executed and then delete the if statement
                 // itself.
-                stmts.splice(it, stmts_to_erase);
-                it = stmts.erase(it);
-
-                // Decrement iterator so we iterate over the
-                // lifted statements next.
-                it--;
+                it            = lift_stmts(stmts, it, stmts_to_erase);
                 performed_dce = true;
                 continue;
             }
@@ -192,10 +185,11 @@ dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
             if (node->cond->kind == ExpNode::IntExp) {
                 auto cond_node = dynamic_cast<IntNode *>(node->cond.get());
 
-                // Eliminate while loops that will not execute
-                // This is wrong
+                // A while loop that will not execute is replaced by its
+                // otherwise block, which is lifted out the same way as the
+                // taken branch of an if statement.
                 if (cond_node->ival == 0) {
-                    it            = stmts.erase(it);
+                    it = lift_stmts(stmts, it, node->otherwise_stmts);
                     performed_dce = true;
                     continue;
                 }
@@ -217,13 +211,7 @@ dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
             break;
         }
         case StmtNode::CallStmt: break;
-        case StmtNode::FundecStmt: {
-            auto node = dynamic_cast<FundecNode *>(stmt.get());
-            if (dce_stmts(node->body)) {
-                performed_dce = true;
-            }
-            break;
-        }
+        case StmtNode::FundecStmt: break;
 
         // Erase all statements after the return statement.
         case StmtNode::RetStmt: {
@@ -243,4 +231,53 @@ dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts)
         it++;
     }
     return performed_dce;
-}
\ No newline at end of file
+}
+
+static void
+mark_tail_calls_in(std::list<std::unique_ptr<StmtNode>> &stmts, int fun_idx)
+{
+    for (auto &stmt : stmts) {
+        switch (stmt->kind) {
+        case StmtNode::IfStmt: {
+            auto node = dynamic_cast<IfNode *>(stmt.get());
+            mark_tail_calls_in(node->then_stmts, fun_idx);
+            mark_tail_calls_in(node->else_stmts, fun_idx);
+            break;
+        }
+        case StmtNode::WhileStmt: {
+            auto node = dynamic_cast<WhileNode *>(stmt.get());
+            mark_tail_calls_in(node->body_stmts, fun_idx);
+            mark_tail_calls_in(node->otherwise_stmts, fun_idx);
+            break;
+        }
+        case StmtNode::RepeatStmt: {
+            auto node = dynamic_cast<RepeatNode *>(stmt.get());
+            mark_tail_calls_in(node->body_stmts, fun_idx);
+            break;
+        }
+        case StmtNode::RetStmt: {
+            // A return leaves every enclosing loop, so it is a tail position
+            // wherever it appears.
+            auto node = dynamic_cast<RetNode *>(stmt.get());
+            if (node->ret_exp.has_value()
+                && node->ret_exp.value()->kind == ExpNode::CallExp) {
+                auto call = dynamic_cast<CallNode *>(node->ret_exp->get());
+                node->tail_call = call->fun_info->var_idx_db == fun_idx;
+            }
+            break;
+        }
+        default: break;
+        }
+    }
+}
+
+void
+mark_tail_calls(std::list<std::unique_ptr<StmtNode>> &stmts)
+{
+    for (auto &stmt : stmts) {
+        if (stmt->kind == StmtNode::FundecStmt) {
+            auto node = dynamic_cast<FundecNode *>(stmt.get());
+            mark_tail_calls_in(node->body, node->fun_info->var_idx_db);
+        }
+    }
+}
@@ -2,8 +2,20 @@
 #include <iostream>
 #include <vector>
 
+// Folds the expressions of `stmt` itself, leaving the statements nested in it
+// alone. Returns whether anything changed.
 bool
-fold_stmts(std::list<std::unique_ptr<StmtNode>> &stmts);
+fold_stmt(StmtNode *stmt);
 
+// Removes the statements of `stmts` that can never run, lifting the taken
+// branch of an if with a constant condition into `stmts`. The lists nested in
+// the statements are left alone. Returns whether anything changed.
 bool
-dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts);
\ No newline at end of file
+dce_stmts(std::list<std::unique_ptr<StmtNode>> &stmts);
+
+// Flags the return statements of every function that return the result of a
+// call to that same function (RetNode::tail_call). Every engine turns those
+// into an assignment of the arguments to the parameters and a jump back to
+// the start, so self tail recursion runs in constant stack space.
+void
+mark_tail_calls(std::list<std::unique_ptr<StmtNode>> &stmts);
\ No newline at end of file
@@ -13,8 +13,7 @@ TypecheckVisitor::typecheck_exp(ExpNode* node) {
     } catch (std::bad_optional_access &e) {
         throw AlbatrossError(
             "Tried typechecking expression, but visitor left no type",
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 }
@@ -40,12 +39,14 @@ TypecheckVisitor::visit_var_node(VarNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     std::cout << "Variable read \"" << node->name << "\" type "
               << type_to_str(type) << "\n";
 #endif
 #endif
 #endif
 #endif
+#endif
 }
 
 void
@@ -59,8 +60,7 @@ TypecheckVisitor::visit_binop_node(BinOpNode *node)
     } else {
         throw AlbatrossError("Unsupported operands: " + type_to_str(t_lhs) + " "
                                  + op_str(node->op) + " " + type_to_str(t_rhs),
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_TYPECHECK_FAILURE);
     }
 }
@@ -75,8 +75,7 @@ TypecheckVisitor::visit_unop_node(UnOpNode *node)
     } else {
         throw AlbatrossError("Unsupported operand: " + op_str(node->op) + " "
                                  + type_to_str(t),
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_TYPECHECK_FAILURE);
     }
 }
@@ -90,11 +89,13 @@ TypecheckVisitor::visit_call_node(CallNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     std::cout << "Function called \"" << node->name << "\" returns "
               << type_to_str(info.ret_type) << "\n";
 #endif
 #endif
 #endif
+#endif
 #endif
 
     // Check that the argument types match the parameter types.
@@ -106,8 +107,7 @@ TypecheckVisitor::visit_call_node(CallNode *node)
             "Incorrect number of arguments supplied for function " + node->name
                 + ": expected " + std::to_string(n_params) + ", got "
                 + std::to_string(n_args),
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -119,8 +119,7 @@ TypecheckVisitor::visit_call_node(CallNode *node)
             throw AlbatrossError("Mismatched type in function " + node->name
                                      + " for param " + info.params[i].name
                                      + ", position " + std::to_string(i),
-                                 node->line_num,
-                                 node->col_num,
+                                 node->pos,
                                  EXIT_TYPECHECK_FAILURE);
         }
     }
@@ -150,18 +149,19 @@ TypecheckVisitor::visit_assign_node(AssignNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     auto var = dynamic_cast<VarNode *>(node->lhs.get());
     std::cout << "Variable written \"" << var->name << "\" type "
               << type_to_str(type_lhs) << "\n";
 #endif
 #endif
 #endif
+#endif
 #endif
 
     if (type_lhs != type_rhs) {
         throw AlbatrossError("Mismatched types in assignment",
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_TYPECHECK_FAILURE);
     }
 }
@@ -175,11 +175,13 @@ TypecheckVisitor::visit_vardecl_node(VardeclNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     std::cout << "Variable declared \"" << node->lhs << "\" type "
               << type_to_str(type_lhs) << "\n";
 #endif
 #endif
 #endif
+#endif
 #endif
 
     // Typecheck rhs
@@ -187,8 +189,7 @@ TypecheckVisitor::visit_vardecl_node(VardeclNode *node)
 
     if (type_lhs != type_rhs) {
         throw AlbatrossError("Mismatched types in variable declaration",
-                             node->line_num,
-                             node->col_num,
+                             node->pos,
                              EXIT_TYPECHECK_FAILURE);
     }
     return;
@@ -204,8 +205,7 @@ TypecheckVisitor::visit_if_node(IfNode *node)
         throw AlbatrossError(
             "Condition expressions in if statements must be of type int, but got "
                 + type_to_str(cond_type),
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -223,8 +223,7 @@ TypecheckVisitor::visit_while_node(WhileNode *node)
         throw AlbatrossError(
             "Condition expressions in while statements must be of type int, but got "
                 + type_to_str(cond_type),
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -242,8 +241,7 @@ TypecheckVisitor::visit_repeat_node(RepeatNode *node)
         throw AlbatrossError(
             "Condition expressions in repeat statements must be of type int, but got "
                 + type_to_str(cond_type),
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -259,11 +257,13 @@ TypecheckVisitor::visit_call_stmt_node(CallStmtNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     std::cout << "Function called \"" << node->name << "\" returns "
               << type_to_str(info.ret_type) << "\n";
 #endif
 #endif
 #endif
+#endif
 #endif
 
     // Check that the argument types match the parameter types.
@@ -275,8 +275,7 @@ TypecheckVisitor::visit_call_stmt_node(CallStmtNode *node)
             "Incorrect number of arguments supplied for function " + node->name
                 + ": expected " + std::to_string(n_params) + ", got "
                 + std::to_string(n_args),
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -289,8 +288,7 @@ TypecheckVisitor::visit_call_stmt_node(CallStmtNode *node)
             throw AlbatrossError("Mismatched type in function " + node->name
                                      + " for param " + info.params[i].name
                                      + ", position " + std::to_string(i),
-                                 node->line_num,
-                                 node->col_num,
+                                 node->pos,
                                  EXIT_TYPECHECK_FAILURE);
         }
     }
@@ -317,8 +315,7 @@ TypecheckVisitor::visit_ret_node(RetNode *node)
         throw AlbatrossError(
             "Return statement does not return type specified in "
             "function declaration.",
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -329,8 +326,7 @@ TypecheckVisitor::visit_ret_node(RetNode *node)
             "Return expression in global scope must be of type "
             "'int', but got '"
                 + type_to_str(ret_exp_type) + "\'",
-            node->line_num,
-            node->col_num,
+            node->pos,
             EXIT_TYPECHECK_FAILURE);
     }
 
@@ -344,6 +340,7 @@ TypecheckVisitor::visit_fundec_node(FundecNode *node)
 #ifdef COMPILE_STAGE_PARSER
 #ifdef COMPILE_STAGE_SYMBOL_RESOLVER
 #ifdef COMPILE_STAGE_TYPE_CHECKER
+#ifndef COMPILE_STAGE_EXECUTOR
     std::cout << "Function declared \"" << node->name << "\" returns "
               << type_to_str(node->ret_type) << "\n";
 
@@ -356,6 +353,7 @@ TypecheckVisitor::visit_fundec_node(FundecNode *node)
 #endif
 #endif
 #endif
+#endif
 #endif
     fun_ret_type = node->ret_type;
     visit_stmts(node->body);
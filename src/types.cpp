@@ -1,7 +1,7 @@
 #include "types.h"
 
 Type
-str_to_type(std::string &type_str)
+str_to_type(std::string_view type_str)
 {
     if (type_str == "int")
         return Type::Int;
@@ -12,7 +12,7 @@ str_to_type(std::string &type_str)
     else if (type_str == "char")
         return Type::Char;
     else {
-        printf("Invalid type %s\n", type_str.c_str());
+        printf("Invalid type %.*s\n", (int)type_str.size(), type_str.data());
         exit(-1);
     }
 }
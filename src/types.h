@@ -5,7 +5,7 @@
 enum class Type { Int, String, Char, Void };
 
 Type
-str_to_type(std::string &type_str);
+str_to_type(std::string_view type_str);
 
 std::string
 type_to_str(Type type);
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "vm.h"
+
+#include <algorithm>
+
+#include "error.h"
+
+// The register stacks are sized so that the deepest possible chain of the
+// largest frames fits, which makes the call depth the only real limit.
+static size_t
+stack_size(BCProgram &program, uint16_t BCFunction::*n_regs)
+{
+    size_t max_frame = 0;
+    for (unsigned int i = 1; i < program.funs.size(); i++) {
+        if (program.funs[i]) {
+            max_frame = std::max<size_t>(max_frame, program.funs[i].get()->*n_regs);
+        }
+    }
+    return program.funs[0].get()->*n_regs + max_frame * MAX_CALL_DEPTH;
+}
+
+VM::VM(BCProgram &program)
+    : program(program)
+    , globals(program.n_globals, 0)
+    , int_stack(stack_size(program, &BCFunction::n_ints), 0)
+    , str_stack(stack_size(program, &BCFunction::n_strs), nullptr)
+{
+    frames.resize(MAX_CALL_DEPTH);
+}
+
+void
+VM::runtime_error(const std::string &msg, BCFunction *fun, const BCInst *inst)
+{
+    auto it = fun->positions.find(inst - fun->code.data());
+    if (it == fun->positions.end()) {
+        throw AlbatrossError(msg, -1, EXIT_RUNTIME_FAILURE);
+    }
+    throw AlbatrossError(msg, it->second, EXIT_RUNTIME_FAILURE);
+}
+
+// With GCC and Clang every handler jumps straight to the next one through a
+// table of label addresses, which gives the branch predictor one indirect
+// jump per opcode instead of a single shared one. Other compilers get a
+// plain switch.
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(name) L_##name:
+#define VM_NEXT()                                                             \
+    do {                                                                      \
+        n_steps++;                                                            \
+        inst = pc++;                                                          \
+        goto *labels[inst->op];                                               \
+    } while (0)
+#define VM_DISPATCH() VM_NEXT();
+#else
+#define VM_CASE(name) case BC_##name:
+#define VM_NEXT() goto dispatch
+#define VM_DISPATCH()                                                         \
+    dispatch:                                                                 \
+    n_steps++;                                                                \
+    inst = pc++;                                                              \
+    switch (inst->op)
+#endif
+
+int
+VM::run()
+{
+#ifdef VM_COMPUTED_GOTO
+    static void *labels[] = {
+#define BC_LABEL(name) &&L_##name,
+        BC_OPS(BC_LABEL)
+#undef BC_LABEL
+    };
+#endif
+
+    BCFunction        *fun  = program.funs[0].get();
+    int32_t           *ints = int_stack.data();
+    const PoolString **strs = str_stack.data();
+    const BCInst      *pc   = fun->code.data();
+    const BCInst      *inst;
+    uint64_t           n_steps = 0;
+    Frame              *fp         = frames.data();
+    Frame              *frames_end = frames.data() + frames.size();
+
+#define VM_RETURN()                                                           \
+    do {                                                                      \
+        fp--;                                                                 \
+        fun  = fp->fun;                                                       \
+        ints = fp->ints;                                                      \
+        strs = fp->strs;                                                      \
+        pc   = fp->ret_pc;                                                    \
+    } while (0)
+
+    VM_DISPATCH()
+    {
+        VM_CASE(LOADK)
+        {
+            ints[inst->a] = inst->imm;
+            VM_NEXT();
+        }
+        VM_CASE(LOADS)
+        {
+            strs[inst->a] = string_pool.get(inst->imm);
+            VM_NEXT();
+        }
+        VM_CASE(MOV)
+        {
+            ints[inst->a] = ints[inst->b];
+            VM_NEXT();
+        }
+        VM_CASE(SMOV)
+        {
+            strs[inst->a] = strs[inst->b];
+            VM_NEXT();
+        }
+        VM_CASE(LOADG)
+        {
+            ints[inst->a] = globals[inst->imm];
+            VM_NEXT();
+        }
+        VM_CASE(LOADGS)
+        {
+            strs[inst->a] = value_str(globals[inst->imm]);
+            VM_NEXT();
+        }
+        VM_CASE(STOREG)
+        {
+            globals[inst->imm] = ints[inst->a];
+            VM_NEXT();
+        }
+        VM_CASE(STOREGS)
+        {
+            globals[inst->imm] = str_value(strs[inst->a]);
+            VM_NEXT();
+        }
+
+#define VM_BINOP(name, op)                                                    \
+    VM_CASE(name)                                                             \
+    {                                                                         \
+        ints[inst->a] = eval_binop(op, ints[inst->b], ints[inst->c]);         \
+        VM_NEXT();                                                            \
+    }                                                                         \
+    VM_CASE(name##K)                                                          \
+    {                                                                         \
+        ints[inst->a] = eval_binop(op, ints[inst->b], inst->c);               \
+        VM_NEXT();                                                            \
+    }
+
+        VM_BINOP(ADD, Operator::Add)
+        VM_BINOP(SUB, Operator::Sub)
+        VM_BINOP(MUL, Operator::Mul)
+        VM_BINOP(EQ, Operator::Eq)
+        VM_BINOP(NE, Operator::Ne)
+        VM_BINOP(LT, Operator::Lt)
+        VM_BINOP(LE, Operator::Le)
+        VM_BINOP(GT, Operator::Gt)
+        VM_BINOP(GE, Operator::Ge)
+#undef VM_BINOP
+
+        VM_CASE(DIV)
+        {
+            if (ints[inst->c] == 0) {
+                runtime_error("Division by zero", fun, inst);
+            }
+            ints[inst->a]
+                = eval_binop(Operator::Div, ints[inst->b], ints[inst->c]);
+            VM_NEXT();
+        }
+        VM_CASE(REM)
+        {
+            if (ints[inst->c] == 0) {
+                runtime_error("Division by zero", fun, inst);
+            }
+            ints[inst->a]
+                = eval_binop(Operator::Rem, ints[inst->b], ints[inst->c]);
+            VM_NEXT();
+        }
+        VM_CASE(BAND)
+        {
+            ints[inst->a] = ints[inst->b] & ints[inst->c];
+            VM_NEXT();
+        }
+        VM_CASE(BOR)
+        {
+            ints[inst->a] = ints[inst->b] | ints[inst->c];
+            VM_NEXT();
+        }
+        VM_CASE(XOR)
+        {
+            ints[inst->a] = ints[inst->b] ^ ints[inst->c];
+            VM_NEXT();
+        }
+        VM_CASE(NEG)
+        {
+            ints[inst->a] = eval_unop(Operator::Neg, ints[inst->b]);
+            VM_NEXT();
+        }
+        VM_CASE(NOT)
+        {
+            ints[inst->a] = !ints[inst->b];
+            VM_NEXT();
+        }
+        VM_CASE(JMP)
+        {
+            pc += inst->imm;
+            VM_NEXT();
+        }
+        VM_CASE(JT)
+        {
+            if (ints[inst->a]) {
+                pc += inst->imm;
+            }
+            VM_NEXT();
+        }
+        VM_CASE(JF)
+        {
+            if (!ints[inst->a]) {
+                pc += inst->imm;
+            }
+            VM_NEXT();
+        }
+        VM_CASE(CALL)
+        {
+            // The callee's registers start right after the caller's. The
+            // register stacks have room for MAX_CALL_DEPTH of the largest
+            // frames, so only the depth needs checking.
+            if (fp == frames_end) {
+                runtime_error("Stack overflow", fun, inst);
+            }
+
+            BCFunction        *callee   = program.funs[inst->imm].get();
+            int32_t           *new_ints = ints + fun->n_ints;
+            const PoolString **new_strs = strs + fun->n_strs;
+
+            // Parameters take the first registers of their file, in order.
+            const uint8_t *is_str = callee->param_is_str.data();
+            int            argc   = callee->param_is_str.size();
+            int            n_int  = 0;
+            int            n_str  = 0;
+            for (int i = 0; i < argc; i += 3, pc++) {
+                uint16_t regs[3] = { pc->a, pc->b, (uint16_t)pc->c };
+                for (int j = 0; j < 3 && i + j < argc; j++) {
+                    if (is_str[i + j]) {
+                        new_strs[n_str++] = strs[regs[j]];
+                    } else {
+                        new_ints[n_int++] = ints[regs[j]];
+                    }
+                }
+            }
+
+            *fp++ = Frame{ fun, pc, ints, strs, inst->a };
+            fun   = callee;
+            ints  = new_ints;
+            strs  = new_strs;
+            pc    = callee->code.data();
+            VM_NEXT();
+        }
+        VM_CASE(ARGS)
+        {
+            // Only ever skipped over by CALL.
+            VM_NEXT();
+        }
+        VM_CASE(RET)
+        {
+            int32_t v = ints[inst->a];
+            if (fp == frames.data()) {
+                rt_stats.instructions = n_steps;
+                return v;
+            }
+            VM_RETURN();
+            ints[fp->ret_dst] = v;
+            VM_NEXT();
+        }
+        VM_CASE(RETS)
+        {
+            // Only functions return strings, so there is always a caller.
+            const PoolString *v = strs[inst->a];
+            VM_RETURN();
+            strs[fp->ret_dst] = v;
+            VM_NEXT();
+        }
+        VM_CASE(RETV)
+        {
+            if (fp == frames.data()) {
+                rt_stats.instructions = n_steps;
+                return 0;
+            }
+            VM_RETURN();
+            VM_NEXT();
+        }
+        VM_CASE(PRINTI)
+        {
+            rt_printint(ints[inst->a]);
+            VM_NEXT();
+        }
+        VM_CASE(PRINTS)
+        {
+            rt_printstring(str_value(strs[inst->a]));
+            VM_NEXT();
+        }
+        VM_CASE(EXIT)
+        {
+            rt_stats.instructions = n_steps;
+            rt_exit(ints[inst->a]);
+        }
+    }
+
+    // Not reached: every handler ends in a jump or returns.
+    return 0;
+}
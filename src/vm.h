@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "runtime.h"
+
+// A register VM for the bytecode in bytecode.h. Each frame is a window into
+// two preallocated stacks, one of 32-bit ints and one of string pointers, so
+// an int-only frame costs four bytes per register. Calls and returns are
+// handled inside the dispatch loop and never recurse on the C++ stack.
+class VM {
+private:
+    struct Frame {
+        BCFunction        *fun;
+        const BCInst      *ret_pc;
+        int32_t           *ints;
+        const PoolString **strs;
+        uint16_t           ret_dst;
+    };
+
+    BCProgram &program;
+
+    std::vector<Value>              globals;
+    std::vector<int32_t>            int_stack;
+    std::vector<const PoolString *> str_stack;
+    std::vector<Frame>              frames;
+
+    [[noreturn]] void runtime_error(const std::string &msg,
+                                    BCFunction        *fun,
+                                    const BCInst      *inst);
+
+public:
+    VM(BCProgram &program);
+
+    // Runs the top-level code and returns the program's exit code.
+    int run();
+};
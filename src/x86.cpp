@@ -0,0 +1,479 @@
+#include "x86.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void
+Assembler::emit32(int32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        emit8(v >> (8 * i));
+    }
+}
+
+void
+Assembler::emit64(int64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        emit8(v >> (8 * i));
+    }
+}
+
+static bool
+is_int8(int64_t v)
+{
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+void
+Assembler::rex(bool wide, int reg, int rm, bool force)
+{
+    uint8_t prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (prefix != 0x40 || force) {
+        emit8(prefix);
+    }
+}
+
+void
+Assembler::modrm(int reg, int rm)
+{
+    emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void
+Assembler::modrm(int reg, Mem mem)
+{
+    int base = mem.base & 7;
+
+    // RBP and R13 as a base have no disp-less encoding; RSP and R12 need a
+    // SIB byte.
+    int mod;
+    if (mem.disp == 0 && base != RBP) {
+        mod = 0;
+    } else if (is_int8(mem.disp)) {
+        mod = 1;
+    } else {
+        mod = 2;
+    }
+
+    emit8((mod << 6) | ((reg & 7) << 3) | base);
+    if (base == RSP) {
+        emit8(0x24);
+    }
+
+    if (mod == 1) {
+        emit8(mem.disp);
+    } else if (mod == 2) {
+        emit32(mem.disp);
+    }
+}
+
+void
+Assembler::op(uint8_t opc, bool wide, int reg, int rm, bool byte_rm)
+{
+    rex(wide, reg, rm, byte_rm && rm >= 4 && rm < 8);
+    emit8(opc);
+    modrm(reg, rm);
+}
+
+void
+Assembler::op(uint8_t opc, bool wide, int reg, Mem mem)
+{
+    rex(wide, reg, mem.base);
+    emit8(opc);
+    modrm(reg, mem);
+}
+
+void
+Assembler::op0f(uint8_t opc, bool wide, int reg, int rm, bool byte_rm)
+{
+    rex(wide, reg, rm, byte_rm && rm >= 4 && rm < 8);
+    emit8(0x0F);
+    emit8(opc);
+    modrm(reg, rm);
+}
+
+void
+Assembler::op0f(uint8_t opc, bool wide, int reg, Mem mem)
+{
+    rex(wide, reg, mem.base);
+    emit8(0x0F);
+    emit8(opc);
+    modrm(reg, mem);
+}
+
+void
+Assembler::rel32(Label &label)
+{
+    if (label.pos >= 0) {
+        emit32(label.pos - (int)(size() + 4));
+    } else {
+        label.uses.push_back(size());
+        emit32(0);
+    }
+}
+
+void
+Assembler::bind(Label &label)
+{
+    label.pos = size();
+    for (int use : label.uses) {
+        int32_t disp = label.pos - (use + 4);
+        memcpy(&code[use], &disp, 4);
+    }
+    label.uses.clear();
+}
+
+void
+Assembler::mov(Reg dst, Reg src, bool wide)
+{
+    op(0x89, wide, src, dst);
+}
+
+void
+Assembler::mov(Reg dst, Mem src, bool wide)
+{
+    op(0x8B, wide, dst, src);
+}
+
+void
+Assembler::mov(Mem dst, Reg src, bool wide)
+{
+    op(0x89, wide, src, dst);
+}
+
+void
+Assembler::mov(Reg dst, int64_t imm)
+{
+    if (imm >= 0 && imm <= UINT32_MAX) {
+        // mov r32, imm32 zero-extends.
+        rex(false, 0, dst);
+        emit8(0xB8 | (dst & 7));
+        emit32(imm);
+    } else if (imm >= INT32_MIN && imm <= INT32_MAX) {
+        op(0xC7, true, 0, dst);
+        emit32(imm);
+    } else {
+        rex(true, 0, dst);
+        emit8(0xB8 | (dst & 7));
+        emit64(imm);
+    }
+}
+
+void
+Assembler::mov(Mem dst, int32_t imm, bool wide)
+{
+    op(0xC7, wide, 0, dst);
+    emit32(imm);
+}
+
+void
+Assembler::movsxd(Reg dst, Reg src)
+{
+    op(0x63, true, dst, src);
+}
+
+void
+Assembler::movsxd(Reg dst, Mem src)
+{
+    op(0x63, true, dst, src);
+}
+
+void
+Assembler::movzxb(Reg dst, Reg src)
+{
+    op0f(0xB6, false, dst, src, true);
+}
+
+void
+Assembler::lea(Reg dst, Mem src)
+{
+    op(0x8D, true, dst, src);
+}
+
+void
+Assembler::xchg(Reg a, Reg b)
+{
+    op(0x87, true, b, a);
+}
+
+void
+Assembler::alu(AluOp aop, Reg dst, Reg src, bool wide)
+{
+    op((aop << 3) | 1, wide, src, dst);
+}
+
+void
+Assembler::alu(AluOp aop, Reg dst, Mem src, bool wide)
+{
+    op((aop << 3) | 3, wide, dst, src);
+}
+
+void
+Assembler::alu(AluOp aop, Mem dst, Reg src, bool wide)
+{
+    op((aop << 3) | 1, wide, src, dst);
+}
+
+void
+Assembler::alu(AluOp aop, Reg dst, int32_t imm, bool wide)
+{
+    if (is_int8(imm)) {
+        op(0x83, wide, aop, dst);
+        emit8(imm);
+    } else {
+        op(0x81, wide, aop, dst);
+        emit32(imm);
+    }
+}
+
+void
+Assembler::alu(AluOp aop, Mem dst, int32_t imm, bool wide)
+{
+    if (is_int8(imm)) {
+        op(0x83, wide, aop, dst);
+        emit8(imm);
+    } else {
+        op(0x81, wide, aop, dst);
+        emit32(imm);
+    }
+}
+
+void
+Assembler::alu(AluOp aop, const void *slot, int32_t imm)
+{
+    // RIP-relative displacements count from the end of the instruction, so
+    // the immediate after the displacement is subtracted up front.
+    int tail = is_int8(imm) ? 1 : 4;
+    emit8(tail == 1 ? 0x83 : 0x81);
+    emit8((aop << 3) | 5);
+    abs_refs.push_back({ size(), (const uint8_t *)slot - tail });
+    emit32(0);
+    if (tail == 1) {
+        emit8(imm);
+    } else {
+        emit32(imm);
+    }
+}
+
+void
+Assembler::imul(Reg dst, Reg src, bool wide)
+{
+    op0f(0xAF, wide, dst, src);
+}
+
+void
+Assembler::imul(Reg dst, Mem src)
+{
+    op0f(0xAF, false, dst, src);
+}
+
+void
+Assembler::imul(Reg dst, Reg src, int32_t imm)
+{
+    if (is_int8(imm)) {
+        op(0x6B, false, dst, src);
+        emit8(imm);
+    } else {
+        op(0x69, false, dst, src);
+        emit32(imm);
+    }
+}
+
+void
+Assembler::idiv(Reg src)
+{
+    op(0xF7, false, 7, src);
+}
+
+void
+Assembler::idiv(Mem src)
+{
+    op(0xF7, false, 7, src);
+}
+
+void
+Assembler::cdq()
+{
+    emit8(0x99);
+}
+
+void
+Assembler::neg(Reg dst)
+{
+    op(0xF7, false, 3, dst);
+}
+
+void
+Assembler::shift(ShiftOp sop, Reg dst, uint8_t count, bool wide)
+{
+    if (count == 1) {
+        op(0xD1, wide, sop, dst);
+    } else {
+        op(0xC1, wide, sop, dst);
+        emit8(count);
+    }
+}
+
+void
+Assembler::test(Reg a, Reg b, bool wide)
+{
+    op(0x85, wide, b, a);
+}
+
+void
+Assembler::setcc(Cond cond, Reg dst)
+{
+    op0f(0x90 | cond, false, 0, dst, true);
+}
+
+void
+Assembler::push(Reg src)
+{
+    rex(false, 0, src);
+    emit8(0x50 | (src & 7));
+}
+
+void
+Assembler::pop(Reg dst)
+{
+    rex(false, 0, dst);
+    emit8(0x58 | (dst & 7));
+}
+
+void
+Assembler::jmp(Label &label)
+{
+    emit8(0xE9);
+    rel32(label);
+}
+
+void
+Assembler::jcc(Cond cond, Label &label)
+{
+    emit8(0x0F);
+    emit8(0x80 | cond);
+    rel32(label);
+}
+
+void
+Assembler::call(Label &label)
+{
+    emit8(0xE8);
+    rel32(label);
+}
+
+void
+Assembler::call(Reg target)
+{
+    op(0xFF, false, 2, target);
+}
+
+void
+Assembler::call_indirect(const void *slot)
+{
+    emit8(0xFF);
+    emit8(0x15);
+    abs_refs.push_back({ size(), slot });
+    emit32(0);
+}
+
+void
+Assembler::jmp_indirect(const void *slot)
+{
+    emit8(0xFF);
+    emit8(0x25);
+    abs_refs.push_back({ size(), slot });
+    emit32(0);
+}
+
+void
+Assembler::ret()
+{
+    emit8(0xC3);
+}
+
+void
+Assembler::copy_to(uint8_t *dst)
+{
+    memcpy(dst, code.data(), code.size());
+
+    for (auto [pos, target] : abs_refs) {
+        int64_t disp = (const uint8_t *)target - (dst + pos + 4);
+        if (disp < INT32_MIN || disp > INT32_MAX) {
+            perror("Code reference out of rel32 range");
+            exit(EXIT_FAILURE);
+        }
+        int32_t disp32 = disp;
+        memcpy(dst + pos, &disp32, 4);
+    }
+}
+
+static size_t
+page_align(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+CodeArena::CodeArena(size_t reserve)
+    : reserved(page_align(reserve))
+{
+    void *p = mmap(nullptr,
+                   reserved,
+                   PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1,
+                   0);
+    if (p == MAP_FAILED) {
+        perror("mmap()");
+        exit(EXIT_FAILURE);
+    }
+    base = (uint8_t *)p;
+}
+
+CodeArena::~CodeArena()
+{
+    munmap(base, reserved);
+}
+
+static uint8_t *
+take_pages(uint8_t *base, size_t reserved, size_t &used, size_t size)
+{
+    size = page_align(size);
+    if (used + size > reserved) {
+        perror("Out of JIT code space");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t *p = base + used;
+    used += size;
+    if (mprotect(p, size, PROT_READ | PROT_WRITE) != 0) {
+        perror("mprotect()");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+void *
+CodeArena::allocate_data(size_t size)
+{
+    return take_pages(base, reserved, used, size);
+}
+
+void *
+CodeArena::install(Assembler &as)
+{
+    size_t   size = page_align(as.size());
+    uint8_t *p    = take_pages(base, reserved, used, size);
+
+    as.copy_to(p);
+    if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect()");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
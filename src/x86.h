@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small x86-64 assembler, just big enough for the JIT. Instructions are
+// appended to a byte buffer; references to labels and to absolute addresses
+// outside the buffer are patched once the final location of the code is
+// known (see CodeArena).
+
+enum Reg : uint8_t {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+// Condition codes, numbered as in the Jcc and SETcc encodings.
+enum Cond : uint8_t {
+    CondB  = 0x2,
+    CondAE = 0x3,
+    CondE  = 0x4,
+    CondNE = 0x5,
+    CondBE = 0x6,
+    CondA  = 0x7,
+    CondL  = 0xC,
+    CondGE = 0xD,
+    CondLE = 0xE,
+    CondG  = 0xF,
+};
+
+static inline Cond
+negate(Cond cond)
+{
+    return (Cond)(cond ^ 1);
+}
+
+// The condition that holds with the operands of the comparison swapped.
+static inline Cond
+swap_operands(Cond cond)
+{
+    switch (cond) {
+    case CondL: return CondG;
+    case CondG: return CondL;
+    case CondLE: return CondGE;
+    case CondGE: return CondLE;
+    case CondB: return CondA;
+    case CondA: return CondB;
+    case CondBE: return CondAE;
+    case CondAE: return CondBE;
+    default: return cond;
+    }
+}
+
+// A memory operand [base + disp].
+struct Mem {
+    Reg     base;
+    int32_t disp;
+};
+
+struct Label {
+    int              pos = -1;
+    std::vector<int> uses;
+};
+
+// The group-1 ALU operations, numbered by their ModRM extension.
+enum AluOp : uint8_t {
+    AluAdd = 0,
+    AluOr  = 1,
+    AluAnd = 4,
+    AluSub = 5,
+    AluXor = 6,
+    AluCmp = 7,
+};
+
+// The group-2 shift operations, numbered by their ModRM extension.
+enum ShiftOp : uint8_t {
+    ShiftShl = 4,
+    ShiftShr = 5,
+    ShiftSar = 7,
+};
+
+class Assembler {
+private:
+    // rel32 fields to patch with the distance to an absolute address, keyed
+    // by their offset in `code`.
+    std::vector<std::pair<int, const void *>> abs_refs;
+
+    void emit8(uint8_t b)
+    {
+        code.push_back(b);
+    }
+    void emit32(int32_t v);
+    void emit64(int64_t v);
+
+    void rex(bool wide, int reg, int rm, bool force = false);
+    void modrm(int reg, int rm);
+    void modrm(int reg, Mem mem);
+
+    // Emits an instruction with a register-register or register-memory ModRM
+    // operand. `byte_rm` forces a REX prefix so that registers 4-7 name the
+    // low bytes of RSP..RDI rather than AH..BH.
+    void op(uint8_t opc, bool wide, int reg, int rm, bool byte_rm = false);
+    void op(uint8_t opc, bool wide, int reg, Mem mem);
+    void op0f(uint8_t opc, bool wide, int reg, int rm, bool byte_rm = false);
+    void op0f(uint8_t opc, bool wide, int reg, Mem mem);
+
+    void rel32(Label &label);
+
+public:
+    std::vector<uint8_t> code;
+
+    size_t size() const
+    {
+        return code.size();
+    }
+
+    void bind(Label &label);
+
+    // Moves. `wide` selects 64-bit operands; 32-bit writes to a register
+    // zero the upper half.
+    void mov(Reg dst, Reg src, bool wide = true);
+    void mov(Reg dst, Mem src, bool wide = true);
+    void mov(Mem dst, Reg src, bool wide = true);
+    void mov(Reg dst, int64_t imm);
+    void mov(Mem dst, int32_t imm, bool wide = true);
+    void movsxd(Reg dst, Reg src);
+    void movsxd(Reg dst, Mem src);
+    void movzxb(Reg dst, Reg src);
+    void lea(Reg dst, Mem src);
+    void xchg(Reg a, Reg b);
+
+    void alu(AluOp op, Reg dst, Reg src, bool wide = false);
+    void alu(AluOp op, Reg dst, Mem src, bool wide = false);
+    void alu(AluOp op, Mem dst, Reg src, bool wide = false);
+    void alu(AluOp op, Reg dst, int32_t imm, bool wide = false);
+    void alu(AluOp op, Mem dst, int32_t imm, bool wide = false);
+    // op dword [rip + disp], imm on the 32-bit value stored at `slot`.
+    void alu(AluOp op, const void *slot, int32_t imm);
+
+    void imul(Reg dst, Reg src, bool wide = false);
+    void imul(Reg dst, Mem src);
+    void imul(Reg dst, Reg src, int32_t imm);
+    void idiv(Reg src);
+    void idiv(Mem src);
+    void cdq();
+    void neg(Reg dst);
+    void shift(ShiftOp op, Reg dst, uint8_t count, bool wide = false);
+    void test(Reg a, Reg b, bool wide = false);
+    void setcc(Cond cond, Reg dst);
+
+    void push(Reg src);
+    void pop(Reg dst);
+
+    void jmp(Label &label);
+    void jcc(Cond cond, Label &label);
+    void call(Label &label);
+    void call(Reg target);
+    // call qword [rip + disp], calling through a function pointer stored at
+    // `slot`.
+    void call_indirect(const void *slot);
+    // jmp qword [rip + disp], likewise.
+    void jmp_indirect(const void *slot);
+    void ret();
+
+    // Copies the code to `dst` and resolves absolute references for code
+    // that will run from there.
+    void copy_to(uint8_t *dst);
+};
+
+// Executable memory for generated code. One contiguous range is reserved up
+// front so that all code and the data it references directly stay within
+// rel32 range of each other. Pages are never writable and executable at the
+// same time: code is written into read-write pages that are then flipped to
+// read-execute.
+class CodeArena {
+private:
+    uint8_t *base     = nullptr;
+    size_t   reserved = 0;
+    size_t   used     = 0;
+
+public:
+    CodeArena(size_t reserve);
+    ~CodeArena();
+
+    CodeArena(const CodeArena &)            = delete;
+    CodeArena &operator=(const CodeArena &) = delete;
+
+    // Allocates zeroed read-write memory for data that generated code reads
+    // through rel32 displacements.
+    void *allocate_data(size_t size);
+
+    // Places the assembled code in fresh pages, makes them executable and
+    // returns the address of its first byte.
+    void *install(Assembler &as);
+};